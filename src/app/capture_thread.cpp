@@ -39,6 +39,8 @@ CaptureThread::CaptureThread(int cam_id)
   control->addChild( (VarType*) (c_auto_refresh= new VarBool("auto refresh params",true)));
   // timings should only be printed on demand for a short period of time by temporally activating this flag
   control->addChild( (VarType*) (c_print_timings = new VarBool("print timings",false)));
+  // grab the next frame in a separate thread while the current one is processed
+  control->addChild( (VarType*) (c_pipelined = new VarBool("pipelined capture",false)));
   control->addChild( (VarType*) (c_refresh= new VarTrigger("re-read params","Refresh")));
   control->addChild( (VarType*) (captureModule= new VarStringEnum("Capture Module",camId < 1 ? "Read from files" : "None")));
   captureModule->addFlags(VARTYPE_FLAG_NOLOAD_ENUM_CHILDREN);
@@ -135,6 +137,8 @@ CaptureThread::CaptureThread(int cam_id)
 
   selectCaptureMethod();
   _kill =false;
+  _grabber_kill=false;
+  _post_process=true;
   rb=0;
 }
 
@@ -154,6 +158,8 @@ VarList * CaptureThread::getSettings() {
 
 CaptureThread::~CaptureThread()
 {
+  stopGrabber();
+  delete grab_rb;
   delete captureVideo;
   delete captureFiles;
   delete captureGenerator;
@@ -198,6 +204,7 @@ CaptureThread::~CaptureThread()
 
 void CaptureThread::setFrameBuffer(FrameBuffer * _rb) {
   rb=_rb;
+  slot_stats=registerFrameDataSlot<CaptureStats>(rb,"capture_stats",[]() { return new CaptureStats(); });
 }
 
 FrameBuffer * CaptureThread::getFrameBuffer() const {
@@ -208,6 +215,12 @@ VisionStack * CaptureThread::getStack() const {
   return stack;
 }
 
+void CaptureThread::setPostProcess(bool enable) {
+  // postProcess() only prepares data for visualization,
+  // so it can be skipped entirely when nobody is watching.
+  _post_process=enable;
+}
+
 void CaptureThread::selectCaptureMethod() {
   capture_mutex.lock();
   CaptureInterface * old_capture=capture;
@@ -340,77 +353,82 @@ void CaptureThread::run() {
       if (rb!=0) {
         int idx=rb->curWrite();
         FrameData * d=rb->getPointer(idx);
-        if ((stats=(CaptureStats *)d->map.get("capture_stats")) == 0) {
-          stats=(CaptureStats *)d->map.insert("capture_stats",new CaptureStats());
-        }
-        capture_mutex.lock();
-        if ((capture != nullptr) && (capture->isCapturing())) {
-          auto t_start = std::chrono::steady_clock::now();
-          RawImage pic_raw=capture->getFrame();
-          auto t_getFrame = std::chrono::steady_clock::now();
-          pic_raw.setTime(GetTimeSec());
-          d->time = pic_raw.getTime();
-          d->time_cam=pic_raw.getTimeCam();
-          bool bSuccess = capture->copyAndConvertFrame( pic_raw,d->video);
-          auto t_convert = std::chrono::steady_clock::now();
-          capture_mutex.unlock();
+        stats=d->map.get(slot_stats);
+        if (c_pipelined->getBool()) {
+          if (grabber == nullptr) startGrabber();
+          processGrabbedFrame(d, stats);
+        } else {
+          if (grabber != nullptr) stopGrabber();
+          capture_mutex.lock();
+          if ((capture != nullptr) && (capture->isCapturing())) {
+            auto t_start = std::chrono::steady_clock::now();
+            RawImage pic_raw=capture->getFrame();
+            auto t_getFrame = std::chrono::steady_clock::now();
+            pic_raw.setTime(GetTimeSec());
+            d->time = pic_raw.getTime();
+            d->time_cam=pic_raw.getTimeCam();
+            bool bSuccess = capture->copyAndConvertFrame( pic_raw,d->video);
+            auto t_convert = std::chrono::steady_clock::now();
+            capture_mutex.unlock();
+
+            if (bSuccess) {           //only on a good frame read do we proceed
+                counter->count();
+                stats->total=d->number=counter->getTotal();
+                stats->fps_capture=counter->getFPS(changed);
 
-          if (bSuccess) {           //only on a good frame read do we proceed
-              counter->count();
-              stats->total=d->number=counter->getTotal();
-              stats->fps_capture=counter->getFPS(changed);
-
-              stack_mutex.lock();
-              if (stack!=0) {
-                stack->process(d);
-                stack->postProcess(d);
-              }
-              stack_mutex.unlock();
-              rb->nextWrite(true);
-
-            auto t_process = std::chrono::steady_clock::now();
-
-              if(c_print_timings->getBool())
-              {
-                auto getFrame_duration = std::chrono::duration_cast<std::chrono::microseconds>(t_getFrame - t_start);
-                std::cout << std::setw(13) << std::left << "getFrame"
-                          << std::setw(5) << std::right << getFrame_duration.count() << " μs" << std::endl;
-                auto convert_duration = std::chrono::duration_cast<std::chrono::microseconds>(t_convert - t_getFrame);
-                std::cout << std::setw(13) << std::left << "copy&convert"
-                          << std::setw(5) << std::right << convert_duration.count() << " μs" << std::endl;
-                auto process_duration = std::chrono::duration_cast<std::chrono::microseconds>(t_process - t_convert);
-                std::cout << std::setw(13) << std::left << "process"
-                          << std::setw(5) << std::right << process_duration.count() << " μs" << std::endl;
-                auto total_duration = std::chrono::duration_cast<std::chrono::microseconds>(t_process - t_start);
-                std::cout << std::setw(13) << std::left << "total"
-                          << std::setw(5) << std::right << total_duration.count() << " μs" << std::endl << std::endl;
-              }
-
-              if (changed) {
-                if (c_auto_refresh->getBool()==true) {
-                  capture_mutex.lock();
-                  if ((capture != 0) && (capture->isCapturing())) capture->readAllParameterValues();
-                  capture_mutex.unlock();
-                }
                 stack_mutex.lock();
-                stack->updateTimingStatistics();
+                if (stack!=0) {
+                  stack->process(d);
+                  if (_post_process) stack->postProcess(d);
+                }
                 stack_mutex.unlock();
-              }
-          }
+                rb->nextWrite(true);
+
+              auto t_process = std::chrono::steady_clock::now();
+
+                if(c_print_timings->getBool())
+                {
+                  auto getFrame_duration = std::chrono::duration_cast<std::chrono::microseconds>(t_getFrame - t_start);
+                  std::cout << std::setw(13) << std::left << "getFrame"
+                            << std::setw(5) << std::right << getFrame_duration.count() << " μs" << std::endl;
+                  auto convert_duration = std::chrono::duration_cast<std::chrono::microseconds>(t_convert - t_getFrame);
+                  std::cout << std::setw(13) << std::left << "copy&convert"
+                            << std::setw(5) << std::right << convert_duration.count() << " μs" << std::endl;
+                  auto process_duration = std::chrono::duration_cast<std::chrono::microseconds>(t_process - t_convert);
+                  std::cout << std::setw(13) << std::left << "process"
+                            << std::setw(5) << std::right << process_duration.count() << " μs" << std::endl;
+                  auto total_duration = std::chrono::duration_cast<std::chrono::microseconds>(t_process - t_start);
+                  std::cout << std::setw(13) << std::left << "total"
+                            << std::setw(5) << std::right << total_duration.count() << " μs" << std::endl << std::endl;
+                }
 
-          capture_mutex.lock();
-          if ((capture != nullptr) && (capture->isCapturing())) {
-            capture->releaseFrame();
+                if (changed) {
+                  if (c_auto_refresh->getBool()==true) {
+                    capture_mutex.lock();
+                    if ((capture != 0) && (capture->isCapturing())) capture->readAllParameterValues();
+                    capture_mutex.unlock();
+                  }
+                  stack_mutex.lock();
+                  stack->updateTimingStatistics();
+                  stack_mutex.unlock();
+                }
+            }
+
+            capture_mutex.lock();
+            if ((capture != nullptr) && (capture->isCapturing())) {
+              capture->releaseFrame();
+            }
+            capture_mutex.unlock();
+          } else {
+            stats->total=d->number=counter->getTotal();
+            stats->fps_capture=counter->getFPS(changed);
+            //we are not capturing...chill this thread out...
+            capture_mutex.unlock();
+            usleep(5000);
           }
-          capture_mutex.unlock();
-        } else {
-          stats->total=d->number=counter->getTotal();
-          stats->fps_capture=counter->getFPS(changed);
-          //we are not capturing...chill this thread out...
-          capture_mutex.unlock();
-          usleep(5000);
         }
         if (_kill) {
+          stopGrabber();
           capture_mutex.lock();
           if(capture != nullptr) {
             capture->stopCapture();
@@ -423,3 +441,111 @@ void CaptureThread::run() {
       }
     }
 }
+
+void CaptureThread::startGrabber() {
+  if (grab_rb == nullptr) grab_rb = new RingBuffer<RawImage>(3);
+  _grabber_kill = false;
+  grabber = new CaptureGrabber(this);
+  grabber->start();
+}
+
+void CaptureThread::stopGrabber() {
+  if (grabber == nullptr) return;
+  _grabber_kill = true;
+  grabber->wait();
+  delete grabber;
+  grabber = nullptr;
+}
+
+void CaptureGrabber::run() {
+  owner->grabLoop();
+}
+
+void CaptureThread::grabLoop() {
+  while (!_grabber_kill) {
+    RawImage * target = grab_rb->getPointer(grab_rb->curWrite());
+    capture_mutex.lock();
+    if ((capture != nullptr) && (capture->isCapturing())) {
+      RawImage pic_raw=capture->getFrame();
+      pic_raw.setTime(GetTimeSec());
+      bool bSuccess = capture->copyAndConvertFrame(pic_raw,*target);
+      // the frame has been copied, so the camera can refill its buffer right away
+      capture->releaseFrame();
+      capture_mutex.unlock();
+      if (bSuccess) {
+        grab_rb->nextWrite(true);
+        {
+          std::lock_guard<std::mutex> lock(grab_wait_mutex);
+        }
+        grab_wait.notify_one();
+      }
+    } else {
+      capture_mutex.unlock();
+      usleep(5000);
+    }
+  }
+}
+
+void CaptureThread::processGrabbedFrame(FrameData * d, CaptureStats * stats) {
+  bool changed;
+  auto t_start = std::chrono::steady_clock::now();
+
+  // wait for a frame that has not been processed yet
+  if (grab_rb->latestSequence() == last_grabbed_seq) {
+    std::unique_lock<std::mutex> lock(grab_wait_mutex);
+    grab_wait.wait_for(lock, std::chrono::milliseconds(5), [this]() {
+      return grab_rb->latestSequence() != last_grabbed_seq || _kill;
+    });
+  }
+  grab_rb->nextRead(true);
+  uint64_t seq = grab_rb->curReadSequence();
+  if (seq == 0 || seq == last_grabbed_seq) {
+    stats->total=d->number=counter->getTotal();
+    stats->fps_capture=counter->getFPS(changed);
+    return;
+  }
+  last_grabbed_seq = seq;
+
+  // hand the grabbed image over to the frame without copying:
+  // the grabber will reuse the previous buffer of this frame
+  RawImage * grabbed = grab_rb->getPointer(grab_rb->curRead());
+  std::swap(*grabbed, d->video);
+  d->time = d->video.getTime();
+  d->time_cam = d->video.getTimeCam();
+  auto t_grabbed = std::chrono::steady_clock::now();
+
+  counter->count();
+  stats->total=d->number=counter->getTotal();
+  stats->fps_capture=counter->getFPS(changed);
+
+  stack_mutex.lock();
+  if (stack!=0) {
+    stack->process(d);
+    if (_post_process) stack->postProcess(d);
+  }
+  stack_mutex.unlock();
+  rb->nextWrite(true);
+
+  auto t_process = std::chrono::steady_clock::now();
+
+  if(c_print_timings->getBool())
+  {
+    auto wait_duration = std::chrono::duration_cast<std::chrono::microseconds>(t_grabbed - t_start);
+    std::cout << std::setw(13) << std::left << "wait"
+              << std::setw(5) << std::right << wait_duration.count() << " μs" << std::endl;
+    auto process_duration = std::chrono::duration_cast<std::chrono::microseconds>(t_process - t_grabbed);
+    std::cout << std::setw(13) << std::left << "process"
+              << std::setw(5) << std::right << process_duration.count() << " μs" << std::endl << std::endl;
+  }
+
+  if (changed) {
+    if (c_auto_refresh->getBool()==true) {
+      capture_mutex.lock();
+      if ((capture != 0) && (capture->isCapturing())) capture->readAllParameterValues();
+      capture_mutex.unlock();
+    }
+    stack_mutex.lock();
+    stack->updateTimingStatistics();
+    stack_mutex.unlock();
+  }
+}
@@ -29,6 +29,9 @@
 #include "capture_generator.h"
 #include "capture_splitter.h"
 #include <QThread>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include "ringbuffer.h"
 #include "framedata.h"
 #include "framecounter.h"
@@ -64,6 +67,24 @@
 #include "capture_daheng.h"
 #endif
 
+class CaptureThread;
+
+/*!
+  \class   CaptureGrabber
+  \brief   The grabber stage of a CaptureThread running in pipelined mode
+
+  Dequeues and converts the next camera frame while the owning
+  CaptureThread still processes the previous one.
+*/
+class CaptureGrabber : public QThread
+{
+protected:
+  CaptureThread * owner;
+public:
+  explicit CaptureGrabber(CaptureThread * _owner) : owner(_owner) {}
+  void run() override;
+};
+
 /*!
   \class   CaptureThread
   \brief   A thread for capturing and processing video data
@@ -72,6 +93,7 @@
 class CaptureThread : public QThread
 {
 Q_OBJECT
+friend class CaptureGrabber;
 protected:
   QMutex stack_mutex; //this mutex protects multi-threaded operations on the stack
   QMutex capture_mutex; //this mutex protects multi-threaded operations on the capture control
@@ -93,7 +115,9 @@ protected:
   CaptureInterface * captureDaheng = nullptr;
   AffinityManager * affinity;
   FrameBuffer * rb;
+  FrameDataSlot<CaptureStats> slot_stats;
   bool _kill;
+  bool _post_process;
   int camId;
   VarList * settings;
   VarList * dc1394 = nullptr;
@@ -116,8 +140,21 @@ protected:
   VarTrigger * c_refresh;
   VarBool * c_auto_refresh;
   VarBool * c_print_timings;
+  VarBool * c_pipelined;
   VarStringEnum * captureModule;
 
+  // pipelined mode: the grabber fills grab_rb, the capture thread consumes its latest bin
+  CaptureGrabber * grabber = nullptr;
+  RingBuffer<RawImage> * grab_rb = nullptr;
+  std::atomic<bool> _grabber_kill;
+  std::mutex grab_wait_mutex;
+  std::condition_variable grab_wait;
+  uint64_t last_grabbed_seq = 0;
+  void startGrabber();
+  void stopGrabber();
+  void grabLoop();
+  void processGrabbedFrame(FrameData * d, CaptureStats * stats);
+
 public slots:
   bool init();
   bool stop();
@@ -130,6 +167,7 @@ public:
   FrameBuffer * getFrameBuffer() const;
   void setStack(VisionStack * _stack);
   VisionStack * getStack() const;
+  void setPostProcess(bool enable);
   void kill();
   VarList * getSettings();
   void setAffinityManager(AffinityManager * _affinity);
@@ -20,6 +20,69 @@
 //========================================================================
 
 #include "framedata.h"
+#include <stdio.h>
+
+std::mutex FrameDataRegistry::mutex;
+vector<FrameDataRegistry::Entry> FrameDataRegistry::entries;
+
+int FrameDataRegistry::lookupOrRegister(const string & label, const std::type_index & type, Deleter deleter) {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (unsigned int i = 0; i < entries.size(); i++) {
+    if (entries[i].label == label) {
+      if (entries[i].type != type) {
+        fprintf(stderr, "FrameData slot '%s' is already registered with a different type!\n", label.c_str());
+        return -1;
+      }
+      return (int)i;
+    }
+  }
+  if (entries.size() >= FRAME_DATA_MAX_SLOTS) {
+    fprintf(stderr, "Unable to register FrameData slot '%s': all %d slots are taken.\n", label.c_str(), FRAME_DATA_MAX_SLOTS);
+    return -1;
+  }
+  entries.push_back({label, type, deleter});
+  return (int)entries.size() - 1;
+}
+
+int FrameDataRegistry::lookup(const string & label) {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (unsigned int i = 0; i < entries.size(); i++) {
+    if (entries[i].label == label) return (int)i;
+  }
+  return -1;
+}
+
+FrameDataRegistry::Deleter FrameDataRegistry::getDeleter(int index) {
+  std::lock_guard<std::mutex> lock(mutex);
+  return entries[index].deleter;
+}
+
+FrameDataMap::FrameDataMap() {
+  for (int i = 0; i < FRAME_DATA_MAX_SLOTS; i++) {
+    items[i] = nullptr;
+    owned[i] = false;
+  }
+}
+
+FrameDataMap::~FrameDataMap() {
+  for (int i = 0; i < FRAME_DATA_MAX_SLOTS; i++) {
+    release(i);
+  }
+}
+
+void FrameDataMap::release(int index) {
+  if (owned[index] && items[index] != nullptr) {
+    FrameDataRegistry::getDeleter(index)(items[index]);
+  }
+  items[index] = nullptr;
+  owned[index] = false;
+}
+
+void * FrameDataMap::get(const string & label) const {
+  int index = FrameDataRegistry::lookup(label);
+  if (index < 0) return nullptr;
+  return items[index];
+}
 
 FrameData::FrameData()
 {
@@ -24,44 +24,111 @@
 #define FRAMEDATA_H
 #include "ringbuffer.h"
 #include "rawimage.h"
-#include <map>
+#include <functional>
 #include <mutex>
-#include <shared_mutex>
+#include <string>
+#include <typeindex>
+#include <vector>
 using namespace std;
 
+/// maximum number of distinct slots that can be registered in a FrameDataMap
+#define FRAME_DATA_MAX_SLOTS 32
+
+/*!
+  \class   FrameDataSlot
+  \brief   A typed handle to one entry of a FrameDataMap
+
+  Handles are obtained once via registerFrameDataSlot() when a plugin is
+  constructed and then used for O(1), lock-free access on every frame.
+*/
+template <class T>
+class FrameDataSlot
+{
+public:
+  int index;
+  FrameDataSlot() : index(-1) {}
+  explicit FrameDataSlot(int _index) : index(_index) {}
+  bool valid() const {
+    return index >= 0;
+  }
+};
+
+/*!
+  \class   FrameDataRegistry
+  \brief   Process-wide registry of all FrameDataMap slots
+
+  Maps slot labels to indices, so that a producer and all consumers of
+  e.g. "cmv_threshold" end up with the same handle. It also checks that all
+  of them agree on the stored type.
+*/
+class FrameDataRegistry
+{
+public:
+  typedef void (*Deleter)(void *);
+
+  /// returns the index of \p label, registering it if necessary.
+  /// returns -1 if the label is known with a different type or if all slots are taken.
+  static int lookupOrRegister(const string & label, const std::type_index & type, Deleter deleter);
+
+  /// returns the index of \p label or -1 if it was never registered
+  static int lookup(const string & label);
+
+  static Deleter getDeleter(int index);
+
+private:
+  struct Entry {
+    string label;
+    std::type_index type;
+    Deleter deleter;
+  };
+  static std::mutex mutex;
+  static vector<Entry> entries;
+};
+
 /*!
   \class   FrameDataMap
   \brief   A general storage map, for plugins to store and read their data
   \author  Stefan Zickler, (C) 2008
 
-  This class acts as a storage map of string and data-pointer pairs.
-  This allows any plugin to make its results publicly available to the
-  entire image stack pipeline for the current frame.
+  This class acts as a storage map of typed data-pointers, addressed by
+  FrameDataSlot handles. This allows any plugin to make its results publicly
+  available to the entire image stack pipeline for the current frame.
+
+  All slots are allocated when they are registered, i.e. while the stacks
+  are constructed, so reading or writing a slot never allocates or locks.
+  Only the owning capture thread may replace a slot of a frame it is writing.
 */
-class FrameDataMap : protected map<string,void *>
+class FrameDataMap
 {
 public:
-  void * get(const string & label) const {
-    std::shared_lock lock(map_mutex);
-    map<string,void *>::const_iterator iter = map<string,void *>::find(label);
-    if (iter==map<string,void *>::end()) return 0;
-    return iter->second;
-  }
-  void * insert(const string & label, void * item) {
-    std::unique_lock lock(map_mutex);
-    pair< map<string,void *>::iterator, bool > pair = map<string,void *>::insert ( make_pair(label,item) );
-    if (pair.first==map<string,void *>::end()) return 0;
-    return pair.first->second;
+  FrameDataMap();
+  ~FrameDataMap();
+  FrameDataMap(const FrameDataMap &) = delete;
+  FrameDataMap & operator=(const FrameDataMap &) = delete;
+
+  template <class T>
+  T * get(FrameDataSlot<T> slot) const {
+    if (!slot.valid()) return nullptr;
+    return static_cast<T *>(items[slot.index]);
   }
-  void * update(const string & label, void * item) {
-    {
-      std::unique_lock lock(map_mutex);
-      erase(label);
-    }
-    return insert(label, item);
+
+  /// replaces the item of \p slot by \p item, deleting the previous one if it was owned
+  template <class T>
+  T * replace(FrameDataSlot<T> slot, T * item, bool take_ownership = true) {
+    if (!slot.valid()) return nullptr;
+    release(slot.index);
+    items[slot.index] = item;
+    owned[slot.index] = take_ownership;
+    return item;
   }
+
+  /// string based lookup, meant for the GUI and debugging only
+  void * get(const string & label) const;
+
 private:
-  mutable std::shared_mutex map_mutex;
+  void release(int index);
+  void * items[FRAME_DATA_MAX_SLOTS];
+  bool owned[FRAME_DATA_MAX_SLOTS];
 };
 
 /*!
@@ -95,4 +162,28 @@ public:
 */
 typedef RingBuffer<FrameData> FrameBuffer;
 
+/*!
+  \brief Registers the slot \p label for items of type \p T in all frames of \p buffer
+
+  If \p factory is given, every frame of the buffer which does not yet hold
+  an item for this slot gets one from the factory. Without a factory the
+  slot stays empty until a producer fills it via FrameDataMap::replace().
+
+  Registering the same label again, e.g. from a consumer, returns the same
+  handle. An invalid handle is returned on a type mismatch.
+*/
+template <class T>
+FrameDataSlot<T> registerFrameDataSlot(FrameBuffer * buffer, const string & label,
+                                       const std::function<T *()> & factory = nullptr) {
+  int index = FrameDataRegistry::lookupOrRegister(label, std::type_index(typeid(T)),
+                                                  [](void * p) { delete static_cast<T *>(p); });
+  FrameDataSlot<T> slot(index);
+  if (!slot.valid() || buffer == nullptr || !factory) return slot;
+  for (int i = 0; i < buffer->size; i++) {
+    FrameDataMap & map = buffer->getPointer(i)->map;
+    if (map.get(slot) == nullptr) map.replace(slot, factory());
+  }
+  return slot;
+}
+
 #endif
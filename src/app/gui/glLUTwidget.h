@@ -73,6 +73,7 @@ class GLLUTWidget : public QGLWidget, public RealTimeDisplayWidget
       };
       void restore(LUT3D * lut) {
         memcpy(lut->getPointerPreshrunk(0,0,0),table,lut->LUT_SIZE);
+        lut->markAllDirty();
       }
   };
 
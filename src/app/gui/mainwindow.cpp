@@ -21,7 +21,7 @@
 
 #include "mainwindow.h"
 
-MainWindow::MainWindow(bool start_capture, bool enforce_affinity, int num_cameras)
+MainWindow::MainWindow(bool start_capture, bool enforce_affinity, int num_cameras, LUTChannelMode lut_mode)
 {
 
   affinity=0;
@@ -50,7 +50,7 @@ MainWindow::MainWindow(bool start_capture, bool enforce_affinity, int num_camera
   //opt->parse();
 
   //load RoboCup SSL stack by default:
-  multi_stack= new MultiStackRoboCupSSL(opts, num_cameras);
+  multi_stack= new MultiStackRoboCupSSL(opts, num_cameras, false, lut_mode);
 
   VarExternal * stackvar;
   root->addChild(stackvar= new VarExternal((multi_stack->getSettingsFileName() + ".xml").c_str(),multi_stack->getName()));
@@ -191,8 +191,9 @@ void MainWindow::timerEvent( QTimerEvent * e) {
     fb=w->getRingBuffer();
     if (fb!=0) {
       fb->lockRead();
-      int cur=fb->curRead();
-      if (fb->nextRead(true) != cur) frame_changed=true;
+      uint64_t seq=fb->curReadSequence();
+      fb->nextRead(true);
+      if (fb->curReadSequence() != seq) frame_changed=true;
       fb->unlockRead();
     }
     w->displayLoopEvent(frame_changed,opts);
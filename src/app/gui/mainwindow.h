@@ -68,7 +68,7 @@ public:
 
   MultiVisionStack * multi_stack;
 
-  MainWindow(bool start_capture, bool enforce_affinity, int num_cameras);
+  MainWindow(bool start_capture, bool enforce_affinity, int num_cameras, LUTChannelMode lut_mode = LUTChannelMode_Numeric);
   virtual ~MainWindow();
   void init();
   void Quit() { emit close(); }
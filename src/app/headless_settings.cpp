@@ -0,0 +1,61 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    headless_settings.cpp
+  \brief   C++ Implementation: settings tree for the GUI-free binaries
+*/
+//========================================================================
+
+#include "headless_settings.h"
+#include <QString>
+
+VarList * buildHeadlessSettingsTree(MultiVisionStack * multi_stack, AffinityManager * affinity) {
+  VarList * root = new VarList("Vision System");
+
+  VarExternal * stackvar;
+  root->addChild(stackvar = new VarExternal((multi_stack->getSettingsFileName() + ".xml").c_str(),multi_stack->getName()));
+  stackvar->addChild(multi_stack->getSettings());
+
+  for (unsigned int i=0;i<multi_stack->threads.size();i++) {
+    CaptureThread * thread = multi_stack->threads[i];
+    VisionStack * s = thread->getStack();
+    if (affinity!=0) thread->setAffinityManager(affinity);
+    thread->setPostProcess(false);
+
+    QString label = "Thread " + QString::number(i);
+#ifdef CAMERA_SPLITTER
+    if(i == multi_stack->threads.size() - 1)
+    {
+      label = "Distributor Thread";
+    }
+#endif
+
+    VarList * threadvar = new VarList(label.toStdString());
+    threadvar->addChild(s->getSettings());
+    threadvar->addChild(thread->getSettings());
+
+    for (auto p : s->stack) {
+      if (p->getSettings()==0) continue;
+      if (p->isSharedAmongStacks()) {
+        if (i==0) stackvar->addChild(p->getSettings());
+      } else {
+        threadvar->addChild(p->getSettings());
+      }
+    }
+    stackvar->addChild(threadvar);
+  }
+
+  return root;
+}
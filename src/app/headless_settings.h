@@ -0,0 +1,33 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    headless_settings.h
+  \brief   C++ Interface: settings tree for the GUI-free binaries
+*/
+//========================================================================
+
+#ifndef HEADLESS_SETTINGS_H
+#define HEADLESS_SETTINGS_H
+
+#include "VarTypes.h"
+#include "affinity_manager.h"
+#include "multivisionstack.h"
+
+/// Builds the data-tree exactly like the graphical application does, so that
+/// the same settings.xml can be shared between all binaries.
+/// Post-processing of all capture threads is disabled on the way.
+VarList * buildHeadlessSettingsTree(MultiVisionStack * multi_stack, AffinityManager * affinity);
+
+#endif // HEADLESS_SETTINGS_H
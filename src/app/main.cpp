@@ -90,11 +90,13 @@ int main(int argc, char *argv[])
   bool help=false;
   bool start=false;
   bool enforce_affinity=false;
+  bool bitwise_lut=false;
   QString camera_count;
   int ecode=0;
   opts.addSwitch("help",&help);
   opts.addShortOptSwitch( 'a',QString("Enforce Processor Affinity"),&enforce_affinity, false);
   opts.addShortOptSwitch( 's',QString("Start Capturing Immediately"),&start, false);
+  opts.addShortOptSwitch( 'b',QString("Bitwise LUT Channels"),&bitwise_lut, false);
   opts.addOptionalOption( 'c',QString("Camera Count"),&camera_count, QString("4"));
   if (!opts.parse()) {
     fprintf(stderr,"Invalid command line parameters!\n");
@@ -115,13 +117,15 @@ int main(int argc, char *argv[])
     printf(" -s        Start capture immediately\n");
     printf(" -a        Set Processor Affinity\n");
     printf(" -c <n>    Set Number of Cameras\n");
+    printf(" -b        Use bitwise LUTs, in which a color can belong to several channels\n");
     printf(" --help    Show this help\n");
     exit(ecode);
   }
 
   printPathWarning();
 
-  MainWindow mainWin(start, enforce_affinity, num_cameras);
+  MainWindow mainWin(start, enforce_affinity, num_cameras,
+                     bitwise_lut ? LUTChannelMode_Bitwise : LUTChannelMode_Numeric);
   mainWinPtr = &mainWin;
   mainWin.show();
   mainWin.init();
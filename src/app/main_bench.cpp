@@ -0,0 +1,662 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    main_bench.cpp
+  \brief   Offline benchmark of the RoboCup SSL vision stack.
+
+  Plays back a directory of recorded frames (any format accepted by
+  CaptureFromFile) through the plugin chain of one StackRoboCupSSL, exactly
+  as a capture thread would, but without starting any thread or opening
+  the network outputs.
+
+  For every plugin the latency of each frame is recorded and summarized as
+  p50/p99/max. Additionally the achieved frame rate and the number of bytes
+  allocated through operator new per frame are reported. The summary is
+  printed to stdout and can be written as JSON (-o) to compare commits.
+
+  With -t the segmentation plugin is first timed on a single frame for every
+  LUT layout it offers, which isolates the cost of the table lookups.
+  With -r the labeling of the runs of a single frame is timed with the runs
+  stored in the arrays of a RunList and as an array of Run structs.
+*/
+//========================================================================
+
+#include <QCoreApplication>
+#include <QString>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "qgetopt.h"
+#include "VarXML.h"
+#include "capturefromfile.h"
+#include "cmvision_threshold.h"
+#include "headless_settings.h"
+#include "multistack_robocup_ssl.h"
+#include "stack_robocup_ssl.h"
+#include "timer.h"
+
+//========================================================================
+// Allocation accounting: all plain operator new/delete calls of this
+// binary are routed through these counters.
+//========================================================================
+static std::atomic<unsigned long long> alloc_bytes(0);
+static std::atomic<unsigned long long> alloc_count(0);
+
+static void * countedAlloc(std::size_t size) {
+  alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+  alloc_count.fetch_add(1, std::memory_order_relaxed);
+  return malloc(size == 0 ? 1 : size);
+}
+
+void * operator new(std::size_t size) {
+  void * p = countedAlloc(size);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+
+void * operator new[](std::size_t size) {
+  void * p = countedAlloc(size);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+
+void * operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return countedAlloc(size);
+}
+
+void * operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return countedAlloc(size);
+}
+
+void operator delete(void * p) noexcept {
+  free(p);
+}
+
+void operator delete[](void * p) noexcept {
+  free(p);
+}
+
+void operator delete(void * p, std::size_t) noexcept {
+  free(p);
+}
+
+void operator delete[](void * p, std::size_t) noexcept {
+  free(p);
+}
+
+//========================================================================
+// Latency statistics
+//========================================================================
+struct BenchStage {
+  std::string name;
+  std::vector<double> samples; // microseconds, one per measured frame
+  double p50;
+  double p99;
+  double max;
+  double mean;
+
+  explicit BenchStage(const std::string & _name) : name(_name), p50(0), p99(0), max(0), mean(0) {}
+
+  // nearest-rank percentiles
+  void summarize() {
+    if (samples.empty()) return;
+    std::vector<double> sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+    size_t n = sorted.size();
+    p50 = sorted[(size_t)std::ceil(0.50 * n) - 1];
+    p99 = sorted[(size_t)std::ceil(0.99 * n) - 1];
+    max = sorted[n - 1];
+    double sum = 0;
+    for (double s : sorted) sum += s;
+    mean = sum / n;
+  }
+};
+
+static std::string jsonEscape(const std::string & s) {
+  std::string out;
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if ((unsigned char)c < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    } else {
+      out += c;
+    }
+  }
+  return out;
+}
+
+static bool writeJSON(const std::string & filename, const std::string & directory, int camera, int frames, int warmup,
+                      const std::string & kernel, double fps, double bytes_per_frame, double allocs_per_frame,
+                      const std::vector<BenchStage> & layouts, const std::vector<BenchStage> & run_layouts,
+                      const std::vector<BenchStage> & stages, const CMVision::ListArena * arena) {
+  FILE * f = fopen(filename.c_str(), "w");
+  if (f == nullptr) {
+    fprintf(stderr, "Unable to write %s\n", filename.c_str());
+    return false;
+  }
+  fprintf(f, "{\n");
+  fprintf(f, "  \"directory\": \"%s\",\n", jsonEscape(directory).c_str());
+  fprintf(f, "  \"camera\": %d,\n", camera);
+  fprintf(f, "  \"frames\": %d,\n", frames);
+  fprintf(f, "  \"warmup_frames\": %d,\n", warmup);
+  fprintf(f, "  \"threshold_kernel\": \"%s\",\n", jsonEscape(kernel).c_str());
+  fprintf(f, "  \"fps\": %.3f,\n", fps);
+  fprintf(f, "  \"bytes_allocated_per_frame\": %.1f,\n", bytes_per_frame);
+  fprintf(f, "  \"allocations_per_frame\": %.2f,\n", allocs_per_frame);
+  fprintf(f, "  \"lut_layouts\": [\n");
+  for (size_t i = 0; i < layouts.size(); i++) {
+    const BenchStage & s = layouts[i];
+    fprintf(f, "    {\"name\": \"%s\", \"p50_us\": %.2f, \"p99_us\": %.2f, \"max_us\": %.2f, \"mean_us\": %.2f}%s\n",
+            jsonEscape(s.name).c_str(), s.p50, s.p99, s.max, s.mean, (i + 1 < layouts.size()) ? "," : "");
+  }
+  fprintf(f, "  ],\n");
+  fprintf(f, "  \"run_layouts\": [\n");
+  for (size_t i = 0; i < run_layouts.size(); i++) {
+    const BenchStage & s = run_layouts[i];
+    fprintf(f, "    {\"name\": \"%s\", \"p50_us\": %.2f, \"p99_us\": %.2f, \"max_us\": %.2f, \"mean_us\": %.2f}%s\n",
+            jsonEscape(s.name).c_str(), s.p50, s.p99, s.max, s.mean, (i + 1 < run_layouts.size()) ? "," : "");
+  }
+  fprintf(f, "  ],\n");
+  if (arena != nullptr) {
+    fprintf(f, "  \"lists\": {\n");
+    const CMVision::ListCapacity * lists[2] = {&arena->runs, &arena->regions};
+    const char * names[2] = {"runs", "regions"};
+    for (int i = 0; i < 2; i++) {
+      fprintf(f, "    \"%s\": {\"capacity\": %d, \"high_water\": %d, \"overflow_frames\": %ld, \"grows\": %d}%s\n",
+              names[i], lists[i]->getCapacity(), lists[i]->getHighWater(), lists[i]->getOverflows(), lists[i]->getGrows(),
+              i == 0 ? "," : "");
+    }
+    fprintf(f, "  },\n");
+  }
+  fprintf(f, "  \"stages\": [\n");
+  for (size_t i = 0; i < stages.size(); i++) {
+    const BenchStage & s = stages[i];
+    fprintf(f, "    {\"name\": \"%s\", \"p50_us\": %.2f, \"p99_us\": %.2f, \"max_us\": %.2f, \"mean_us\": %.2f}%s\n",
+            jsonEscape(s.name).c_str(), s.p50, s.p99, s.max, s.mean, (i + 1 < stages.size()) ? "," : "");
+  }
+  fprintf(f, "  ]\n");
+  fprintf(f, "}\n");
+  fclose(f);
+  return true;
+}
+
+// reads an external settings file (e.g. a LUT or mask xml) into the children of an existing node
+static bool overrideExternal(VarList * stack_settings, const std::string & node_name, const std::string & filename) {
+  VarType * node = stack_settings->findChild(node_name);
+  if (node == nullptr) {
+    fprintf(stderr, "Stack has no '%s' settings to override\n", node_name.c_str());
+    return false;
+  }
+  VarXML::read(node->getChildren(), filename);
+  return true;
+}
+
+static double elapsedMicros(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+  return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+// runs the segmentation plugin on the same frame with each of its LUT layouts, one stage per layout
+static std::vector<BenchStage> benchLUTLayouts(VisionStack * stack, FrameData * d, RenderOptions * render_opts,
+                                               int frames, int warmup) {
+  std::vector<BenchStage> layouts;
+  VisionPlugin * segmentation = nullptr;
+  for (auto p : stack->stack) {
+    if (p->getName() == "Segmentation") segmentation = p;
+  }
+  VarStringEnum * v_layout = nullptr;
+  if (segmentation != nullptr && segmentation->getSettings() != nullptr) {
+    v_layout = (VarStringEnum *)segmentation->getSettings()->findChild("LUT layout");
+  }
+  if (v_layout == nullptr) {
+    fprintf(stderr, "Stack has no segmentation plugin with a LUT layout setting\n");
+    return layouts;
+  }
+
+  std::string selected = v_layout->getString();
+  for (unsigned int l = 0; l < v_layout->getCount(); l++) {
+    v_layout->selectIndex(l);
+    layouts.emplace_back(v_layout->getLabel(l));
+    layouts.back().samples.reserve(frames);
+    for (int i = 0; i < warmup + frames; i++) {
+      segmentation->lock();
+      auto start = std::chrono::steady_clock::now();
+      segmentation->process(d, render_opts);
+      auto end = std::chrono::steady_clock::now();
+      segmentation->unlock();
+      if (i >= warmup) layouts.back().samples.push_back(elapsedMicros(start, end));
+    }
+    layouts.back().summarize();
+  }
+  v_layout->select(selected);
+  return layouts;
+}
+
+//========================================================================
+// Run layout benchmark: the labeling passes on the arrays of a RunList
+// and, as the baseline, on the array of Run structs RunList used to keep.
+//========================================================================
+
+// connectComponents() on an array of Run, for the runs [begin,end)
+static void connectRunStructs(CMVision::Run * map, int begin, int end) {
+  int l1 = begin, l2 = begin;
+  while (l1 < end && map[l1].y == map[begin].y) l1++;
+  if (l1 >= end) return;
+  CMVision::Run r1 = map[l1], r2 = map[l2];
+  int i, j, s = l1;
+  while (l1 < end) {
+    if (r1.color == r2.color && r1.color.v != 0 &&
+        ((r2.x <= r1.x && r1.x < r2.x + r2.width) || (r1.x <= r2.x && r2.x < r1.x + r1.width))) {
+      if (s != l1) {
+        map[l1].parent = r1.parent = r2.parent;
+        s = l1;
+      } else if (r1.parent != r2.parent) {
+        i = r1.parent;
+        while (i != map[i].parent) i = map[i].parent;
+        j = r2.parent;
+        while (j != map[j].parent) j = map[j].parent;
+        if (i < j) {
+          map[j].parent = i;
+          map[l1].parent = map[l2].parent = r1.parent = r2.parent = i;
+        } else {
+          map[i].parent = j;
+          map[l1].parent = map[l2].parent = r1.parent = r2.parent = j;
+        }
+      }
+    }
+    i = (r2.x + r2.width) - (r1.x + r1.width);
+    if (i >= 0 && ++l1 < end) r1 = map[l1];
+    if (i <= 0) r2 = map[++l2];
+  }
+  for (i = begin; i < end; i++) {
+    j = map[i].parent;
+    map[i].parent = map[j].parent;
+  }
+}
+
+// extractRegions() on an array of Run, returns the number of regions
+static int extractRunStructs(CMVision::Run * map, int num, CMVision::RegionList * reglist) {
+  CMVision::Region * reg = reglist->getRegionArrayPointer();
+  int max_reg = reglist->getMaxRegions();
+  int n = 0;
+  for (int i = 0; i < num; i++) {
+    if (map[i].color.v == 0) continue;
+    CMVision::Run r = map[i];
+    int sum_x = r.width * (2 * r.x + r.width - 1) / 2;
+    if (r.parent == i) {
+      int b = map[i].parent = n;
+      reg[b].color = r.color;
+      reg[b].area = r.width;
+      reg[b].x1 = r.x;
+      reg[b].y1 = r.y;
+      reg[b].x2 = r.x + r.width;
+      reg[b].y2 = r.y;
+      reg[b].cen_x = sum_x;
+      reg[b].cen_y = r.y * r.width;
+      reg[b].run_start = i;
+      reg[b].iterator_id = i;
+      if (++n >= max_reg) return n;
+    } else {
+      int b = map[i].parent = map[r.parent].parent;
+      reg[b].area += r.width;
+      reg[b].x2 = std::max(r.x + r.width, reg[b].x2);
+      reg[b].x1 = std::min(r.x, reg[b].x1);
+      reg[b].y2 = r.y;
+      reg[b].cen_x += sum_x;
+      reg[b].cen_y += r.y * r.width;
+      map[reg[b].iterator_id].next = i;
+      reg[b].iterator_id = i;
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    reg[i].cen_x /= reg[i].area;
+    reg[i].cen_y /= reg[i].area;
+    map[reg[i].iterator_id].next = 0;
+    reg[i].x2--;
+  }
+  return n;
+}
+
+// runs the stack once on the frame and times connecting the components of
+// its runs and extracting the regions, with both layouts of the runs
+static std::vector<BenchStage> benchRunLayouts(VisionStack * stack, FrameBuffer * rb, FrameData * d,
+                                               RenderOptions * render_opts, int frames, int warmup) {
+  std::vector<BenchStage> layouts;
+  for (auto p : stack->stack) {
+    p->lock();
+    p->process(d, render_opts);
+    p->unlock();
+  }
+  CMVision::RunList * frame_runs = d->map.get(registerFrameDataSlot<CMVision::RunList>(rb, "cmv_runlist"));
+  if (frame_runs == nullptr) {
+    fprintf(stderr, "Stack has no run list to benchmark\n");
+    return layouts;
+  }
+
+  // copies of the runs as the encoder left them, before they were labeled
+  int num = frame_runs->getUsedRuns();
+  std::vector<CMVision::Run> structs(num);
+  CMVision::RunList arrays(std::max(num, 1));
+  for (int i = 0; i < num; i++) {
+    structs[i] = frame_runs->getRun(i);
+    structs[i].parent = i;
+    structs[i].next = 0;
+    arrays.setRun(i, structs[i]);
+  }
+  arrays.setUsedRuns(num);
+  // a bitwise list holds one plane per channel, each starting over at the top row
+  std::vector<int> planes(1, 0);
+  for (int i = 1; i < num; i++) {
+    if (structs[i].y < structs[i - 1].y) planes.push_back(i);
+  }
+  planes.push_back(num);
+  CMVision::RegionList regions(std::max(num, 1));
+
+  char name[64];
+  snprintf(name, sizeof(name), "Run structs (%d B/run)", (int)sizeof(CMVision::Run));
+  layouts.emplace_back(name);
+  snprintf(name, sizeof(name), "RunList arrays (%d B/run)", CMVision::RunList::bytes_per_run);
+  layouts.emplace_back(name);
+  int found[2] = {0, 0};
+  for (int layout = 0; layout < 2; layout++) {
+    BenchStage & s = layouts[layout];
+    s.samples.reserve(frames);
+    int * parents = arrays.getParentArray();
+    for (int i = 0; i < warmup + frames; i++) {
+      for (int k = 0; k < num; k++) {
+        structs[k].parent = k;
+        parents[k] = k;
+      }
+      auto start = std::chrono::steady_clock::now();
+      if (layout == 0) {
+        for (size_t p = 0; p + 1 < planes.size(); p++) connectRunStructs(structs.data(), planes[p], planes[p + 1]);
+        found[layout] = extractRunStructs(structs.data(), num, &regions);
+      } else {
+        CMVision::RegionProcessing::connectBitplanes(&arrays);
+        CMVision::RegionProcessing::extractRegions(&regions, &arrays);
+        found[layout] = regions.getUsedRegions();
+      }
+      auto end = std::chrono::steady_clock::now();
+      if (i >= warmup) s.samples.push_back(elapsedMicros(start, end));
+    }
+    s.summarize();
+  }
+  if (found[0] != found[1]) {
+    fprintf(stderr, "Warning: the run layouts found %d and %d regions\n", found[0], found[1]);
+  }
+  return layouts;
+}
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication app(argc, argv);
+
+  GetOpt opts(argc, argv);
+  bool help=false;
+  QString frame_dir;
+  QString settings_file;
+  QString lut_file;
+  QString mask_file;
+  QString json_file;
+  QString camera_str;
+  QString frames_str;
+  QString warmup_str;
+  QString kernel_str;
+  bool bench_layouts=false;
+  bool bench_runs=false;
+  bool bitwise_lut=false;
+  int ecode=0;
+  opts.addSwitch("help",&help);
+  opts.addShortOptSwitch( 't',QString("LUT Layout Benchmark"),&bench_layouts, false);
+  opts.addShortOptSwitch( 'r',QString("Run Layout Benchmark"),&bench_runs, false);
+  opts.addShortOptSwitch( 'b',QString("Bitwise LUT Channels"),&bitwise_lut, false);
+  opts.addOptionalOption( 'd',QString("Frame Directory"),&frame_dir, QString(""));
+  opts.addOptionalOption( 'f',QString("Settings File"),&settings_file, QString("settings.xml"));
+  opts.addOptionalOption( 'i',QString("Camera Index"),&camera_str, QString("0"));
+  opts.addOptionalOption( 'l',QString("LUT File"),&lut_file, QString(""));
+  opts.addOptionalOption( 'm',QString("Mask File"),&mask_file, QString(""));
+  opts.addOptionalOption( 'n',QString("Frame Count"),&frames_str, QString("1000"));
+  opts.addOptionalOption( 'w',QString("Warmup Frame Count"),&warmup_str, QString("20"));
+  opts.addOptionalOption( 'o',QString("JSON Output File"),&json_file, QString(""));
+  opts.addOptionalOption( 'k',QString("Threshold Kernel"),&kernel_str, QString(""));
+  if (!opts.parse()) {
+    fprintf(stderr,"Invalid command line parameters!\n");
+    help=true;
+    ecode=1;
+  }
+
+  bool camera_ok = false, frames_ok = false, warmup_ok = false;
+  int camera = camera_str.toInt(&camera_ok);
+  int frames = frames_str.toInt(&frames_ok);
+  int warmup = warmup_str.toInt(&warmup_ok);
+  if (!help && (!camera_ok || camera < 0 || !frames_ok || frames <= 0 || !warmup_ok || warmup < 0)) {
+    fprintf(stderr,"Invalid numeric parameter!\n");
+    help=true;
+    ecode=1;
+  }
+  if (!help && !kernel_str.isEmpty()) {
+    bool kernel_ok = false;
+    for (int isa = CMVisionThreshold::ISA_SCALAR; isa <= CMVisionThreshold::ISA_AVX512; isa++) {
+      if (kernel_str.toStdString() == CMVisionThreshold::getInstructionSetName((CMVisionThreshold::InstructionSet)isa)) {
+        CMVisionThreshold::setInstructionSet((CMVisionThreshold::InstructionSet)isa);
+        kernel_ok = true;
+      }
+    }
+    if (!kernel_ok) {
+      fprintf(stderr,"Unknown threshold kernel: %s\n", kernel_str.toStdString().c_str());
+      help=true;
+      ecode=1;
+    }
+  }
+  if (!help && frame_dir.isEmpty()) {
+    fprintf(stderr,"No frame directory given!\n");
+    help=true;
+    ecode=1;
+  }
+
+  if (help) {
+    printf("SSL-Vision benchmark command line options:\n");
+    printf(" -d <dir>  Directory with recorded frames (png, bmp, jpg, raw)\n");
+    printf(" -f <file> Settings file to load, incl. calibration (default: settings.xml)\n");
+    printf(" -i <n>    Camera index whose stack and settings are used (default: 0)\n");
+    printf(" -l <file> LUT file overriding the one of the camera, XML or binary (.lut)\n");
+    printf(" -m <file> Mask file overriding the one of the camera\n");
+    printf(" -n <n>    Number of measured frames (default: 1000)\n");
+    printf(" -w <n>    Number of warmup frames, not measured (default: 20)\n");
+    printf(" -o <file> Write the results as JSON\n");
+    printf(" -k <isa>  Limit the threshold and run-length kernels to scalar, sse4.1, avx2 or avx512 (default: best supported)\n");
+    printf(" -t        Time the segmentation of the first frame with every LUT layout first\n");
+    printf(" -r        Time the labeling of the runs of the first frame with both run layouts first\n");
+    printf(" -b        Use the bitwise LUTs, in which a color can belong to several channels\n");
+    printf(" --help    Show this help\n");
+    exit(ecode);
+  }
+
+  RenderOptions * render_opts=new RenderOptions();
+  MultiStackRoboCupSSL * multi_stack = new MultiStackRoboCupSSL(render_opts, camera + 1, true,
+                                                                bitwise_lut ? LUTChannelMode_Bitwise : LUTChannelMode_Numeric);
+
+  vector<VarType *> world;
+  world.push_back(buildHeadlessSettingsTree(multi_stack, nullptr));
+  world=VarXML::read(world,settings_file.toStdString());
+
+  CaptureThread * thread = multi_stack->threads[camera];
+  VisionStack * stack = thread->getStack();
+  FrameBuffer * rb = thread->getFrameBuffer();
+  StackRoboCupSSL * ssl_stack = dynamic_cast<StackRoboCupSSL *>(stack);
+
+  if (!lut_file.isEmpty() && lut_file.endsWith(".lut")) {
+    if (ssl_stack == nullptr || !ssl_stack->getLUT()->loadBinary(lut_file.toStdString())) exit(1);
+  } else if (!lut_file.isEmpty() && !overrideExternal(stack->getSettings(), "LUT 3D", lut_file.toStdString())) {
+    exit(1);
+  }
+  if (!mask_file.isEmpty() && !overrideExternal(stack->getSettings(), "Mask", mask_file.toStdString())) exit(1);
+
+  // without an event loop, queued updates of the LUT never run: derive and publish
+  // the loaded tables here, as the segmentation only reads the published ones
+  if (ssl_stack != nullptr) {
+    YUVLUT * lut = ssl_stack->getLUT();
+    lut->lock();
+    lut->markAllDirty();
+    lut->unlock();
+    lut->updateDerivedLUTs();
+  }
+
+  VarList * capture_settings = new VarList("Read from files");
+  CaptureFromFile * capture = new CaptureFromFile(capture_settings, camera);
+  VarString * v_dir = (VarString *)capture_settings->findChild("Capture Settings")->findChild("directory");
+  v_dir->setString(frame_dir.toStdString());
+  if (!capture->startCapture()) {
+    fprintf(stderr,"Unable to load frames from %s\n", frame_dir.toStdString().c_str());
+    exit(1);
+  }
+
+  std::vector<BenchStage> stages;
+  stages.emplace_back("copy&convert");
+  for (auto p : stack->stack) {
+    stages.emplace_back(p->getName());
+    stages.back().samples.reserve(frames);
+  }
+  stages.emplace_back("All");
+  stages.front().samples.reserve(frames);
+  stages.back().samples.reserve(frames);
+
+  std::vector<BenchStage> layouts;
+  std::vector<BenchStage> run_layouts;
+  FrameData * first = nullptr;
+  if (bench_layouts || bench_runs) {
+    first = rb->getPointer(rb->curWrite());
+    RawImage pic_raw = capture->getFrame();
+    bool success = capture->copyAndConvertFrame(pic_raw, first->video);
+    capture->releaseFrame();
+    if (!success) {
+      fprintf(stderr,"Unable to convert the first frame\n");
+      exit(1);
+    }
+  }
+  if (bench_layouts) {
+    FrameData * d = first;
+    layouts = benchLUTLayouts(stack, d, render_opts, frames, warmup);
+    long pixels = (long)d->video.getWidth() * d->video.getHeight();
+    printf("%-23s %10s %10s %10s %10s %10s\n", "LUT layout", "p50 μs", "p99 μs", "max μs", "mean μs", "ns/pixel");
+    for (auto & s : layouts) {
+      printf("%-23s %10.1f %10.1f %10.1f %10.1f %10.2f\n", s.name.c_str(), s.p50, s.p99, s.max, s.mean,
+             pixels > 0 ? s.mean * 1e3 / pixels : 0.0);
+    }
+    printf("\n");
+  }
+  if (bench_runs) {
+    run_layouts = benchRunLayouts(stack, rb, first, render_opts, frames, warmup);
+    printf("%-27s %10s %10s %10s %10s\n", "run layout", "p50 μs", "p99 μs", "max μs", "mean μs");
+    for (auto & s : run_layouts) {
+      printf("%-27s %10.1f %10.1f %10.1f %10.1f\n", s.name.c_str(), s.p50, s.p99, s.max, s.mean);
+    }
+    printf("\n");
+  }
+
+  unsigned long long bytes_before = 0;
+  unsigned long long count_before = 0;
+  double measured_time = 0;
+
+  for (int i = 0; i < warmup + frames; i++) {
+    bool measure = (i >= warmup);
+    if (i == warmup) {
+      bytes_before = alloc_bytes.load();
+      count_before = alloc_count.load();
+    }
+
+    FrameData * d = rb->getPointer(rb->curWrite());
+    auto t_start = std::chrono::steady_clock::now();
+    RawImage pic_raw = capture->getFrame();
+    pic_raw.setTime(GetTimeSec());
+    d->time = pic_raw.getTime();
+    d->time_cam = pic_raw.getTimeCam();
+    d->number = i;
+    bool success = capture->copyAndConvertFrame(pic_raw, d->video);
+    capture->releaseFrame();
+    if (!success) {
+      fprintf(stderr,"Unable to convert frame %d\n", i);
+      exit(1);
+    }
+    auto t_convert = std::chrono::steady_clock::now();
+
+    size_t stage = 1;
+    for (auto p : stack->stack) {
+      p->lock();
+      auto start = std::chrono::steady_clock::now();
+      p->process(d, render_opts);
+      auto end = std::chrono::steady_clock::now();
+      p->unlock();
+      if (measure) stages[stage].samples.push_back(elapsedMicros(start, end));
+      stage++;
+    }
+    rb->nextWrite(true);
+    auto t_end = std::chrono::steady_clock::now();
+
+    if (measure) {
+      stages.front().samples.push_back(elapsedMicros(t_start, t_convert));
+      stages.back().samples.push_back(elapsedMicros(t_convert, t_end));
+      measured_time += elapsedMicros(t_start, t_end);
+    }
+  }
+
+  double bytes_per_frame = (double)(alloc_bytes.load() - bytes_before) / frames;
+  double allocs_per_frame = (double)(alloc_count.load() - count_before) / frames;
+  double fps = frames / (measured_time * 1e-6);
+
+  printf("%-23s %10s %10s %10s %10s\n", "stage", "p50 μs", "p99 μs", "max μs", "mean μs");
+  for (auto & s : stages) {
+    s.summarize();
+    printf("%-23s %10.1f %10.1f %10.1f %10.1f\n", s.name.c_str(), s.p50, s.p99, s.max, s.mean);
+  }
+  printf("\n");
+  printf("frames:              %d (+%d warmup)\n", frames, warmup);
+  printf("fps:                 %.2f\n", fps);
+  printf("bytes alloc / frame: %.1f\n", bytes_per_frame);
+  printf("allocs / frame:      %.2f\n", allocs_per_frame);
+  std::string kernel = CMVisionThreshold::getInstructionSetName(CMVisionThreshold::getInstructionSet());
+  printf("threshold kernel:    %s\n", kernel.c_str());
+  const CMVision::ListArena * arena = ssl_stack != nullptr ? ssl_stack->getListArena() : nullptr;
+  if (arena != nullptr) {
+    // a grow during the measured frames shows up in the allocations above
+    printf("runs:                peak %d of %d, %ld frames truncated\n",
+           arena->runs.getHighWater(), arena->runs.getCapacity(), arena->runs.getOverflows());
+    printf("regions:             peak %d of %d, %ld frames truncated\n",
+           arena->regions.getHighWater(), arena->regions.getCapacity(), arena->regions.getOverflows());
+  }
+
+  if (!json_file.isEmpty()) {
+    if (!writeJSON(json_file.toStdString(), frame_dir.toStdString(), camera, frames, warmup,
+                   kernel, fps, bytes_per_frame, allocs_per_frame, layouts, run_layouts, stages, arena)) {
+      ecode=1;
+    }
+  }
+
+  capture->stopCapture();
+  delete capture;
+  delete capture_settings;
+  delete multi_stack;
+
+  return ecode;
+}
@@ -0,0 +1,175 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    main_headless.cpp
+  \brief   Entry point of the GUI-free ssl-vision application.
+
+  Builds the same RoboCup SSL multi-stack as the graphical application
+  and loads its configuration from settings.xml, but does not create any
+  widget, does not run the visualization plugins and skips the
+  postProcess() pass of every stack. It therefore does not need an
+  X server and leaves all cycles to the capture threads.
+
+  The application is controlled with the following signals:
+    SIGINT / SIGTERM   stop capturing and exit
+    SIGHUP             re-read settings.xml
+    SIGUSR1            reload the LUT of every camera from its binary LUT file
+*/
+//========================================================================
+
+#include <QCoreApplication>
+#include <QString>
+#include <QTimer>
+#include <signal.h>
+#include <stdio.h>
+#include "qgetopt.h"
+#include "VarXML.h"
+#include "affinity_manager.h"
+#include "headless_settings.h"
+#include "multistack_robocup_ssl.h"
+#include "stack_robocup_ssl.h"
+
+static volatile sig_atomic_t stop_requested = 0;
+static volatile sig_atomic_t reload_requested = 0;
+static volatile sig_atomic_t lut_reload_requested = 0;
+
+// Signal handler for breaks (Ctrl-C) and termination
+void HandleStop(int i) {
+  (void)i;
+  stop_requested = 1;
+}
+
+// Signal handler for configuration reloads
+void HandleReload(int i) {
+  (void)i;
+  reload_requested = 1;
+}
+
+// Signal handler for LUT reloads
+void HandleLUTReload(int i) {
+  (void)i;
+  lut_reload_requested = 1;
+}
+
+int main(int argc, char *argv[])
+{
+  signal(SIGINT,HandleStop);
+  signal(SIGTERM,HandleStop);
+  signal(SIGHUP,HandleReload);
+  signal(SIGUSR1,HandleLUTReload);
+  QCoreApplication app(argc, argv);
+
+  GetOpt opts(argc, argv);
+  bool help=false;
+  bool enforce_affinity=false;
+  bool bitwise_lut=false;
+  QString camera_count;
+  QString settings_file;
+  int ecode=0;
+  opts.addSwitch("help",&help);
+  opts.addShortOptSwitch( 'a',QString("Enforce Processor Affinity"),&enforce_affinity, false);
+  opts.addShortOptSwitch( 'b',QString("Bitwise LUT Channels"),&bitwise_lut, false);
+  opts.addOptionalOption( 'c',QString("Camera Count"),&camera_count, QString("4"));
+  opts.addOptionalOption( 'f',QString("Settings File"),&settings_file, QString("settings.xml"));
+  if (!opts.parse()) {
+    fprintf(stderr,"Invalid command line parameters!\n");
+    help=true;
+    ecode=1;
+  }
+
+  bool camera_count_ok = false;
+  int num_cameras = camera_count.toInt(&camera_count_ok);
+  if(!camera_count_ok) {
+    fprintf(stderr,"Invalid number of cameras!\n");
+    help=true;
+    ecode=1;
+  }
+
+  if (help) {
+    printf("SSL-Vision (headless) command line options:\n");
+    printf(" -a        Set Processor Affinity\n");
+    printf(" -b        Use bitwise LUTs, in which a color can belong to several channels\n");
+    printf(" -c <n>    Set Number of Cameras\n");
+    printf(" -f <file> Settings file to load (default: settings.xml)\n");
+    printf(" --help    Show this help\n");
+    printf("\n");
+    printf("Capturing starts immediately. Settings are read but never written.\n");
+    printf("Send SIGHUP to re-read the settings file, SIGINT or SIGTERM to exit.\n");
+    printf("Send SIGUSR1 to reload the LUTs from the binary LUT files saved in the YUV calibration.\n");
+    exit(ecode);
+  }
+
+  AffinityManager * affinity=0;
+  if (enforce_affinity) affinity=new AffinityManager();
+
+  RenderOptions * render_opts=new RenderOptions();
+  MultiStackRoboCupSSL * multi_stack = new MultiStackRoboCupSSL(render_opts, num_cameras, true,
+                                                                bitwise_lut ? LUTChannelMode_Bitwise : LUTChannelMode_Numeric);
+  if (affinity!=0) affinity->demandCore(multi_stack->threads.size());
+
+  vector<VarType *> world;
+  world.push_back(buildHeadlessSettingsTree(multi_stack, affinity));
+  world=VarXML::read(world,settings_file.toStdString());
+
+  //update network output settings from xml file
+  multi_stack->RefreshNetworkOutput();
+  multi_stack->RefreshLegacyNetworkOutput();
+  multi_stack->start();
+
+  for (auto thread : multi_stack->threads) {
+    if (!thread->init()) {
+      fprintf(stderr,"Unable to start capture on one of the capture threads.\n");
+    }
+  }
+
+  // signal handlers may only set flags, so we poll them from the event loop
+  QTimer signal_poll;
+  QObject::connect(&signal_poll, &QTimer::timeout, [&]() {
+    if (reload_requested) {
+      reload_requested = 0;
+      printf("Reloading %s\n", settings_file.toStdString().c_str());
+      fflush(stdout);
+      world=VarXML::read(world,settings_file.toStdString());
+      multi_stack->RefreshNetworkOutput();
+      multi_stack->RefreshLegacyNetworkOutput();
+    }
+    if (lut_reload_requested) {
+      lut_reload_requested = 0;
+      for (auto thread : multi_stack->threads) {
+        StackRoboCupSSL * stack = dynamic_cast<StackRoboCupSSL *>(thread->getStack());
+        if (stack == nullptr) continue;
+        YUVLUT * lut = stack->getLUT();
+        if (lut->loadBinary(lut->getBinaryFilename())) {
+          printf("Reloaded %s\n", lut->getBinaryFilename().c_str());
+        }
+      }
+      fflush(stdout);
+    }
+    if (stop_requested) {
+      printf("\nExiting.\n");
+      fflush(stdout);
+      app.quit();
+    }
+  });
+  signal_poll.start(100);
+
+  int retval = app.exec();
+
+  multi_stack->stop();
+  delete multi_stack;
+  if (affinity!=0) delete affinity;
+
+  return retval;
+}
@@ -132,7 +132,7 @@ void PluginAutoColorCalibration::process_gui_commands() {
   if (accw->pending_reset_lut) {
     accw->pending_reset_lut = false;
     global_lut->reset();
-    global_lut->updateDerivedLUTs();
+    global_lut->requestDerivedLUTUpdate();
     lutw->getGLLUTWidget()->needs_init = true;
     lutw->getGLLUTWidget()->repaint();
   }
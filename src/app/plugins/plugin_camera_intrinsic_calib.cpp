@@ -38,6 +38,15 @@ PluginCameraIntrinsicCalibration::PluginCameraIntrinsicCalibration(FrameBuffer *
   connect(this, SIGNAL(startLoadImages()), worker, SLOT(loadImages()));
   connect(this, SIGNAL(startCalibration()), worker, SLOT(calibrate()));
   connect(this, SIGNAL(startSaveImages()), worker->image_storage, SLOT(saveImages()));
+
+  slot_img_calibration = registerFrameDataSlot<Image<raw8>>(buffer, "img_calibration", []() { return new Image<raw8>(); });
+  slot_chessboard = registerFrameDataSlot<Chessboard>(buffer, "chessboard", []() { return new Chessboard(); });
+  // the image points are owned by the worker and shared by all frames
+  slot_chessboard_img_points =
+      registerFrameDataSlot<std::vector<std::vector<cv::Point2f>>>(buffer, "chessboard_img_points");
+  for (int i = 0; buffer != nullptr && i < buffer->size; i++) {
+    buffer->getPointer(i)->map.replace(slot_chessboard_img_points, &worker->image_points, false);
+  }
 }
 
 PluginCameraIntrinsicCalibration::~PluginCameraIntrinsicCalibration() {
@@ -56,22 +65,14 @@ QWidget *PluginCameraIntrinsicCalibration::getControlWidget() { return static_ca
 ProcessResult PluginCameraIntrinsicCalibration::process(FrameData *data, RenderOptions *options) {
   (void)options;
 
-  Image<raw8> *img_calibration;
-  if ((img_calibration = reinterpret_cast<Image<raw8> *>(data->map.get("img_calibration"))) == nullptr) {
-    img_calibration = reinterpret_cast<Image<raw8> *>(data->map.insert("img_calibration", new Image<raw8>()));
+  Image<raw8> *img_calibration = data->map.get(slot_img_calibration);
+  Chessboard *chessboard = data->map.get(slot_chessboard);
+  if (img_calibration == nullptr || chessboard == nullptr) {
+    return ProcessingFailed;
   }
 
   ConversionsGreyscale::cvColor2Grey(data->video, img_calibration);
 
-  Chessboard *chessboard;
-  if ((chessboard = reinterpret_cast<Chessboard *>(data->map.get("chessboard"))) == nullptr) {
-    chessboard = reinterpret_cast<Chessboard *>(data->map.insert("chessboard", new Chessboard()));
-  }
-
-  if (data->map.get("chessboard_img_points") == nullptr) {
-    data->map.insert("chessboard_img_points", &worker->image_points);
-  }
-
   // cv expects row major order and image stores col major.
   // height and width are swapped intentionally!
   cv::Mat greyscale_mat(img_calibration->getHeight(), img_calibration->getWidth(), CV_8UC1, img_calibration->getData());
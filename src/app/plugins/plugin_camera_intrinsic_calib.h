@@ -116,4 +116,8 @@ private:
   VarDouble *chessboard_capture_dt;
 
   double lastChessboardCaptureFrame = 0.0;
+
+  FrameDataSlot<Image<raw8>> slot_img_calibration;
+  FrameDataSlot<Chessboard> slot_chessboard;
+  FrameDataSlot<std::vector<std::vector<cv::Point2f>>> slot_chessboard_img_points;
 };
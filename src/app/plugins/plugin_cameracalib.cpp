@@ -79,6 +79,7 @@ void PluginCameraCalibration::detectEdges(FrameData* data) {
     return;
   }
 
+  camera_parameters.getSnapshot(calibration);
   field.field_markings_mutex.lockForRead();
   for (size_t i = 0; i < field.field_lines.size(); ++i) {
     const FieldLine& line = *(field.field_lines[i]);
@@ -174,7 +175,7 @@ void PluginCameraCalibration::detectEdgesOnSingleLine(
         1.0 - static_cast<double>(i) / (static_cast<double>(num_points) + 1.0);
     const GVector::vector3d<double> p_world = alpha * p1 + (1.0 - alpha) * p2;
     GVector::vector2d<double> p_image(0.0, 0.0);
-        camera_parameters.field2image(p_world, p_image);
+        calibration.field2image(p_world, p_image);
     if (p_image.x < image_boundary ||
         p_image.x > grey_image->getWidth() - image_boundary ||
         p_image.y < image_boundary ||
@@ -194,8 +195,8 @@ void PluginCameraCalibration::detectEdgesOnSingleLine(
     const GVector::vector3d<double> end_world =
         p_world - line_perp * (0.5 * thickness + search_distance);
     GVector::vector2d<double> start_image(0.0, 0.0), end_image(0.0, 0.0);
-    camera_parameters.field2image(start_world, start_image);
-    camera_parameters.field2image(end_world, end_image);
+    calibration.field2image(start_world, start_image);
+    calibration.field2image(end_world, end_image);
     sanitizeSobel(grey_image, start_image);
     sanitizeSobel(grey_image, end_image);
 
@@ -242,7 +243,7 @@ void PluginCameraCalibration::detectEdgesOnSingleArc(
     const GVector::vector3d<double> radius_vector(cos(theta), sin(theta), 0.0);
     const GVector::vector3d<double> p_world = center + radius * radius_vector;
     GVector::vector2d<double> p_image(0.0, 0.0);
-    camera_parameters.field2image(p_world, p_image);
+    calibration.field2image(p_world, p_image);
     if (p_image.x < image_boundary ||
         p_image.x > grey_image->getWidth() - image_boundary ||
         p_image.y < image_boundary ||
@@ -262,8 +263,8 @@ void PluginCameraCalibration::detectEdgesOnSingleArc(
     const GVector::vector3d<double> end_world =
         center + (radius + 0.5 * thickness + search_distance) * radius_vector;
     GVector::vector2d<double> start_image(0.0, 0.0), end_image(0.0, 0.0);
-    camera_parameters.field2image(start_world, start_image);
-    camera_parameters.field2image(end_world, end_image);
+    calibration.field2image(start_world, start_image);
+    calibration.field2image(end_world, end_image);
     sanitizeSobel(grey_image, start_image);
     sanitizeSobel(grey_image, end_image);
 
@@ -39,6 +39,8 @@ protected:
   VarList* camera_settings;
   VarList* calibration_settings;
   CameraParameters& camera_parameters;
+  // calibration used by the current edge detection pass
+  CameraCalibrationSnapshot calibration;
   RoboCupField& field;
   CameraCalibrationWidget * ccw;
   greyImage* grey_image;
@@ -38,6 +38,15 @@ PluginColorCalibration::PluginColorCalibration(FrameBuffer * _buffer, YUVLUT * _
     v_lut_sources->addItem(LUT_COPY_PLACEHOLDER);
     settings->addChild( v_lut_colors = new VarStringEnum("Color", LUT_COPY_PLACEHOLDER));
     updateColorList();
+
+    // binary copy of the LUT, e.g. to hand it to a headless instance or the benchmark
+    settings->addChild( v_lut_file = new VarString("LUT file", lut->getBinaryFilename()));
+    save_LUT_file_trigger = new VarTrigger("Save LUT file", "Save");
+    settings->addChild(save_LUT_file_trigger);
+    connect(save_LUT_file_trigger,SIGNAL(signalTriggered()),this,SLOT(slotSaveLUTFile()));
+    load_LUT_file_trigger = new VarTrigger("Load LUT file", "Load");
+    settings->addChild(load_LUT_file_trigger);
+    connect(load_LUT_file_trigger,SIGNAL(signalTriggered()),this,SLOT(slotLoadLUTFile()));
 }
 
 void PluginColorCalibration::updateColorList() {
@@ -65,6 +74,9 @@ PluginColorCalibration::~PluginColorCalibration()
     delete copy_LUT_trigger;
     delete v_lut_sources;
     delete v_lut_colors;
+    delete v_lut_file;
+    delete save_LUT_file_trigger;
+    delete load_LUT_file_trigger;
 }
 
 QWidget * PluginColorCalibration::getControlWidget() {
@@ -169,6 +181,19 @@ void PluginColorCalibration::slotCopyLUT() {
     copyLUT();
 }
 
+void PluginColorCalibration::slotSaveLUTFile() {
+    if (lut->saveBinary(v_lut_file->getString())) {
+        printf("Saved LUT to %s\n", v_lut_file->getString().c_str());
+    }
+}
+
+void PluginColorCalibration::slotLoadLUTFile() {
+    if (lut->loadBinary(v_lut_file->getString()) && lutw != NULL) {
+        lutw->getGLLUTWidget()->needs_init = true;
+        lutw->getGLLUTWidget()->repaint();
+    }
+}
+
 void PluginColorCalibration::copyLUT() {
     updateColorList();
     VarString *pSelf = reinterpret_cast<VarString*>(settings->getParent());
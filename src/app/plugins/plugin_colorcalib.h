@@ -42,12 +42,17 @@ protected:
     VarStringEnum * v_lut_sources;
     VarStringEnum * v_lut_colors;
     VarTrigger * copy_LUT_trigger;
+    VarString * v_lut_file;
+    VarTrigger * save_LUT_file_trigger;
+    VarTrigger * load_LUT_file_trigger;
     LUTChannelMode mode;
     bool continuing_undo;
     void mouseEvent ( QMouseEvent * event, pixelloc loc );
     void copyLUT();
 protected slots:
     void slotCopyLUT();
+    void slotSaveLUTFile();
+    void slotLoadLUTFile();
 public:
     PluginColorCalibration(FrameBuffer * _buffer, YUVLUT * _lut, ConvexHullImageMask& mask, LUTChannelMode _mode=LUTChannelMode_Numeric);
     virtual VarList * getSettings();
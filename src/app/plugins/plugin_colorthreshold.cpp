@@ -19,145 +19,231 @@
 */
 //========================================================================
 #include "plugin_colorthreshold.h"
-
-static void thresholdImage(RawImage *imagePartIn, Image<raw8> *imagePartOut, YUVLUT * lut, const ImageInterface* mask = nullptr) {
-  if (imagePartIn->getColorFormat() == COLOR_YUV422_UYVY) {
-    CMVisionThreshold::thresholdImageYUV422_UYVY(imagePartOut, imagePartIn, lut, mask);
-  } else if (imagePartIn->getColorFormat() == COLOR_YUV444) {
-    CMVisionThreshold::thresholdImageYUV444(imagePartOut, imagePartIn, lut, mask);
-  } else if (imagePartIn->getColorFormat() == COLOR_RGB8) {
-    auto *rgblut = (RGBLUT *) lut->getDerivedLUT(CSPACE_RGB);
-    if (rgblut == nullptr) {
-      printf("WARNING: No RGB LUT has been defined. You need to create a derived RGB LUT by calling e.g. \"lut_yuv->addDerivedLUT(new RGBLUT(5,5,5,\"\"))\" in the stack constructor!\n");
-    } else {
-      CMVisionThreshold::thresholdImageRGB(imagePartOut, imagePartIn, rgblut, mask);
-    }
-  } else {
-    fprintf(stderr, "ColorThresholding needs YUV422, YUV444, or RGB8 as input image, but found: %s\n",
-            Colors::colorFormatToString(imagePartIn->getColorFormat()).c_str());
-  }
-}
-
-PluginColorThresholdWorker::PluginColorThresholdWorker(int _id, int _totalThreads, YUVLUT * _lut) : QObject() {
-
-  this->id = _id;
-  this->totalThreads = _totalThreads;
-  this->lut = _lut;
-
-  thread = new QThread();
-  thread->setObjectName("ColorThreshold");
-  moveToThread(thread);
-  connect(this, SIGNAL(startThresholding()), this, SLOT(process()));
-  thread->start();
+#include <algorithm>
+#include <sstream>
+
+ThresholdImageSlots::ThresholdImageSlots(FrameBuffer * buffer) {
+  image = registerFrameDataSlot<Image<raw8>>(buffer, "cmv_threshold", []() { return new Image<raw8>(); });
+  state = registerFrameDataSlot<ThresholdImageState>(buffer, "cmv_threshold_state", []() { return new ThresholdImageState(); });
+  runlist = registerFrameDataSlot<CMVision::RunList>(buffer, "cmv_runlist");
+  integral = registerFrameDataSlot<CMVision::IntegralHistogram>(buffer, "cmv_threshold_integral",
+                                                                []() { return new CMVision::IntegralHistogram(); });
 }
 
-PluginColorThresholdWorker::~PluginColorThresholdWorker() {
-  thread->quit();
-  thread->deleteLater();
-}
+Image<raw8> * ThresholdImageSlots::get(FrameData * data) const {
+  Image<raw8> * img = data->map.get(image);
+  ThresholdImageState * s = data->map.get(state);
+  if (img == nullptr || s == nullptr || s->image_valid) return img;
 
-
-void PluginColorThresholdWorker::process() {
-  RawImage imagePartIn;
-  imagePartIn.setColorFormat(imageIn->getColorFormat());
-  imagePartIn.setHeight(imageIn->getHeight()/totalThreads);
-  imagePartIn.setWidth(imageIn->getWidth());
-  int offsetBytesIn = id * imageIn->getNumBytes() / totalThreads;
-  imagePartIn.setData(imageIn->getData() + offsetBytesIn);
-
-  RawImage maskImagePartIn;
-  maskImagePartIn.setColorFormat(maskImageIn->getColorFormat());
-  maskImagePartIn.setHeight(maskImageIn->getHeight()/totalThreads);
-  maskImagePartIn.setWidth(maskImageIn->getWidth());
-  int maskOffsetBytesIn = id * maskImageIn->getNumBytes() /  totalThreads;
-  maskImagePartIn.setData(maskImageIn->getData() + maskOffsetBytesIn);
-
-  RawImage rawImageOut;
-  rawImageOut.setColorFormat(imageOut->getColorFormat());
-  rawImageOut.setHeight(imageOut->getHeight()/totalThreads);
-  rawImageOut.setWidth(imageOut->getWidth());
-  int offsetBytesOut = id * imageOut->getNumBytes() / totalThreads;
-  rawImageOut.setData(imageOut->getData() + offsetBytesOut);
-  Image<raw8> imagePartOut;
-  imagePartOut.fromRawImage(rawImageOut);
-
-  thresholdImage(&imagePartIn, &imagePartOut, lut, &maskImagePartIn);
-
-  doneMutex.unlock();
+  CMVision::RunList * runs = data->map.get(runlist);
+  if (runs == nullptr) return nullptr;
+  CMVision::RegionProcessing::decodeRuns(runs, img);
+  s->image_valid = true;
+  return img;
 }
 
-
-void PluginColorThresholdWorker::start() {
-  doneMutex.lock();
-  emit startThresholding();
-}
-
-
-void PluginColorThresholdWorker::wait() {
-  doneMutex.lock();
-  doneMutex.unlock();
+CMVision::IntegralHistogram * ThresholdImageSlots::getIntegral(FrameData * data) const {
+  CMVision::IntegralHistogram * tables = data->map.get(integral);
+  ThresholdImageState * s = data->map.get(state);
+  if (tables == nullptr || s == nullptr) return nullptr;
+  if (s->integral_valid) return tables;
+
+  // the tables of a fused frame are built from its runs, without restoring the image
+  if (s->image_valid) {
+    Image<raw8> * img = data->map.get(image);
+    if (img == nullptr) return nullptr;
+    tables->setImage(img, s->channel_count, s->channel_mode);
+  } else {
+    CMVision::RunList * runs = data->map.get(runlist);
+    if (runs == nullptr) return nullptr;
+    tables->setRuns(runs, data->video.getWidth(), data->video.getHeight(), s->channel_count);
+  }
+  s->integral_valid = true;
+  return tables;
 }
 
-
-PluginColorThreshold::PluginColorThreshold(FrameBuffer * _buffer, YUVLUT * _lut, ConvexHullImageMask &mask)
-  : VisionPlugin(_buffer), _image_mask(mask)
+PluginColorThreshold::PluginColorThreshold(FrameBuffer * _buffer, YUVLUT * _lut, ConvexHullImageMask &mask,
+                                           CMVision::ListArena * _arena)
+  : VisionPlugin(_buffer), _image_mask(mask), threshold_slots(_buffer), arena(_arena)
 {
   lut=_lut;
 
   settings=new VarList("Color Threshold");
   numThreads = new VarInt("number of threads", 0, 0, 32);
   settings->addChild(numThreads);
+  // comma separated list of cpu ids, leave empty to let the scheduler decide
+  pinCpus = new VarString("pin threads to cpus", "");
+  settings->addChild(pinCpus);
+  // classify and run-length encode row by row instead of writing the full thresholded image
+  fusedEncoding = new VarBool("fused run-length encoding", false);
+  settings->addChild(fusedEncoding);
+  // memory order of the table the pixels are looked up in, the result is the same for all of them.
+  // "uv-major" keeps the Y cells of a color together, which usually hits the cache more often.
+  lutLayout = new VarStringEnum("LUT layout", "flat");
+  lutLayout->addItem("flat");
+  lutLayout->addItem("uv-major");
+  settings->addChild(lutLayout);
 }
 
 
 PluginColorThreshold::~PluginColorThreshold()
 {
-  clearWorkers();
+  delete pool;
   delete settings;
 }
 
-void PluginColorThreshold::clearWorkers() {
-  for (auto worker : workers) {
-    worker->deleteLater();
+void PluginColorThreshold::updatePool() {
+  if (pool != nullptr && pool->getNumWorkers() == numThreads->getInt() && pool_cpus == pinCpus->getString()) {
+    return;
+  }
+  delete pool;
+  pool = nullptr;
+  pool_cpus = pinCpus->getString();
+  if (numThreads->getInt() <= 0) return;
+
+  std::vector<int> cpus;
+  std::stringstream cpu_list(pool_cpus);
+  std::string cpu;
+  while (std::getline(cpu_list, cpu, ',')) {
+    char * end = nullptr;
+    long id = strtol(cpu.c_str(), &end, 10);
+    if (end != cpu.c_str() && id >= 0) {
+      cpus.push_back((int)id);
+    } else if (cpu.find_first_not_of(" \t") != std::string::npos) {
+      fprintf(stderr, "Segmentation: ignoring invalid cpu id '%s'\n", cpu.c_str());
+    }
   }
-  workers.clear();
+  pool = new WorkerPool(numThreads->getInt(), cpus);
 }
 
 
+LUT3D * PluginColorThreshold::getTable(ColorFormat format) {
+  if (format == COLOR_YUV422_UYVY || format == COLOR_YUV444) {
+    return lut;
+  } else if (format == COLOR_RGB8) {
+    // looking it up locks the YUV LUT, so only do it once
+    if (rgblut == nullptr) rgblut = (RGBLUT *) lut->getDerivedLUT(CSPACE_RGB);
+    if (rgblut == nullptr) {
+      printf("WARNING: No RGB LUT has been defined. You need to create a derived RGB LUT by calling e.g. \"lut_yuv->addDerivedLUT(new RGBLUT(5,5,5,\"\"))\" in the stack constructor!\n");
+    }
+    return rgblut;
+  }
+  fprintf(stderr, "ColorThresholding needs YUV422, YUV444, or RGB8 as input image, but found: %s\n",
+          Colors::colorFormatToString(format).c_str());
+  return nullptr;
+}
+
+int PluginColorThreshold::getTileRows(int height) const {
+  if (pool == nullptr) return height;
+  // several tiles per thread, so that slower threads do not hold up the frame
+  return std::max(1, height / (4 * (pool->getNumWorkers() + 1)));
+}
+
+void PluginColorThreshold::runTiles(int height, int tile_rows, const std::function<void(int, int)> & task) {
+  if (pool == nullptr) {
+    task(0, height);
+  } else {
+    pool->runTiles(height, tile_rows, task);
+  }
+}
+
+void PluginColorThreshold::thresholdImage(const RawImage & video, const LUTReadGuard & table, const Image<raw8> & mask,
+                                          const MaskSpan * spans, Image<raw8> * target) {
+  int width = video.getWidth();
+  int height = video.getHeight();
+  int bytes_per_row = video.getNumBytes() / height;
+  runTiles(height, getTileRows(height), [&](int first_row, int end_row) {
+    if (spans == nullptr) {
+      CMVisionThreshold::thresholdPixels(video.getColorFormat(),
+                                         (uint8_t *)target->getPixelData() + (long)first_row * width,
+                                         video.getData() + (long)first_row * bytes_per_row, table,
+                                         mask.getData() + (long)first_row * width, (end_row - first_row) * width);
+      return;
+    }
+    for (int y = first_row; y < end_row; y++) {
+      CMVisionThreshold::thresholdRow(video.getColorFormat(), (uint8_t *)target->getPixelData() + (long)y * width,
+                                      video.getData() + (long)y * bytes_per_row, table,
+                                      mask.getData() + (long)y * width, width, spans[y].begin, spans[y].end);
+    }
+  });
+}
+
+bool PluginColorThreshold::thresholdAndEncode(const RawImage & video, const LUTReadGuard & table, const Image<raw8> & mask,
+                                              const MaskSpan * spans, CMVision::RunList * runlist) {
+  int height = video.getHeight();
+  int tile_rows = getTileRows(height);
+  int num_tiles = (height + tile_rows - 1) / tile_rows;
+  int max_runs = runlist->getMaxRuns();
+  if ((int)tile_runs.size() < num_tiles) tile_runs.resize(num_tiles);
+
+  runTiles(height, tile_rows, [&](int first_row, int end_row) {
+    TileRuns & tile = tile_runs[first_row / tile_rows];
+    tile.complete = CMVision::RegionProcessing::thresholdAndEncodeRows(&video, table, &mask, spans, first_row, end_row,
+                                                                        tile.runs, tile.used, max_runs);
+  });
+
+  // concatenate the tiles in row order, which gives the same list as encodeRuns()
+  int j = 0;
+  bool complete = true;
+  for (int t = 0; t < num_tiles && complete; t++) {
+    const TileRuns & tile = tile_runs[t];
+    for (int i = 0; i < tile.used && j < max_runs; i++, j++) {
+      CMVision::Run r = tile.runs[i];
+      r.parent = j;
+      runlist->setRun(j, r);
+    }
+    complete = tile.complete && j < max_runs;
+  }
+  runlist->setUsedRuns(j);
+  return complete;
+}
+
 ProcessResult PluginColorThreshold::process(FrameData * data, RenderOptions * options) {
-  _image_mask.lock();
   (void)options;
 
-  Image<raw8> * img_thresholded;
+  Image<raw8> * img_thresholded = data->map.get(threshold_slots.image);
+  ThresholdImageState * state = data->map.get(threshold_slots.state);
+  if (img_thresholded == nullptr || state == nullptr) return ProcessingFailed;
 
-  if ((img_thresholded=(Image<raw8> *)data->map.get("cmv_threshold")) == nullptr) {
-    img_thresholded=(Image<raw8> *)data->map.insert("cmv_threshold",new Image<raw8>());
-  }
+  LUT3D * table_lut = getTable(data->video.getColorFormat());
+  if (table_lut == nullptr) return ProcessingFailed;
+
+  _image_mask.lock();
 
   //make sure image is allocated:
   img_thresholded->allocate(data->video.getWidth(),data->video.getHeight());
 
-  if((int) workers.size() != numThreads->getInt()) {
-    clearWorkers();
-    for(int i=0;i<numThreads->getInt();i++) {
-      auto *worker = new PluginColorThresholdWorker(i, numThreads->getInt(), lut);
-      workers.push_back(worker);
-    }
-  }
+  updatePool();
 
-  if(workers.empty()) {
-    thresholdImage(&data->video, img_thresholded, lut, &_image_mask.getMask());
-  } else {
-    for (auto worker : workers) {
-      worker->imageIn = &data->video;
-      worker->maskImageIn = &_image_mask.getMask();
-      worker->imageOut = img_thresholded;
-      worker->start();
-    }
+  LUTLayout layout = lutLayout->getString() == "uv-major" ? LUTLayout_UVMajor : LUTLayout_Flat;
+  if (table_lut->getLayout() != layout) table_lut->setLayout(layout);
 
-    for (auto worker : workers) {
-      worker->wait();
-    }
+  // all tiles use the table that was published when the frame started, edits never block us
+  LUTReadGuard table(table_lut);
+  state->runs_encoded = false;
+  state->image_valid = true;
+  state->integral_valid = false;
+  // only the pixels within the span of the mask are looked at, the rest of each row is clear.
+  // The spans are copied, so that later plugins can use them without locking the mask.
+  if ((int)_image_mask.getSpans().size() == data->video.getHeight()) {
+    state->spans = _image_mask.getSpans();
+  } else {
+    state->spans.clear();
+  }
+  const MaskSpan * spans = state->spans.empty() ? nullptr : state->spans.data();
+  state->channel_mode = table_lut->getChannelMode();
+  state->channel_count = table_lut->getChannelCount();
+  // bitwise labels are encoded per channel from the full image, see PluginRunlengthEncode
+  bool fused = fusedEncoding->getBool() && state->channel_mode == LUTChannelMode_Numeric;
+  CMVision::RunList * runlist = fused ? data->map.get(threshold_slots.runlist) : nullptr;
+  if (runlist != nullptr) {
+    arena->prepare(runlist);
+    state->runs_encoded = true;
+    // if the runs were truncated, the image can not be restored from them later on
+    state->image_valid = !thresholdAndEncode(data->video, table, _image_mask.getMask(), spans, runlist);
+  }
+  if (state->image_valid) {
+    thresholdImage(data->video, table, _image_mask.getMask(), spans, img_thresholded);
   }
 
   _image_mask.unlock();
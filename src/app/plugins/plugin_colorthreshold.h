@@ -22,36 +22,55 @@
 #define PLUGIN_COLORTHRESHOLD_H
 
 #include <visionplugin.h>
+#include <vector>
 #include "lut3d.h"
 #include "cmvision_threshold.h"
-#include <mutex>
-#include <QThread>
-#include <QObject>
+#include "cmvision_region.h"
+#include "cmvision_histogram.h"
 #include "convex_hull_image_mask.h"
+#include "worker_pool.h"
 
-class PluginColorThresholdWorker : public QObject {
-Q_OBJECT
+/*!
+  \class  ThresholdImageState
+  \brief  Per frame state of the color-thresholded image ("cmv_threshold_state")
+*/
+class ThresholdImageState
+{
+public:
+  bool runs_encoded = false; ///< "cmv_runlist" was already filled by the threshold plugin
+  bool image_valid = true;   ///< "cmv_threshold" holds the labels of this frame
+  bool integral_valid = false; ///< "cmv_threshold_integral" was set up for this frame
+  std::vector<MaskSpan> spans; ///< per row span of the image mask, outside all labels are clear. Empty if unknown.
+  LUTChannelMode channel_mode = LUTChannelMode_Numeric; ///< with LUTChannelMode_Bitwise the labels are bitmasks of channels
+  int channel_count = 0;      ///< number of channels of the LUT
+};
+
+/*!
+  \class  ThresholdImageSlots
+  \brief  Access to the color-thresholded image of a frame
+
+  With "fused run-length encoding" enabled, PluginColorThreshold encodes the
+  runs directly and does not write the thresholded image. get() restores it
+  from the runs the first time a plugin asks for it in a frame, so the image
+  only costs anything if visualization needs it. Histogram checks use
+  getIntegral(), which reads the runs directly in that case.
+*/
+class ThresholdImageSlots
+{
 public:
-    PluginColorThresholdWorker(int id, int totalThreads, YUVLUT * lut);
-    ~PluginColorThresholdWorker() override;
-    QThread* thread;
-    int id;
-    int totalThreads;
-    RawImage* imageIn = nullptr;
-    const ImageInterface* maskImageIn = nullptr;
-    Image<raw8>* imageOut = nullptr;
-    YUVLUT * lut;
-    std::mutex doneMutex;
-
-    void start();
-    void wait();
-
-public slots:
-    void process();
-
-signals:
-    void startThresholding();
+  explicit ThresholdImageSlots(FrameBuffer * buffer);
+
+  /// returns the thresholded image of \p data, or nullptr if there is none
+  Image<raw8> * get(FrameData * data) const;
 
+  /// returns the histogram tables of the thresholded image of \p data, shared by all
+  /// plugins of the frame, or nullptr if there is no thresholded image
+  CMVision::IntegralHistogram * getIntegral(FrameData * data) const;
+
+  FrameDataSlot<Image<raw8>> image;
+  FrameDataSlot<ThresholdImageState> state;
+  FrameDataSlot<CMVision::RunList> runlist;
+  FrameDataSlot<CMVision::IntegralHistogram> integral;
 };
 
 /**
@@ -61,11 +80,17 @@ class PluginColorThreshold : public VisionPlugin
 {
 protected:
   YUVLUT * lut;
+  RGBLUT * rgblut = nullptr;
   ConvexHullImageMask& _image_mask;
   VarList * settings;
   VarInt * numThreads;
+  VarString * pinCpus;
+  VarBool * fusedEncoding;
+  VarStringEnum * lutLayout;
+  ThresholdImageSlots threshold_slots;
+  CMVision::ListArena * arena;
 public:
-  PluginColorThreshold(FrameBuffer * _buffer, YUVLUT * _lut, ConvexHullImageMask& mask);
+  PluginColorThreshold(FrameBuffer * _buffer, YUVLUT * _lut, ConvexHullImageMask& mask, CMVision::ListArena * _arena);
 
     ~PluginColorThreshold() override;
 
@@ -74,10 +99,30 @@ public:
     VarList * getSettings() override;
 
     string getName() override;
+
+    /// the threads of this stack, pinned to the configured cpus, or nullptr to run on the capture thread.
+    /// Updated by process(), so later plugins of the same frame can use it.
+    WorkerPool * getPool() const { return pool; }
 private:
-    std::vector<PluginColorThresholdWorker*> workers;
+    // runs of one tile in fused mode, kept between frames to avoid allocations
+    struct TileRuns {
+      std::vector<CMVision::Run> runs;
+      int used = 0;
+      bool complete = true;
+    };
+
+    WorkerPool * pool = nullptr;
+    std::string pool_cpus;
+    std::vector<TileRuns> tile_runs;
 
-    void clearWorkers();
+    void updatePool();
+    LUT3D * getTable(ColorFormat format);
+    int getTileRows(int height) const;
+    void runTiles(int height, int tile_rows, const std::function<void(int, int)> & task);
+    void thresholdImage(const RawImage & video, const LUTReadGuard & table, const Image<raw8> & mask, const MaskSpan * spans,
+                        Image<raw8> * target);
+    bool thresholdAndEncode(const RawImage & video, const LUTReadGuard & table, const Image<raw8> & mask, const MaskSpan * spans,
+                            CMVision::RunList * runlist);
 };
 
 #endif
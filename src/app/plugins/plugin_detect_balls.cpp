@@ -18,11 +18,11 @@
   \author  Author Name, 2009
 */
 //========================================================================
-#include <list>
+#include <algorithm>
 #include "plugin_detect_balls.h"
 
 PluginDetectBalls::PluginDetectBalls ( FrameBuffer * _buffer, LUT3D * lut, const CameraParameters& camera_params, const RoboCupField& field,PluginDetectBallsSettings * settings )
-    : VisionPlugin ( _buffer ), camera_parameters ( camera_params ), field ( field ) {
+    : VisionPlugin ( _buffer ), camera_parameters ( camera_params ), field ( field ), threshold_image ( _buffer ) {
   _lut=lut;
 
   _settings=settings;
@@ -37,7 +37,6 @@ PluginDetectBalls::PluginDetectBalls ( FrameBuffer * _buffer, LUT3D * lut, const
 
 
   //read-out important LUT data:
-  histogram = new CMVision::Histogram ( _lut->getChannelCount() );
   color_id_orange = _lut->getChannelID ( "Orange" );
   if ( color_id_orange == -1 ) printf ( "WARNING color label 'Orange' not defined in LUT!!!\n" );
   color_id_pink = _lut->getChannelID ( "Pink" );
@@ -47,6 +46,8 @@ PluginDetectBalls::PluginDetectBalls ( FrameBuffer * _buffer, LUT3D * lut, const
   color_id_field = _lut->getChannelID ( "Field Green" );
   if ( color_id_field == -1 ) printf ( "WARNING color label 'Field Green' not defined in LUT!!!\n" );
 
+  slot_detection_frame = registerFrameDataSlot<SSL_DetectionFrame> ( _buffer, "ssl_detection_frame", [] () { return new SSL_DetectionFrame(); } );
+  slot_colorlist = registerFrameDataSlot<CMVision::ColorRegionList> ( _buffer, "cmv_colorlist" );
 
 
 
@@ -54,7 +55,6 @@ PluginDetectBalls::PluginDetectBalls ( FrameBuffer * _buffer, LUT3D * lut, const
 
 
 PluginDetectBalls::~PluginDetectBalls() {
-  delete histogram;
 }
 
 
@@ -70,50 +70,91 @@ string PluginDetectBalls::getName() {
   return "DetectBalls";
 }
 
-bool PluginDetectBalls::checkHistogram ( const Image<raw8> * image, const CMVision::Region * reg, double min_greenness, double max_markeryness ) {
+bool PluginDetectBalls::checkHistogram ( CMVision::IntegralHistogram * histogram, const CMVision::Region * reg, double min_greenness, double max_markeryness ) {
   static const int PixelRadius = 4;
 
-  histogram->clear();
+  int num = histogram->addBox ( reg->x1 - PixelRadius, reg->y1 - PixelRadius, reg->x2 + PixelRadius, reg->y2 + PixelRadius );
+  int orange = histogram->getChannel ( color_id_orange );
 
-  int num = histogram->addBox ( image, reg->x1 - PixelRadius, reg->y1 - PixelRadius,
-                                reg->x2 + PixelRadius, reg->y2 + PixelRadius );
-
-
-  float pf = ( float ) ( histogram->getChannel ( color_id_pink ) ) / ( float ) ( histogram->getChannel ( color_id_orange ) );
-  float yf = ( float ) ( histogram->getChannel ( color_id_yellow ) ) / ( float ) ( histogram->getChannel ( color_id_orange ) );
+  float pf = ( float ) ( histogram->getChannel ( color_id_pink ) ) / ( float ) ( orange );
+  float yf = ( float ) ( histogram->getChannel ( color_id_yellow ) ) / ( float ) ( orange );
   float markeryness = ( pf + 1 ) * ( yf + 1 ) - 1;
-  float greenness = ( float ) ( histogram->getChannel ( color_id_field ) ) / ( ( ( float ) ( num - histogram->getChannel ( color_id_orange ) ) ) + 1E-6 );
+  float greenness = ( float ) ( histogram->getChannel ( color_id_field ) ) / ( ( ( float ) ( num - orange ) ) + 1E-6 );
 
   if ( greenness   > min_greenness ) return ( true );
   if ( markeryness > max_markeryness ) return ( false );
   return ( true );
 }
 
-//Data structure for storing and sorting the filtered regions
-class BallDetectResult
-{
-public:
-  const CMVision::Region* reg;
-  float conf;
+const ImageToFieldGrid & PluginDetectBalls::getRobotGrid ( double robot_height, int image_width, int image_height ) {
+  for ( const auto & grid : robot_grids ) {
+    if ( grid->getHeight() ==robot_height ) return *grid;
+  }
+  robot_grids.push_back ( camera_parameters.getImageToFieldGrid ( calibration,robot_height,image_width,image_height ) );
+  return *robot_grids.back();
+}
 
-  BallDetectResult(const CMVision::Region* reg, float conf) {
-    this->reg = reg;
-    this->conf = conf;    
+bool PluginDetectBalls::ranksBefore ( const BallDetectResult & a, const BallDetectResult & b ) {
+  //higher confidence first, of equal ones the candidate found last
+  if ( a.conf != b.conf ) return a.conf > b.conf;
+  return a.index > b.index;
+}
+
+void PluginDetectBalls::addCandidate ( const BallDetectResult & candidate ) {
+  if ( ( int ) best_balls.size() < max_balls ) {
+    best_balls.push_back ( candidate );
+    push_heap ( best_balls.begin(),best_balls.end(),ranksBefore );
+  } else if ( ranksBefore ( candidate,best_balls.front() ) ) {
+    pop_heap ( best_balls.begin(),best_balls.end(),ranksBefore );
+    best_balls.back() = candidate;
+    push_heap ( best_balls.begin(),best_balls.end(),ranksBefore );
   }
+}
 
-  bool operator< (BallDetectResult a) {
-    return conf < a.conf;
+void PluginDetectBalls::initNearRobots ( const SSL_DetectionFrame * detection_frame ) {
+  near_robots.clear();
+  near_robot_heights.clear();
+  for ( const SSL_DetectionRobot & robot : detection_frame->robots_blue() ) {
+    if ( robot.confidence() > 0.0 ) near_robots.push_back ( { robot.height(),robot.x(),robot.y() } );
   }
-};
+  for ( const SSL_DetectionRobot & robot : detection_frame->robots_yellow() ) {
+    if ( robot.confidence() > 0.0 ) near_robots.push_back ( { robot.height(),robot.x(),robot.y() } );
+  }
+  sort ( near_robots.begin(),near_robots.end(),[] ( const NearRobot & a, const NearRobot & b ) {
+    return a.height < b.height || ( a.height == b.height && a.x < b.x );
+  } );
+  for ( int i = 0; i < ( int ) near_robots.size(); i++ ) {
+    if ( i == 0 || near_robots[i].height != near_robots[i-1].height ) near_robot_heights.push_back ( i );
+  }
+  near_robot_heights.push_back ( near_robots.size() );
+}
+
+bool PluginDetectBalls::isNearRobot ( const vector2d & pixel_pos, int image_width, int image_height ) {
+  //the candidate is projected once for each robot height, then only the robots
+  //within the distance along x are compared
+  for ( int h = 0; h + 1 < ( int ) near_robot_heights.size(); h++ ) {
+    auto begin = near_robots.begin() + near_robot_heights[h];
+    auto end = near_robots.begin() + near_robot_heights[h+1];
+    vector3d field_on_bot_pos_3d;
+    getRobotGrid ( begin->height,image_width,image_height ).image2field ( field_on_bot_pos_3d, pixel_pos );
+    double x = field_on_bot_pos_3d.x;
+    double y = field_on_bot_pos_3d.y;
+    auto it = lower_bound ( begin,end,x - near_robot_dist,[] ( const NearRobot & robot, double min_x ) {
+      return robot.x < min_x;
+    } );
+    for ( ; it != end && it->x <= x + near_robot_dist; it++ ) {
+      if ( ( sq ( it->x - x ) + sq ( it->y - y ) ) < near_robot_dist_sq ) return true;
+    }
+  }
+  return false;
+}
 
 ProcessResult PluginDetectBalls::process ( FrameData * data, RenderOptions * options ) {
   ( void ) options;
   if ( data==0 ) return ProcessingFailed;
 
-  SSL_DetectionFrame * detection_frame = 0;
-
-  detection_frame= ( SSL_DetectionFrame * ) data->map.get ( "ssl_detection_frame" );
-  if ( detection_frame == 0 ) detection_frame= ( SSL_DetectionFrame * ) data->map.insert ( "ssl_detection_frame",new SSL_DetectionFrame() );
+  SSL_DetectionFrame * detection_frame = data->map.get ( slot_detection_frame );
+  if ( detection_frame == 0 ) return ProcessingFailed;
 
   int color_id_ball = _lut->getChannelID ( _settings->_color_label->getString() );
   if ( color_id_ball == -1 ) {
@@ -162,44 +203,47 @@ ProcessResult PluginDetectBalls::process ( FrameData * data, RenderOptions * opt
     z_height= _settings->_ball_z_height->getDouble();
 
     near_robot_filter = _settings->_ball_too_near_robot_enabled->getBool();
-    near_robot_dist_sq = sq(_settings->_ball_too_near_robot_dist->getDouble());
+    near_robot_dist = fabs(_settings->_ball_too_near_robot_dist->getDouble());
+    near_robot_dist_sq = sq(near_robot_dist);
   }
 
   const CMVision::Region * reg = 0;
 
   //acquire orange region list from data-map:
   CMVision::ColorRegionList * colorlist;
-  colorlist= ( CMVision::ColorRegionList * ) data->map.get ( "cmv_colorlist" );
+  colorlist= data->map.get ( slot_colorlist );
   if ( colorlist==0 ) {
     printf ( "error in ball detection plugin: no region-lists were found!\n" );
     return ProcessingFailed;
   }
-  reg = colorlist->getRegionList ( color_id_ball ).getInitialElement();
 
-  //acquire color-labeled image from data-map:
-  const Image<raw8> * image = ( Image<raw8> * ) ( data->map.get ( "cmv_threshold" ) );
-  if ( image==0 ) {
-    printf ( "error in ball detection plugin: no color-thresholded image was found!\n" );
-    return ProcessingFailed;
+  //acquire the histogram tables of the color-labeled image, only needed for the histogram check:
+  CMVision::IntegralHistogram * histogram = 0;
+  if ( filter_ball_histogram ) {
+    histogram = threshold_image.getIntegral ( data );
+    if ( histogram==0 ) {
+      printf ( "error in ball detection plugin: no color-thresholded image was found!\n" );
+      return ProcessingFailed;
+    }
   }
 
-  int robots_blue_n=0;
-  int robots_yellow_n=0;
   bool use_near_robot_filter=near_robot_filter;
   if ( use_near_robot_filter ) {
-    SSL_DetectionFrame * detection_frame = ( SSL_DetectionFrame * ) data->map.get ( "ssl_detection_frame" );
-    if ( detection_frame==0 ) {
-      use_near_robot_filter=false;
-    } else {
-      robots_blue_n=detection_frame->robots_blue_size();
-      robots_yellow_n=detection_frame->robots_yellow_size();
-      if (robots_blue_n==0 && robots_yellow_n==0) use_near_robot_filter=false;
-    }
+    initNearRobots ( detection_frame );
+    if ( near_robots.empty() ) use_near_robot_filter=false;
   }
 
+  //copy the calibration and fetch the image to field lookup grids once per frame:
+  int image_width=data->video.getWidth();
+  int image_height=data->video.getHeight();
+  camera_parameters.getSnapshot ( calibration );
+  ball_grid=camera_parameters.getImageToFieldGrid ( calibration,z_height,image_width,image_height );
+  robot_grids.clear();
+
   if ( max_balls > 0 ) {
-    list<BallDetectResult> result;
-    filter.init ( reg );
+    best_balls.clear();
+    int num_candidates = 0;
+    filter.init ( colorlist->getRegionList ( color_id_ball ) );
     
     while ( ( reg = filter.getNext() ) != 0 ) {
       float conf = 1.0;
@@ -216,7 +260,7 @@ ProcessResult PluginDetectBalls::process ( FrameData * data, RenderOptions * opt
       //convert from image to field coordinates:
       vector2d pixel_pos ( reg->cen_x,reg->cen_y );
       vector3d field_pos_3d;
-      camera_parameters.image2field ( field_pos_3d,pixel_pos,z_height );
+      ball_grid->image2field ( field_pos_3d,pixel_pos );
       vector2d field_pos ( field_pos_3d.x,field_pos_3d.y );
 
       //filter points that are outside of the field:
@@ -229,73 +273,35 @@ ProcessResult PluginDetectBalls::process ( FrameData * data, RenderOptions * opt
         conf = 0.0;
       }
 
-      //TODO add ball-too-near-robot filter
-      if ( use_near_robot_filter && conf > 0.0 ) {
-        int robots_n=0;
-        for (int team = 0; team < 2; team++) {
-          if (team==0) {
-            robots_n=robots_blue_n;
-          } else {
-            robots_n=robots_yellow_n;
-          }
-          if (robots_n > 0) {
-            ::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot > * robots;
-            if (team==0) {
-              robots = detection_frame->mutable_robots_blue();
-            } else {
-              robots = detection_frame->mutable_robots_yellow();
-            }
-            for (int r = 0; r < robots_n; r++) {
-              const SSL_DetectionRobot & robot = robots->Get(r);
-              if (robot.confidence() > 0.0) {
-                vector3d field_on_bot_pos_3d;
-                camera_parameters.image2field ( field_on_bot_pos_3d, pixel_pos, robot.height());
-                if ((sq((double)(robot.x())-(double)(field_on_bot_pos_3d.x)) + sq((double)(robot.y())-(double)(field_on_bot_pos_3d.y))) < near_robot_dist_sq) {
-                  conf = 0.0;
-                  break;
-                }
-              }
-            }
-            if (conf==0.0) break;
-          }
-        }
+      //filter out points that are too close to a robot
+      if ( use_near_robot_filter && conf > 0.0 && isNearRobot ( pixel_pos,image_width,image_height ) ) {
+        conf = 0.0;
       }
 
       // histogram check if enabled
-      if ( filter_ball_histogram && conf > 0.0 && checkHistogram ( image, reg, min_greenness, max_markeryness ) ==false ) {
+      if ( filter_ball_histogram && conf > 0.0 && checkHistogram ( histogram, reg, min_greenness, max_markeryness ) ==false ) {
         conf = 0.0;
       }
 
-      // add filtered region to the region list
+      // keep the filtered region if it is among the best max_balls ones
       if(conf > 0) {
-        result.push_back(BallDetectResult(reg,conf));
+        addCandidate ( { reg,conf,num_candidates++,field_pos_3d } );
       }
 
     }
 
-    // sort result by confidence and output first max_balls region(s)
-    result.sort();
-    
-    int num_ball = 0;
-    list<BallDetectResult>::reverse_iterator it;
-    for(it=result.rbegin(); it!=result.rend(); it++) {
-      if(++num_ball > max_balls)
-        break;
-
+    // output the best region(s) by confidence
+    sort_heap ( best_balls.begin(),best_balls.end(),ranksBefore );
+    for ( const BallDetectResult & result : best_balls ) {
       //update result:
       SSL_DetectionBall* ball = detection_frame->add_balls();
 
-      ball->set_confidence ( it->conf );
-
-      vector2d pixel_pos ( it->reg->cen_x,it->reg->cen_y );
-      vector3d field_pos_3d;
-      camera_parameters.image2field ( field_pos_3d,pixel_pos,z_height );
-
-      ball->set_area ( it->reg->area );
-      ball->set_x ( field_pos_3d.x );
-      ball->set_y ( field_pos_3d.y );
-      ball->set_pixel_x ( it->reg->cen_x );
-      ball->set_pixel_y ( it->reg->cen_y );
+      ball->set_confidence ( result.conf );
+      ball->set_area ( result.reg->area );
+      ball->set_x ( result.field_pos.x );
+      ball->set_y ( result.field_pos.y );
+      ball->set_pixel_x ( result.reg->cen_x );
+      ball->set_pixel_y ( result.reg->cen_y );
     }
 
   }
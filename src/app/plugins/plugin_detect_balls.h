@@ -30,11 +30,31 @@
 #include "vis_util.h"
 #include "VarNotifier.h"
 #include "lut3d.h"
+#include "plugin_colorthreshold.h"
 /**
 	@author Author Name
 */
 class PluginDetectBalls;
 
+//a ball candidate that passed all filters, with its position on the field
+class BallDetectResult
+{
+public:
+  const CMVision::Region* reg;
+  float conf;
+  int index; ///< order in which the candidates were found
+  vector3d field_pos;
+};
+
+//a detected robot for the near robot filter
+class NearRobot
+{
+public:
+  double height;
+  double x;
+  double y;
+};
+
 class PluginDetectBallsSettings {
 friend class PluginDetectBalls; 
 protected:
@@ -133,6 +153,7 @@ protected:
   double exp_area_var;
   double z_height;
   bool near_robot_filter;
+  double near_robot_dist;
   double near_robot_dist_sq;
   int max_balls;
   //-----------------------------
@@ -149,16 +170,36 @@ protected:
   int color_id_yellow;
   int color_id_field;
 
-  CMVision::Histogram * histogram;
 
   CMVision::RegionFilter filter;
 
   const CameraParameters& camera_parameters;
   const RoboCupField& field;
 
+  //calibration of the current frame, and image to field lookup grids at ball height and at each robot height
+  CameraCalibrationSnapshot calibration;
+  std::shared_ptr<const ImageToFieldGrid> ball_grid;
+  std::vector<std::shared_ptr<const ImageToFieldGrid> > robot_grids;
+  const ImageToFieldGrid & getRobotGrid(double robot_height, int image_width, int image_height);
+
   FieldFilter field_filter;
 
-  bool checkHistogram(const Image<raw8> * image, const CMVision::Region * reg, double min_greenness=0.5, double max_markeryness=2.0);
+  //the best max_balls candidates of the current frame, as a heap with the worst one in front
+  std::vector<BallDetectResult> best_balls;
+  static bool ranksBefore(const BallDetectResult & a, const BallDetectResult & b);
+  void addCandidate(const BallDetectResult & candidate);
+
+  //robots of the current frame sorted by height and x, and where each height starts
+  std::vector<NearRobot> near_robots;
+  std::vector<int> near_robot_heights;
+  void initNearRobots(const SSL_DetectionFrame * detection_frame);
+  bool isNearRobot(const vector2d & pixel_pos, int image_width, int image_height);
+
+  FrameDataSlot<SSL_DetectionFrame> slot_detection_frame;
+  FrameDataSlot<CMVision::ColorRegionList> slot_colorlist;
+  ThresholdImageSlots threshold_image;
+
+  bool checkHistogram(CMVision::IntegralHistogram * histogram, const CMVision::Region * reg, double min_greenness=0.5, double max_markeryness=2.0);
 
 public:
     PluginDetectBalls(FrameBuffer * _buffer, LUT3D * lut, const CameraParameters& camera_params, const RoboCupField& field, PluginDetectBallsSettings * _settings=0);
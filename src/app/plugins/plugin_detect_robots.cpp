@@ -21,7 +21,7 @@
 #include "plugin_detect_robots.h"
 
 PluginDetectRobots::PluginDetectRobots(FrameBuffer * _buffer, LUT3D * lut, const CameraParameters& camera_params, const RoboCupField& field, CMPattern::TeamSelector * _global_team_selector_blue, CMPattern::TeamSelector * _global_team_selector_yellow, CMPattern::TeamDetectorSettings * _global_team_settings)
- : VisionPlugin(_buffer), camera_parameters(camera_params), field(field)
+ : VisionPlugin(_buffer), camera_parameters(camera_params), field(field), _threshold_image(_buffer)
 {
   _lut=lut;
 
@@ -30,7 +30,8 @@ PluginDetectRobots::PluginDetectRobots(FrameBuffer * _buffer, LUT3D * lut, const
   color_id_blue = _lut->getChannelID("Blue");
   if (color_id_yellow == -1) printf("WARNING color label 'Blue' not defined in LUT!!!\n");  
 
-  color_id_clear = 0;
+  // -1 with a bitwise LUT, which has no clear channel
+  color_id_clear = _lut->getChannelID("<Clear>");
 
   color_id_ball = _lut->getChannelID("Orange");
   if (color_id_ball == -1) printf("WARNING color label 'Orange' not defined in LUT!!!\n");
@@ -45,6 +46,9 @@ PluginDetectRobots::PluginDetectRobots(FrameBuffer * _buffer, LUT3D * lut, const
   global_team_selector_yellow=_global_team_selector_yellow;
   global_team_detector_settings=_global_team_settings;
 
+  _slot_detection_frame=registerFrameDataSlot<SSL_DetectionFrame>(_buffer,"ssl_detection_frame",[]() { return new SSL_DetectionFrame(); });
+  _slot_colorlist=registerFrameDataSlot<CMVision::ColorRegionList>(_buffer,"cmv_colorlist");
+
   team_detector_blue=new CMPattern::TeamDetector(_lut,camera_params,field);
   team_detector_yellow=new CMPattern::TeamDetector(_lut,camera_params,field);
 
@@ -74,10 +78,8 @@ void PluginDetectRobots::buildRegionTree(CMVision::ColorRegionList * colorlist)
   for(int c=0;c<num_colors;c++) {
     //ONLY ADD ROBOT MARKER COLORS:
     if (c!= color_id_clear && c!=color_id_field && c!= color_id_ball && c!= color_id_black) {
-      CMVision::Region *reg = colorlist->getRegionList(c).getInitialElement();
-      while(reg!=0) {
+      for (CMVision::Region * reg : colorlist->getRegionList(c)) {
         reg_tree.add(reg);
-        reg = reg->next;
       }
     }
   }
@@ -89,26 +91,17 @@ ProcessResult PluginDetectRobots::process(FrameData * data, RenderOptions * opti
   (void)options;
   if (data==0) return ProcessingFailed;
 
-  SSL_DetectionFrame * detection_frame = 0;
-
-  detection_frame=(SSL_DetectionFrame *)data->map.get("ssl_detection_frame");
-  if (detection_frame == 0) detection_frame=(SSL_DetectionFrame *)data->map.insert("ssl_detection_frame",new SSL_DetectionFrame());
+  SSL_DetectionFrame * detection_frame=data->map.get(_slot_detection_frame);
+  if (detection_frame == 0) return ProcessingFailed;
 
   //acquire orange region list from data-map:
   CMVision::ColorRegionList * colorlist;
-  colorlist=(CMVision::ColorRegionList *)data->map.get("cmv_colorlist");
+  colorlist=data->map.get(_slot_colorlist);
   if (colorlist==0) {
     printf("error in robot detection plugin: no region-lists were found!\n");
     return ProcessingFailed;
   }
 
-  //acquire color-labeled image from data-map:
-  const Image<raw8> * image = (Image<raw8> *)(data->map.get("cmv_threshold"));
-  if (image==0) {
-    printf("error in robot detection plugin: no color-thresholded image was found!\n");
-    return ProcessingFailed;
-  }
-
   CMPattern::Team * team=0;
   ::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robotlist=0;
   
@@ -142,7 +135,17 @@ ProcessResult PluginDetectRobots::process(FrameData * data, RenderOptions * opti
         detector->init(global_team_detector_settings->getRobotPattern(), team);
       }
 
-      detector->update(robotlist, color_id,  num_robots, image, colorlist, reg_tree);
+      //acquire the histogram tables of the color-labeled image, only if the detector's histogram check needs them:
+      CMVision::IntegralHistogram * histogram = 0;
+      if (detector->usesHistogram()) {
+        histogram = _threshold_image.getIntegral(data);
+        if (histogram==0) {
+          printf("error in robot detection plugin: no color-thresholded image was found!\n");
+          return ProcessingFailed;
+        }
+      }
+
+      detector->update(robotlist, color_id,  num_robots, histogram, data->video.getWidth(), data->video.getHeight(), colorlist, reg_tree);
     } else {
       _notifier.changeSlotOtherChange();
     }
@@ -32,6 +32,7 @@
 #include "vis_util.h"
 #include "lut3d.h"
 #include "VarNotifier.h"
+#include "plugin_colorthreshold.h"
 /**
 	@author Author Name
 */
@@ -64,6 +65,10 @@ protected:
   const CameraParameters& camera_parameters;
   const RoboCupField& field;
 
+  FrameDataSlot<SSL_DetectionFrame> _slot_detection_frame;
+  FrameDataSlot<CMVision::ColorRegionList> _slot_colorlist;
+  ThresholdImageSlots _threshold_image;
+
   void buildRegionTree(CMVision::ColorRegionList * colorlist);
 
 protected slots:
@@ -39,6 +39,9 @@ PluginDetectRobotsArUco::PluginDetectRobotsArUco(FrameBuffer * _buffer, LUT3D *
     global_team_selector_yellow=_global_team_selector_yellow;
     global_team_detector_settings=_global_team_settings;
 
+    _slot_detection_frame=registerFrameDataSlot<SSL_DetectionFrame>(_buffer,"ssl_detection_frame",[]() { return new SSL_DetectionFrame(); });
+    _slot_tag_result=registerFrameDataSlot<TagResults>(_buffer,"tag_result",[]() { return new TagResults(); });
+
     _settings=new VarList("Robot Tag");
     _settings->addChild(_shrink_ratio = new VarDouble("Shrink Ratio",1.0,1.0,10.0));
     _settings->addChild(_min_marker_ratio = new VarDouble("Marker4Image ratio",0.0,0.0,1.0));
@@ -69,10 +72,8 @@ ProcessResult PluginDetectRobotsArUco::process(FrameData * data, RenderOptions *
     (void)options;
     if (data==0) return ProcessingFailed;
 
-    SSL_DetectionFrame * detection_frame = 0;
-
-    detection_frame=(SSL_DetectionFrame *)data->map.get("ssl_detection_frame");
-    if (detection_frame == 0) detection_frame=(SSL_DetectionFrame *)data->map.insert("ssl_detection_frame",new SSL_DetectionFrame());
+    SSL_DetectionFrame * detection_frame=data->map.get(_slot_detection_frame);
+    if (detection_frame == 0) return ProcessingFailed;
 
     detection_frame->clear_robots_blue();
     detection_frame->clear_robots_yellow();
@@ -90,10 +91,7 @@ ProcessResult PluginDetectRobotsArUco::process(FrameData * data, RenderOptions *
         return ProcessingFailed;
     }
 
-    TagResults * res = (TagResults *) data->map.get("tag_result");
-    if (res == nullptr) {
-        res = (TagResults *) data->map.insert("tag_result", new TagResults());
-    }
+    TagResults * res = data->map.get(_slot_tag_result);
     auto markers = MDetector.detect(resizeImage);
     bool need_reinit=_notifier.hasChanged();
     if(need_reinit){
@@ -107,6 +105,8 @@ ProcessResult PluginDetectRobotsArUco::process(FrameData * data, RenderOptions *
     res->markerCenters.clear();
     res->markerFaceCenters.clear();
     res->markerIds.clear();
+    CameraCalibrationSnapshot calibration;
+    camera_parameters.getSnapshot(calibration);
     for(auto& marker : markers){
         if(marker.size()!=4){
             std::cerr << "marker corner size not correct" << std::endl;
@@ -126,7 +126,7 @@ ProcessResult PluginDetectRobotsArUco::process(FrameData * data, RenderOptions *
         vector2d face_cen(0,0);
         for(auto corner_i=0u;corner_i<4;corner_i++){
             p_img.set(shrink_ratio*ps[corner_i].x,shrink_ratio*ps[corner_i].y);
-            camera_parameters.image2field(p_3d,p_img,_robot_height);
+            calibration.image2field(p_3d,p_img,_robot_height);
             img_cen.x += p_img.x/4.0;
             img_cen.y += p_img.y/4.0;
             cen.x += p_3d.x/4.0;
@@ -67,6 +67,9 @@ protected:
 
     double _blue_robot_height;
     double _yellow_robot_height;
+
+    FrameDataSlot<SSL_DetectionFrame> _slot_detection_frame;
+    FrameDataSlot<TagResults> _slot_tag_result;
 protected slots:
     void teamDataChange();
 public:
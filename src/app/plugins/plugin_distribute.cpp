@@ -27,6 +27,8 @@ PluginDistribute::PluginDistribute(FrameBuffer *_buffer, vector<CaptureSplitter
   _settings->addChild(_v_enabled);
   _settings->addChild(_v_image);
   _settings->addChild(_v_greyscale);
+
+  _slot_vis_frame = registerFrameDataSlot<VisualizationFrame>(_buffer, "vis_frame", []() { return new VisualizationFrame(); });
 }
 
 PluginDistribute::~PluginDistribute() = default;
@@ -82,12 +84,9 @@ ProcessResult PluginDistribute::process(FrameData *data, RenderOptions *options)
     captureSplitter->waitUntilFrameProcessed();
   }
 
-  VisualizationFrame *vis_frame =
-      reinterpret_cast<VisualizationFrame *>(data->map.get("vis_frame"));
-  if (vis_frame == nullptr) {
-    vis_frame = reinterpret_cast<VisualizationFrame *>(
-        data->map.insert("vis_frame", new VisualizationFrame()));
-  }
+  VisualizationFrame *vis_frame = data->map.get(_slot_vis_frame);
+  if (vis_frame == nullptr)
+    return ProcessingFailed;
 
   if (_v_enabled->getBool()) {
     // check video data...
@@ -29,6 +29,7 @@ protected:
   VarBool *_v_greyscale;
 
   std::vector<CaptureSplitter*> captureSplitters;
+  FrameDataSlot<VisualizationFrame> _slot_vis_frame;
 
   void drawCameraImage(FrameData *data, VisualizationFrame *vis_frame);
 
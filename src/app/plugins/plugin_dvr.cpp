@@ -427,6 +427,7 @@ void PluginDVR::slotMovieSave() {
 PluginDVR::PluginDVR(FrameBuffer * fb)
  : VisionPlugin(fb)
 {
+  slot_detection_frame = registerFrameDataSlot<SSL_DetectionFrame>(fb, "ssl_detection_frame");
   mode = DVRModeOff;
   advance_last_t=0;
   seek_mode = SeekModeLive;
@@ -497,7 +498,7 @@ ProcessResult PluginDVR::process(FrameData * data, RenderOptions * options) {
       stream.setLimit(_max_frames->getInt());
 
       // Get detection frame connected to frame
-      SSL_DetectionFrame* detection_frame = (SSL_DetectionFrame *)data->map.get("ssl_detection_frame");
+      SSL_DetectionFrame* detection_frame = data->map.get(slot_detection_frame);
 
       // If recording is on, store the frame and possible detection_frame in the ringbuffers
       if (is_recording) {
@@ -235,6 +235,8 @@ protected:
   // but is not available in c++11
   std::unique_ptr<DVRNonBlockingWriter> frame_writer;
 
+  FrameDataSlot<SSL_DetectionFrame> slot_detection_frame;
+
 public:
 
   PluginDVR(FrameBuffer * fb);
@@ -20,8 +20,9 @@
 //========================================================================
 #include "plugin_find_blobs.h"
 
-PluginFindBlobs::PluginFindBlobs(FrameBuffer * _buffer, YUVLUT * _lut)
- : VisionPlugin(_buffer)
+PluginFindBlobs::PluginFindBlobs(FrameBuffer * _buffer, YUVLUT * _lut, CMVision::ListArena * _arena,
+                                 PluginColorThreshold * _threshold)
+ : VisionPlugin(_buffer), arena(_arena), threshold(_threshold)
 {
   lut=_lut;
 
@@ -29,8 +30,16 @@ PluginFindBlobs::PluginFindBlobs(FrameBuffer * _buffer, YUVLUT * _lut)
   _settings->addChild(_v_min_blob_area=new VarInt("min_blob_area", 5));
   _settings->addChild(_v_min_blob_area_ratio=new VarDouble("min_blob_area ratio", 0.5));
   _settings->addChild(_v_enable=new VarBool("enable", true));
-  _settings->addChild(v_max_regions=new VarInt("max regions", 50000, 10000, 1000000));
-
+  // the region lists start small and grow with the number of regions seen, up to this limit
+  _settings->addChild(v_region_limit=new VarInt("region capacity limit", arena->regions.getLimit(), 10000, 100000000));
+
+  _slot_reglist = registerFrameDataSlot<CMVision::RegionList>(_buffer, "cmv_reglist", [this]() {
+    return new CMVision::RegionList(arena->regions.getCapacity());
+  });
+  _slot_colorlist = registerFrameDataSlot<CMVision::ColorRegionList>(_buffer, "cmv_colorlist", [this]() {
+    return new CMVision::ColorRegionList(lut->getChannelCount());
+  });
+  _slot_runlist = registerFrameDataSlot<CMVision::RunList>(_buffer, "cmv_runlist");
 }
 
 
@@ -40,7 +49,7 @@ PluginFindBlobs::~PluginFindBlobs()
   delete _v_min_blob_area;
   delete _v_min_blob_area_ratio;
   delete _v_enable;
-  delete v_max_regions;
+  delete v_region_limit;
 }
 
 
@@ -49,49 +58,47 @@ ProcessResult PluginFindBlobs::process(FrameData * data, RenderOptions * options
   (void)options;
 
 
-  CMVision::RegionList * reglist = (CMVision::RegionList *) data->map.get("cmv_reglist");
-  if (reglist == nullptr || reglist->getMaxRegions() != v_max_regions->getInt()) {
-    delete reglist;
-    reglist = (CMVision::RegionList *) data->map.update("cmv_reglist", new CMVision::RegionList(v_max_regions->getInt()));
-  }
-
-  CMVision::ColorRegionList * colorlist = (CMVision::ColorRegionList *) data->map.get("cmv_colorlist");
-  if (colorlist == nullptr) {
-    colorlist = (CMVision::ColorRegionList *) data->map.insert("cmv_colorlist", new CMVision::ColorRegionList(lut->getChannelCount()));
-  }
-
-  CMVision::RunList * runlist = (CMVision::RunList *) data->map.get("cmv_runlist");
-  if (runlist == nullptr) {
+  CMVision::RegionList * reglist = data->map.get(_slot_reglist);
+  CMVision::ColorRegionList * colorlist = data->map.get(_slot_colorlist);
+  CMVision::RunList * runlist = data->map.get(_slot_runlist);
+  if (reglist == nullptr) return ProcessingFailed;
+  if (arena->regions.getLimit() != v_region_limit->getInt()) arena->regions.setLimit(v_region_limit->getInt());
+  if (colorlist == nullptr || runlist == nullptr) {
     printf("Blob finder: no runlength-encoded input list was found!\n");
     return ProcessingFailed;
   }
 
+  // components are connected in bands of rows (with a bitwise LUT: one channel each)
+  // on the pinned threads of the color threshold, or on the capture thread without them
+  WorkerPool * pool = threshold->getPool();
+
   if (_v_enable->getBool()) {
     //Connect the components of the runlength map:
-    CMVision::RegionProcessing::connectComponents(runlist);
+    LUTChannelMode mode = lut->getChannelMode();
+    if (mode == LUTChannelMode_Bitwise) {
+      CMVision::RegionProcessing::connectBitplanes(runlist, pool);
+    } else if (pool != nullptr) {
+      CMVision::RegionProcessing::connectComponents(runlist, pool);
+    } else {
+      CMVision::RegionProcessing::connectComponents(runlist);
+    }
 
-    //Extract Regions from runlength map:
+    //Extract Regions from runlength map, into a list that may only grow here:
+    arena->prepare(reglist);
     CMVision::RegionProcessing::extractRegions(reglist, runlist);
 
-    if (reglist->getUsedRegions() == reglist->getMaxRegions()) {
-      printf("Warning: FindBlobs: extract regions exceeded maximum number of %d regions\n",reglist->getMaxRegions());
-    }
+    // a truncated list is counted as an overflow and makes room for the next frames
+    arena->record(reglist);
 
     //Separate Regions by colors:
-    int max_area = CMVision::RegionProcessing::separateRegions(colorlist, reglist, _v_min_blob_area->getInt(), _v_min_blob_area_ratio->getDouble());
+    CMVision::RegionProcessing::separateRegions(colorlist, reglist, _v_min_blob_area->getInt(), _v_min_blob_area_ratio->getDouble(), mode);
 
     //Sort Regions:
-    CMVision::RegionProcessing::sortRegions(colorlist,max_area);
+    CMVision::RegionProcessing::sortRegions(colorlist);
   } else {
     //detect nothing.
     reglist->setUsedRegions(0);
-    int num_colors=colorlist->getNumColorRegions();
-    CMVision::RegionLinkedList * color=colorlist->getColorRegionArrayPointer();
-
-    // clear out the region list head table
-    for(int i=0; i<num_colors; i++){
-      color[i].reset();
-    }
+    colorlist->reset();
   }
 
   return ProcessingOk;
@@ -24,6 +24,7 @@
 #include <visionplugin.h>
 #include "lut3d.h"
 #include "cmvision_region.h"
+#include "plugin_colorthreshold.h"
 /**
 	@author Stefan Zickler
 */
@@ -36,9 +37,15 @@ protected:
   VarInt * _v_min_blob_area;
   VarDouble * _v_min_blob_area_ratio;
   VarBool * _v_enable;
-  VarInt * v_max_regions;
+  VarInt * v_region_limit;
+  CMVision::ListArena * arena;
+  PluginColorThreshold * threshold;
+  FrameDataSlot<CMVision::RegionList> _slot_reglist;
+  FrameDataSlot<CMVision::ColorRegionList> _slot_colorlist;
+  FrameDataSlot<CMVision::RunList> _slot_runlist;
 public:
-    PluginFindBlobs(FrameBuffer * _buffer, YUVLUT * _lut);
+    PluginFindBlobs(FrameBuffer * _buffer, YUVLUT * _lut, CMVision::ListArena * _arena,
+                    PluginColorThreshold * _threshold);
 
     ~PluginFindBlobs() override;
 
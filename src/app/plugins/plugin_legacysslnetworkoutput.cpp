@@ -28,7 +28,9 @@ PluginLegacySSLNetworkOutput::PluginLegacySSLNetworkOutput(
     VisionPlugin(_fb),
     _camera_params(camera_params),
     _field(field),
-    _ds_udp_server_old(ds_udp_server_old) {}
+    _ds_udp_server_old(ds_udp_server_old) {
+  _slot_detection_frame=registerFrameDataSlot<SSL_DetectionFrame>(_fb,"ssl_detection_frame");
+}
 
 PluginLegacySSLNetworkOutput::~PluginLegacySSLNetworkOutput() {}
 
@@ -71,7 +73,7 @@ ProcessResult PluginLegacySSLNetworkOutput::process(
 
   SSL_DetectionFrame * detection_frame;
 
-  detection_frame=(SSL_DetectionFrame *)data->map.get("ssl_detection_frame");
+  detection_frame=data->map.get(_slot_detection_frame);
   if (detection_frame != nullptr) {
     detection_frame->set_t_capture(data->time);
     if (data->time_cam > 0) {
@@ -6,12 +6,17 @@ PluginMask::PluginMask(FrameBuffer *buffer, ConvexHullImageMask &mask)
     : VisionPlugin(buffer), _mask(mask) {
 
   _settings = new VarList("Image Mask");
-  _widget = new MaskWidget();
+  _widget = nullptr;
 }
 
 PluginMask::~PluginMask() { delete _settings; }
 
-QWidget *PluginMask::getControlWidget() { return (QWidget *)_widget; }
+QWidget *PluginMask::getControlWidget() {
+  if (_widget == nullptr)
+    _widget = new MaskWidget();
+
+  return (QWidget *)_widget;
+}
 
 VarList *PluginMask::getSettings() { return _settings; }
 
@@ -24,7 +29,7 @@ ProcessResult PluginMask::process(FrameData *data, RenderOptions *options) {
   if (_mask.getNumPixels() != data->video.getNumPixels())
     _mask.setSize(data->video.getWidth(), data->video.getHeight());
 
-  if (_widget->clear_mask_button->isChecked()) {
+  if (_widget != nullptr && _widget->clear_mask_button->isChecked()) {
     _mask.reset();
     _widget->clear_mask_button->setChecked(false);
   }
@@ -39,6 +44,11 @@ void PluginMask::_removePoint(const int x, const int y) {
 }
 
 void PluginMask::_mouseEvent(QMouseEvent *event, const pixelloc loc) {
+  if (_widget == nullptr) {
+    event->ignore();
+    return;
+  }
+
   auto tabw = (QTabWidget*) _widget->parentWidget()->parentWidget();
   if (tabw->currentWidget() != _widget) {
     event->ignore();
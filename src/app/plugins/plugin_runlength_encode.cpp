@@ -20,19 +20,26 @@
 //========================================================================
 #include "plugin_runlength_encode.h"
 
-PluginRunlengthEncode::PluginRunlengthEncode(FrameBuffer * _buffer)
- : VisionPlugin(_buffer)
+PluginRunlengthEncode::PluginRunlengthEncode(FrameBuffer * _buffer, CMVision::ListArena * _arena)
+ : VisionPlugin(_buffer), arena(_arena)
 {
   settings=new VarList("Run length encode");
-  v_max_runs = new VarInt("max runs", 50000, 10000, 1000000);
-  settings->addChild(v_max_runs);
+  // the run lists start small and grow with the number of runs seen, up to this limit
+  v_run_limit = new VarInt("run capacity limit", arena->runs.getLimit(), 10000, 100000000);
+  settings->addChild(v_run_limit);
+
+  slot_runlist = registerFrameDataSlot<CMVision::RunList>(_buffer, "cmv_runlist", [this]() {
+    return new CMVision::RunList(arena->runs.getCapacity());
+  });
+  slot_threshold = registerFrameDataSlot<Image<raw8>>(_buffer, "cmv_threshold");
+  slot_threshold_state = registerFrameDataSlot<ThresholdImageState>(_buffer, "cmv_threshold_state");
 }
 
 
 PluginRunlengthEncode::~PluginRunlengthEncode()
 {
   delete settings;
-  delete v_max_runs;
+  delete v_run_limit;
 }
 
 
@@ -40,24 +47,35 @@ PluginRunlengthEncode::~PluginRunlengthEncode()
 ProcessResult PluginRunlengthEncode::process(FrameData * data, RenderOptions * options) {
   (void)options;
 
-  CMVision::RunList * runlist = (CMVision::RunList *) data->map.get("cmv_runlist");
-  if (runlist == nullptr || runlist->getMaxRuns() != v_max_runs->get()) {
-    delete runlist;
-    runlist = (CMVision::RunList *) data->map.update("cmv_runlist", new CMVision::RunList(v_max_runs->getInt()));
-  }
+  CMVision::RunList * runlist = data->map.get(slot_runlist);
+  ThresholdImageState * state = data->map.get(slot_threshold_state);
+  if (runlist == nullptr) return ProcessingFailed;
+  if (arena->runs.getLimit() != v_run_limit->getInt()) arena->runs.setLimit(v_run_limit->getInt());
 
-  Image<raw8> * img_thresholded = (Image<raw8> *) data->map.get("cmv_threshold");
-  if (img_thresholded == nullptr) {
-    printf("Runlength encoder: no thresholded input image found!\n");
-    return ProcessingFailed;
-  }
+  // with fused encoding the threshold plugin already filled the list
+  if (state == nullptr || !state->runs_encoded) {
+    Image<raw8> * img_thresholded = data->map.get(slot_threshold);
+    if (img_thresholded == nullptr) {
+      printf("Runlength encoder: no thresholded input image found!\n");
+      return ProcessingFailed;
+    }
 
-  //Runlength Encode the image:
-  CMVision::RegionProcessing::encodeRuns(img_thresholded, runlist);
-  if (runlist->getUsedRuns() == runlist->getMaxRuns()) {
-    printf("Warning: runlength encoder exceeded current max run size of %d\n",runlist->getMaxRuns());
+    //the only point the list may grow, never while it is written:
+    arena->prepare(runlist);
+
+    //Runlength Encode the image, skipping what lies outside of the image mask:
+    const MaskSpan * spans = nullptr;
+    if (state != nullptr && (int)state->spans.size() == img_thresholded->getHeight()) spans = state->spans.data();
+    if (state != nullptr && state->channel_mode == LUTChannelMode_Bitwise) {
+      CMVision::RegionProcessing::encodeBitplanes(img_thresholded, runlist, state->channel_count, spans);
+    } else {
+      CMVision::RegionProcessing::encodeRuns(img_thresholded, runlist, spans);
+    }
   }
 
+  // a truncated list is counted as an overflow and makes room for the next frames
+  arena->record(runlist);
+
   return ProcessingOk;
 
 }
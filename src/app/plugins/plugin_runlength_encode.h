@@ -23,6 +23,7 @@
 
 #include <visionplugin.h>
 #include "cmvision_region.h"
+#include "plugin_colorthreshold.h"
 #include "timer.h"
 
 /**
@@ -32,9 +33,13 @@ class PluginRunlengthEncode : public VisionPlugin
 {
 protected:
   VarList * settings;
-  VarInt * v_max_runs;
+  VarInt * v_run_limit;
+  CMVision::ListArena * arena;
+  FrameDataSlot<CMVision::RunList> slot_runlist;
+  FrameDataSlot<Image<raw8>> slot_threshold;
+  FrameDataSlot<ThresholdImageState> slot_threshold_state;
 public:
-    explicit PluginRunlengthEncode(FrameBuffer * _buffer);
+    PluginRunlengthEncode(FrameBuffer * _buffer, CMVision::ListArena * _arena);
 
     ~PluginRunlengthEncode() override;
 
@@ -24,6 +24,7 @@ PluginSSLNetworkOutput::PluginSSLNetworkOutput(FrameBuffer * _fb, RoboCupSSLServ
  : VisionPlugin(_fb), _camera_params(camera_params), _field(field)
 {
   _udp_server=udp_server;
+  _slot_detection_frame=registerFrameDataSlot<SSL_DetectionFrame>(_fb,"ssl_detection_frame");
 }
 
 PluginSSLNetworkOutput::~PluginSSLNetworkOutput()
@@ -39,7 +40,7 @@ ProcessResult PluginSSLNetworkOutput::process(FrameData * data, RenderOptions *
 
   SSL_DetectionFrame * detection_frame;
 
-  detection_frame=(SSL_DetectionFrame *)data->map.get("ssl_detection_frame");
+  detection_frame=data->map.get(_slot_detection_frame);
   if (detection_frame != nullptr) {
     detection_frame->set_t_capture(data->time);
     if (data->time_cam > 0) {
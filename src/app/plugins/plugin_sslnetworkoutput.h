@@ -36,6 +36,7 @@ protected:
  const CameraParameters& _camera_params;
  const RoboCupField& _field;
  RoboCupSSLServer * _udp_server;
+ FrameDataSlot<SSL_DetectionFrame> _slot_detection_frame;
 public:
     PluginSSLNetworkOutput(FrameBuffer * _fb, RoboCupSSLServer * udp_server, const CameraParameters& camera_params, const RoboCupField& field);
 
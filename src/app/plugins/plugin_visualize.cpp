@@ -37,7 +37,7 @@ PluginVisualize::PluginVisualize(
     const RoboCupField& real_field, const ConvexHullImageMask& mask) :
     VisionPlugin(_buffer), camera_parameters(camera_params),
     real_field(real_field),
-    _image_mask(mask){
+    _image_mask(mask), _threshold_image(_buffer) {
   _v_enabled = new VarBool("enable", true);
   _v_image = new VarBool("image", true);
   _v_greyscale = new VarBool("greyscale", false);
@@ -79,6 +79,14 @@ PluginVisualize::PluginVisualize(
   _threshold_lut=0;
   edge_image = 0;
   temp_grey_image = 0;
+
+  _slot_vis_frame = registerFrameDataSlot<VisualizationFrame>(_buffer, "vis_frame", []() { return new VisualizationFrame(); });
+  _slot_colorlist = registerFrameDataSlot<CMVision::ColorRegionList>(_buffer, "cmv_colorlist");
+  _slot_chessboard = registerFrameDataSlot<Chessboard>(_buffer, "chessboard");
+  _slot_chessboard_img_points = registerFrameDataSlot<std::vector<std::vector<cv::Point2f>>>(_buffer, "chessboard_img_points");
+#ifdef USE_TAG_FOR_ROBOT
+  _slot_tag_result = registerFrameDataSlot<TagResults>(_buffer, "tag_result");
+#endif
 }
 
 
@@ -141,17 +149,28 @@ void PluginVisualize::DrawCameraImage(
 void PluginVisualize::DrawThresholdedImage(
     FrameData* data, VisualizationFrame* vis_frame) {
   if (_threshold_lut != 0) {
-    Image<raw8>* img_thresholded =
-        reinterpret_cast<Image<raw8>*>(data->map.get("cmv_threshold"));
+    Image<raw8>* img_thresholded = _threshold_image.get(data);
     if (img_thresholded != 0) {
       int n = vis_frame->data.getNumPixels();
       if (img_thresholded->getNumPixels() == n) {
         rgb * vis_ptr = vis_frame->data.getPixelData();
         raw8 * seg_ptr = img_thresholded->getPixelData();
-        for (int i = 0; i < n; i++) {
-          if (seg_ptr[i].getIntensity() != 0) {
-            vis_ptr[i] = _threshold_lut->getChannel(
-                seg_ptr[i].getIntensity()).draw_color;
+        int width = img_thresholded->getWidth();
+        int height = img_thresholded->getHeight();
+        // outside of the spans of the image mask everything is clear
+        ThresholdImageState * state = data->map.get(_threshold_image.state);
+        bool use_spans = state != nullptr && (int)state->spans.size() == height;
+        // a bitwise label is drawn in the color of its lowest channel
+        bool bitwise = _threshold_lut->getChannelMode() == LUTChannelMode_Bitwise;
+        for (int y = 0; y < height; y++) {
+          int begin = use_spans ? state->spans[y].begin : 0;
+          int end = use_spans ? state->spans[y].end : width;
+          for (int i = y * width + begin; i < y * width + end; i++) {
+            unsigned int label = seg_ptr[i].getIntensity();
+            if (label != 0) {
+              vis_ptr[i] = _threshold_lut->getChannel(
+                  bitwise ? __builtin_ctz(label) : label).draw_color;
+            }
           }
         }
       }
@@ -161,12 +180,8 @@ void PluginVisualize::DrawThresholdedImage(
 
 void PluginVisualize::DrawBlobs(
     FrameData* data, VisualizationFrame* vis_frame) {
-  CMVision::ColorRegionList* colorlist =
-      reinterpret_cast<CMVision::ColorRegionList*>(
-          data->map.get("cmv_colorlist"));
+  CMVision::ColorRegionList* colorlist = data->map.get(_slot_colorlist);
   if (colorlist != 0) {
-    CMVision::RegionLinkedList * regionlist;
-    regionlist = colorlist->getColorRegionArrayPointer();
     for (int i = 0; i < colorlist->getNumColorRegions(); i++) {
       rgb blob_draw_color;
       if (_threshold_lut != 0) {
@@ -174,8 +189,7 @@ void PluginVisualize::DrawBlobs(
       } else {
         blob_draw_color.set(255, 255, 255);
       }
-      CMVision::Region * blob=regionlist[i].getInitialElement();
-      while (blob != 0) {
+      for (const CMVision::Region * blob : colorlist->getRegionList(i)) {
         vis_frame->data.drawLine(
             blob->x1,blob->y1,blob->x2,blob->y1,blob_draw_color);
         vis_frame->data.drawLine(
@@ -184,7 +198,6 @@ void PluginVisualize::DrawBlobs(
             blob->x1,blob->y2,blob->x2,blob->y2,blob_draw_color);
         vis_frame->data.drawLine(
             blob->x2,blob->y1,blob->x2,blob->y2,blob_draw_color);
-        blob = blob->next;
       }
     }
   }
@@ -351,7 +364,7 @@ void PluginVisualize::DrawEdgeTangent(
   const GVector::vector3d<double> field_point_plus_tangent =
       field_point + 1000.0 * field_tangent;
   GVector::vector2d<double> image_point_plus_tangent(0.0, 0.0);
-  camera_parameters.field2image(
+  calibration.field2image(
       field_point_plus_tangent, image_point_plus_tangent);
   const GVector::vector2d<double> edge_p1 =
       image_point + (image_point_plus_tangent - image_point).norm(6.0);
@@ -464,7 +477,7 @@ void PluginVisualize::DrawTags(
   FrameData* data, VisualizationFrame* vis_frame){
   _image_mask.lock();
 
-  TagResults * res = (TagResults *) data->map.get("tag_result");
+  TagResults * res = data->map.get(_slot_tag_result);
   if (res == nullptr) {
       std::cerr << "err in getting tag result, got nil" << std::endl;
       return;
@@ -485,14 +498,12 @@ ProcessResult PluginVisualize::process(
     FrameData* data, RenderOptions* options) {
   if (data == 0) return ProcessingFailed;
 
-  VisualizationFrame* vis_frame =
-      reinterpret_cast<VisualizationFrame*>(data->map.get("vis_frame"));
-  if (vis_frame == 0) {
-    vis_frame = reinterpret_cast<VisualizationFrame*>(
-        data->map.insert("vis_frame",new VisualizationFrame()));
-  }
+  VisualizationFrame* vis_frame = data->map.get(_slot_vis_frame);
+  if (vis_frame == 0) return ProcessingFailed;
 
   if (_v_enabled->getBool()) {
+    camera_parameters.getSnapshot(calibration);
+
     //check video data...
     if (data->video.getWidth() == 0 || data->video.getHeight()==0) {
       //there is no valid video data
@@ -574,13 +585,13 @@ void PluginVisualize::drawFieldArc(
   GVector::vector2d<double> lastInImage(0.0, 0.0);
   GVector::vector3d<double> lastInWorld =  center +
       radius * GVector::vector3d<double>(cos(theta1), sin(theta1), 0.0);
-  camera_parameters.field2image(lastInWorld, lastInImage);
+  calibration.field2image(lastInWorld, lastInImage);
   for (int i = 1; i <= steps; ++i) {
     const double theta = theta1 + static_cast<double>(i) * delta;
     GVector::vector3d<double> nextInWorld =  center +
         radius * GVector::vector3d<double>(cos(theta), sin(theta), 0.0);
     GVector::vector2d<double> nextInImage(0.0, 0.0);
-    camera_parameters.field2image(nextInWorld, nextInImage);
+    calibration.field2image(nextInWorld, nextInImage);
     rgb draw_color;
     draw_color.set(r,g,b);
     vis_frame->data.drawFatLine(
@@ -599,11 +610,11 @@ void PluginVisualize::drawFieldLine(
       (end - start) / static_cast<double>(steps);
   GVector::vector2d<double> lastInImage(0.0, 0.0);
   GVector::vector3d<double> lastInWorld(start);
-  camera_parameters.field2image(lastInWorld, lastInImage);
+  calibration.field2image(lastInWorld, lastInImage);
   for (int i = 0; i < steps; ++i) {
     GVector::vector3d<double> nextInWorld = lastInWorld + delta;
     GVector::vector2d<double> nextInImage;
-    camera_parameters.field2image(nextInWorld, nextInImage);
+    calibration.field2image(nextInWorld, nextInImage);
     rgb draw_color;
     draw_color.set(r,g,b);
     vis_frame->data.drawFatLine(
@@ -617,7 +628,7 @@ void PluginVisualize::drawFieldLine(
 void PluginVisualize::DrawChessboard(FrameData *data,
                                      VisualizationFrame *vis_frame) {
   Chessboard *chessboard;
-  if ((chessboard = reinterpret_cast<Chessboard*>(data->map.get("chessboard"))) == nullptr) {
+  if ((chessboard = data->map.get(_slot_chessboard)) == nullptr) {
     std::cerr << "chessboard_found key missing from data map.\n";
     return;
   }
@@ -632,7 +643,7 @@ void PluginVisualize::DrawChessboard(FrameData *data,
 
 void PluginVisualize::DrawChessboardCalibrationPoints(FrameData *data, VisualizationFrame *vis_frame) {
   std::vector<std::vector<cv::Point2f>> *chessboard_img_points;
-  if ((chessboard_img_points = reinterpret_cast<std::vector<std::vector<cv::Point2f>> *>(data->map.get("chessboard_img_points"))) == nullptr) {
+  if ((chessboard_img_points = data->map.get(_slot_chessboard_img_points)) == nullptr) {
     return;
   }
 
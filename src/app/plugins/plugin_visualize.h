@@ -30,6 +30,13 @@
 #include "field.h"
 #include "plugin_mask.h"
 #include "convex_hull_image_mask.h"
+#include "plugin_colorthreshold.h"
+#include <opencv2/core/types.hpp>
+
+class Chessboard;
+#ifdef USE_TAG_FOR_ROBOT
+struct TagResults;
+#endif
 
 /**
 	@author Stefan Zickler
@@ -74,6 +81,8 @@ protected:
   VarBool * _v_chessboard;
 
   const CameraParameters& camera_parameters;
+  // calibration of the frame being drawn
+  CameraCalibrationSnapshot calibration;
   const RoboCupField& real_field;
   const ConvexHullImageMask& _image_mask;
 
@@ -81,6 +90,15 @@ protected:
   greyImage* edge_image;
   greyImage* temp_grey_image;
 
+  FrameDataSlot<VisualizationFrame> _slot_vis_frame;
+  FrameDataSlot<CMVision::ColorRegionList> _slot_colorlist;
+  FrameDataSlot<Chessboard> _slot_chessboard;
+  FrameDataSlot<std::vector<std::vector<cv::Point2f>>> _slot_chessboard_img_points;
+#ifdef USE_TAG_FOR_ROBOT
+  FrameDataSlot<TagResults> _slot_tag_result;
+#endif
+  ThresholdImageSlots _threshold_image;
+
   void drawFieldArc(
       const GVector::vector3d<double>& center,
       double radius, double theta1, double theta2, int steps,
@@ -119,8 +137,8 @@ protected:
 #ifdef USE_TAG_FOR_ROBOT
   void DrawTags(FrameData* data, VisualizationFrame* vis_frame);
 #endif
-  static void DrawChessboard(FrameData* data, VisualizationFrame* vis_frame);
-  static void DrawChessboardCalibrationPoints(FrameData* data, VisualizationFrame* vis_frame);
+  void DrawChessboard(FrameData* data, VisualizationFrame* vis_frame);
+  void DrawChessboardCalibrationPoints(FrameData* data, VisualizationFrame* vis_frame);
 public:
   PluginVisualize(FrameBuffer* _buffer, const CameraParameters& camera_params,
                   const RoboCupField& real_field, const ConvexHullImageMask &mask);
@@ -22,7 +22,8 @@
 #include "capture_splitter.h"
 #include "DistributorStack.h"
 
-MultiStackRoboCupSSL::MultiStackRoboCupSSL(RenderOptions *_opts, int num_normal_camera_threads) :
+MultiStackRoboCupSSL::MultiStackRoboCupSSL(RenderOptions *_opts, int num_normal_camera_threads, bool headless,
+                                           LUTChannelMode lut_mode) :
     MultiVisionStack("RoboCup SSL Multi-Cam",_opts),
     ds_udp_server_new(NULL),
     ds_udp_server_old(NULL) {
@@ -110,7 +111,9 @@ MultiStackRoboCupSSL::MultiStackRoboCupSSL(RenderOptions *_opts, int num_normal_
             global_team_selector_yellow,
             ds_udp_server_new,
             ds_udp_server_old,
-            "robocup-ssl-cam-" + QString::number(i).toStdString()));
+            "robocup-ssl-cam-" + QString::number(i).toStdString(),
+            headless,
+            lut_mode));
   }
 
 #ifdef CAMERA_SPLITTER
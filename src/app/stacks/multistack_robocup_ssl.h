@@ -54,7 +54,8 @@ class MultiStackRoboCupSSL : public QObject, public MultiVisionStack {
   // UDP Server for Double-Sized field, old protobuf format.
   RoboCupSSLServer * ds_udp_server_old;
   public:
-  MultiStackRoboCupSSL(RenderOptions *_opts, int num_normal_camera_threads);
+  MultiStackRoboCupSSL(RenderOptions *_opts, int num_normal_camera_threads, bool headless = false,
+                       LUTChannelMode lut_mode = LUTChannelMode_Numeric);
   virtual string getSettingsFileName();
   virtual ~MultiStackRoboCupSSL();
   public slots:
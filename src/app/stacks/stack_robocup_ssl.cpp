@@ -34,7 +34,9 @@ StackRoboCupSSL::StackRoboCupSSL(
     CMPattern::TeamSelector * _global_team_selector_yellow,
     RoboCupSSLServer * ds_udp_server_new,
     RoboCupSSLServer * ds_udp_server_old,
-    string cam_settings_filename) :
+    string cam_settings_filename,
+    bool headless,
+    LUTChannelMode lut_mode) :
     VisionStack(_opts),
     _camera_id(camera_id),
     _cam_settings_filename(cam_settings_filename),
@@ -46,8 +48,10 @@ StackRoboCupSSL::StackRoboCupSSL(
     _ds_udp_server_new(ds_udp_server_new),
     _ds_udp_server_old(ds_udp_server_old) {
   (void)_fb;
-  lut_yuv = new YUVLUT(4,6,6,cam_settings_filename + "-lut-yuv.xml");
-  lut_yuv->loadRoboCupChannels(LUTChannelMode_Numeric);
+  // a bitwise table can not be read as a numeric one, so they are kept apart
+  string lut_suffix = (lut_mode == LUTChannelMode_Bitwise) ? "-lut-yuv-bitwise.xml" : "-lut-yuv.xml";
+  lut_yuv = new YUVLUT(4,6,6,cam_settings_filename + lut_suffix);
+  lut_yuv->loadRoboCupChannels(lut_mode);
   lut_yuv->addDerivedLUT(new RGBLUT(5,5,5,""));
   settings->addChild(lut_yuv->getSettings());
 
@@ -58,25 +62,35 @@ StackRoboCupSSL::StackRoboCupSSL(
   _global_plugin_publish_geometry->addCameraParameters(camera_parameters);
   _legacy_plugin_publish_geometry->addCameraParameters(camera_parameters);
 
-  auto *pluginColorCalibration = new PluginColorCalibration(_fb, lut_yuv, *_image_mask, LUTChannelMode_Numeric);
+  PluginColorCalibration * pluginColorCalibration = nullptr;
+  if (!headless) {
+    pluginColorCalibration = new PluginColorCalibration(_fb, lut_yuv, *_image_mask, lut_mode);
+    stack.push_back(new PluginDVR(_fb));
+  }
 
-  stack.push_back(new PluginDVR(_fb));
+  // the run and region lists of all frames grow together with what this camera sees
+  list_arena = new CMVision::ListArena();
 
   // must come before all others
   stack.push_back(new PluginMask(_fb, *_image_mask));
 
-  stack.push_back(pluginColorCalibration);
+  if (!headless) {
+    stack.push_back(pluginColorCalibration);
+  }
 
   stack.push_back(new PluginCameraCalibration(_fb,*camera_parameters, *global_field));
 
-  stack.push_back(new PluginColorThreshold(_fb,lut_yuv, *_image_mask));
+  PluginColorThreshold * threshold = new PluginColorThreshold(_fb,lut_yuv, *_image_mask, list_arena);
+  stack.push_back(threshold);
 
-  stack.push_back(
-      new PluginCameraIntrinsicCalibration(_fb, *camera_parameters));
+  if (!headless) {
+    stack.push_back(
+        new PluginCameraIntrinsicCalibration(_fb, *camera_parameters));
+  }
 
-  stack.push_back(new PluginRunlengthEncode(_fb));
+  stack.push_back(new PluginRunlengthEncode(_fb, list_arena));
 
-  stack.push_back(new PluginFindBlobs(_fb,lut_yuv));
+  stack.push_back(new PluginFindBlobs(_fb,lut_yuv,list_arena,threshold));
 #ifdef USE_TAG_FOR_ROBOT
   stack.push_back(new PluginDetectRobotsArUco(_fb,lut_yuv,*camera_parameters,*global_field,global_team_selector_blue,global_team_selector_yellow, global_team_settings));
 #else
@@ -84,7 +98,9 @@ StackRoboCupSSL::StackRoboCupSSL(
 #endif
   stack.push_back(new PluginDetectBalls(_fb,lut_yuv,*camera_parameters,*global_field,global_ball_settings));
 
-  stack.push_back(new PluginAutoColorCalibration(_fb,lut_yuv, (LUTWidget*) pluginColorCalibration->getControlWidget()));
+  if (!headless) {
+    stack.push_back(new PluginAutoColorCalibration(_fb,lut_yuv, (LUTWidget*) pluginColorCalibration->getControlWidget()));
+  }
 
   stack.push_back(new PluginSSLNetworkOutput(
       _fb,
@@ -101,9 +117,11 @@ StackRoboCupSSL::StackRoboCupSSL(
   stack.push_back(_global_plugin_publish_geometry);
   stack.push_back(_legacy_plugin_publish_geometry);
 
-  PluginVisualize * vis = new PluginVisualize(_fb,*camera_parameters,*global_field, *_image_mask);
-  vis->setThresholdingLUT(lut_yuv);
-  stack.push_back(vis);
+  if (!headless) {
+    PluginVisualize * vis = new PluginVisualize(_fb,*camera_parameters,*global_field, *_image_mask);
+    vis->setThresholdingLUT(lut_yuv);
+    stack.push_back(vis);
+  }
 }
 string StackRoboCupSSL::getSettingsFileName() {
   return _cam_settings_filename;
@@ -111,5 +129,6 @@ string StackRoboCupSSL::getSettingsFileName() {
 StackRoboCupSSL::~StackRoboCupSSL() {
   delete lut_yuv;
   delete camera_parameters;
+  delete list_arena;
 }
 
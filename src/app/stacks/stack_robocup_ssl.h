@@ -59,6 +59,16 @@ using namespace std;
   \brief   The single camera vision stack implementation used for the RoboCup SSL
   \author  Stefan Zickler, (C) 2008
            multiple of these stacks are run in parallel using the MultiStackRoboCupSSL
+
+  If \p headless is set, only the plugins needed to produce detection and
+  geometry output are created. Plugins that exist solely for interactive
+  calibration, recording or visualization (and that would require widgets)
+  are left out of the stack.
+
+  With \p lut_mode LUTChannelMode_Bitwise a pixel can belong to several
+  channels (e.g. orange and pink where they overlap) and the blobs of every
+  channel are found separately. Such a LUT has no "<Clear>" and no "Black"
+  channel and is stored in its own file.
 */
 class StackRoboCupSSL : public VisionStack {
   protected:
@@ -68,6 +78,7 @@ class StackRoboCupSSL : public VisionStack {
   CameraParameters* camera_parameters;
   RoboCupField * global_field;
   ConvexHullImageMask *_image_mask;
+  CMVision::ListArena * list_arena;
   PluginDetectBallsSettings * global_ball_settings;
   CMPattern::TeamDetectorSettings * global_team_settings;
   CMPattern::TeamSelector * global_team_selector_blue;
@@ -89,8 +100,17 @@ class StackRoboCupSSL : public VisionStack {
                   CMPattern::TeamSelector* _global_team_selector_yellow,
                   RoboCupSSLServer* ds_udp_server_new,
                   RoboCupSSLServer* ds_udp_server_old,
-                  string cam_settings_filename);
+                  string cam_settings_filename,
+                  bool headless = false,
+                  LUTChannelMode lut_mode = LUTChannelMode_Numeric);
   virtual string getSettingsFileName();
+  YUVLUT * getLUT() const {
+    return lut_yuv;
+  }
+  /// sizes and usage of the run and region lists of this stack
+  const CMVision::ListArena * getListArena() const {
+    return list_arena;
+  }
   ~StackRoboCupSSL() override;
 };
 
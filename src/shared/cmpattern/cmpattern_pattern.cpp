@@ -245,25 +245,27 @@ bool MultiPatternModel::loadSinglePatternImage(const yuvImage & image, YUVLUT *
 
   CMVision::ColorRegionList * colors = proc.getColorRegionList();
 
-  const CMVision::Region * reg = colors->getRegionList(color_team_id).getInitialElement();
+  CMVision::RegionArray team_regions = colors->getRegionList(color_team_id);
 
   // find center dot
-  if (reg==0) {
+  if (team_regions.getNumRegions()==0) {
     printf("Info: Ignoring Pattern Image for Pattern ID %d. It is missing the center marker.\n",idx);
     return false;
   }
 
+  const CMVision::Region * reg = team_regions[0];
   vector2f cen(-reg->cen_y,-reg->cen_x);
 
   // find height
   float height = default_object_height;
   if (color_height_id!=-1) {
-    reg = colors->getRegionList(color_height_id).getInitialElement();
+    CMVision::RegionArray height_regions = colors->getRegionList(color_height_id);
 
-    if(reg!=0 ){
+    if(height_regions.getNumRegions()!=0 ){
+      reg = height_regions[0];
       if(reg->width()<1 || reg->width() > 6) {
         printf("WARNING: No Object Height Indicator Found in Image (for robot id=%d)!\n",idx);
-      } else if ( reg->next != 0) {
+      } else if ( height_regions.getNumRegions() > 1) {
         printf("WARNING: Multiple Height Indicators Found in Image (for robot id=%d)!\n",idx);
       } else {
         height = reg->height();
@@ -278,8 +280,7 @@ bool MultiPatternModel::loadSinglePatternImage(const yuvImage & image, YUVLUT *
   m.reset();
 
   for(unsigned int c=0; c<marker_color_ids.size(); c++) {
-    reg = colors->getRegionList(marker_color_ids[c]).getInitialElement();
-    while(reg != 0){
+    for(const CMVision::Region * reg : colors->getRegionList(marker_color_ids[c])){
       if (reg->width() > 3 && reg->height() > 3) {
         vector2f p(-reg->cen_y,-reg->cen_x);
         m.loc = p - cen;
@@ -289,7 +290,6 @@ bool MultiPatternModel::loadSinglePatternImage(const yuvImage & image, YUVLUT *
         m.angle = angle_pos(m.loc.angle());
         m.dist  = m.loc.length();
         markers.push_back(m);
-        reg = reg->next;
       }
     }
   }
@@ -384,7 +384,7 @@ void MultiPatternModel::recheckColorsUsed() {
   }
 }
 
-bool MultiPatternModel::findPattern(PatternDetectionResult & result, Marker * markers,int num_markers, const PatternFitParameters & fit_params,const CameraParameters& camera_params) const {
+bool MultiPatternModel::findPattern(PatternDetectionResult & result, Marker * markers,int num_markers, const PatternFitParameters & fit_params,const CameraCalibrationSnapshot& calibration) const {
   if(markers==0 || num_markers<0) return(false);
 
   int best_idx = -1;
@@ -429,7 +429,7 @@ bool MultiPatternModel::findPattern(PatternDetectionResult & result, Marker * ma
     for(int i=0; i<num_markers; i++){
       vector2d marker_img_center(markers[i].reg->cen_x,markers[i].reg->cen_y);
       vector3d marker_center3d;
-      camera_params.image2field(marker_center3d,marker_img_center,markers[i].height);
+      calibration.image2field(marker_center3d,marker_img_center,markers[i].height);
       markers[i].loc.set(marker_center3d.x,marker_center3d.y);
     }
 
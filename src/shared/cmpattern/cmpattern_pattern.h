@@ -190,7 +190,7 @@ public:
   bool usesColor(raw8 color_id) const;
   bool loadSinglePatternImage(const yuvImage & image, YUVLUT * _lut,int idx, float default_object_height=0.0);
   bool loadMultiPatternImage(const yuvImage & image, YUVLUT * _lut, int rows=4, int cols=4, float default_object_height=0.0);
-  bool findPattern(PatternDetectionResult & result, Marker * markers,int num_markers, const PatternFitParameters & fit_params,const CameraParameters& camera_params) const;
+  bool findPattern(PatternDetectionResult & result, Marker * markers,int num_markers, const PatternFitParameters & fit_params,const CameraCalibrationSnapshot& calibration) const;
   void recheckColorsUsed();//to be used if patterns have been enabled/disabled;
 };
 
@@ -62,8 +62,6 @@ TeamDetector::TeamDetector(LUT3D * lut3d, const CameraParameters& camera_params,
   _robotPattern=0;
   _lut3d=lut3d;
 
-  histogram=0;
-
   color_id_cyan = _lut3d->getChannelID("Cyan");
   if (color_id_cyan == -1) printf("WARNING color label 'Cyan' not defined in LUT!!!\n");
 
@@ -79,7 +77,8 @@ TeamDetector::TeamDetector(LUT3D * lut3d, const CameraParameters& camera_params,
   color_id_white = _lut3d->getChannelID("White");
   if (color_id_white == -1) printf("WARNING color label 'White' not defined in LUT!!!\n");  
 
-  color_id_clear = 0;
+  // -1 with a bitwise LUT, which has no clear channel
+  color_id_clear = _lut3d->getChannelID("<Clear>");
 
   color_id_green = _lut3d->getChannelID("Green");
   if (color_id_green == -1) printf("WARNING color label 'Green' not defined in LUT!!!\n");  
@@ -93,8 +92,6 @@ void TeamDetector::init(RobotPattern * robotPattern, Team * team)
   _robotPattern=robotPattern;
   _team = team;
 
-  if (histogram==0) histogram= new CMVision::Histogram(_lut3d->getChannelCount());
-
   //--------------THINGS THAT MIGHT CHANGE DURING RUNTIME BELOW:------------
   //update field:
   field_filter.update(_field);
@@ -175,18 +172,19 @@ void TeamDetector::init(RobotPattern * robotPattern, Team * team)
 
 TeamDetector::~TeamDetector()
 {
-  if (histogram !=0) delete histogram;
 }
 
-void TeamDetector::update(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, int team_color_id, int max_robots, const Image<raw8> * image, CMVision::ColorRegionList * colorlist, CMVision::RegionTree & reg_tree) {
+void TeamDetector::update(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, int team_color_id, int max_robots, CMVision::IntegralHistogram * histogram, int image_width, int image_height, CMVision::ColorRegionList * colorlist, CMVision::RegionTree & reg_tree) {
   color_id_team=team_color_id;
   _max_robots=max_robots;
+  _camera_params.getSnapshot(_calibration);
+  _grid=_camera_params.getImageToFieldGrid(_calibration,_robot_height,image_width,image_height);
   robots->Clear();
 
   if (_unique_patterns) {
-    findRobotsByModel(robots,team_color_id,image,colorlist,reg_tree);
+    findRobotsByModel(robots,team_color_id,histogram,colorlist,reg_tree);
   } else {
-    findRobotsByTeamMarkerOnly(robots,team_color_id,image,colorlist);
+    findRobotsByTeamMarkerOnly(robots,team_color_id,histogram,colorlist);
   }
 
 }
@@ -195,9 +193,9 @@ void TeamDetector::update(::google::protobuf::RepeatedPtrField< ::SSL_DetectionR
 
 
 
-void TeamDetector::findRobotsByTeamMarkerOnly(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, int team_color_id, const Image<raw8> * image, CMVision::ColorRegionList * colorlist)
+void TeamDetector::findRobotsByTeamMarkerOnly(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, int team_color_id, CMVision::IntegralHistogram * histogram, CMVision::ColorRegionList * colorlist)
 {
-  filter_team.init( colorlist->getRegionList(team_color_id).getInitialElement() );
+  filter_team.init( colorlist->getRegionList(team_color_id) );
 
   //TODO: change these to update on demand:
   //local variables
@@ -206,14 +204,14 @@ void TeamDetector::findRobotsByTeamMarkerOnly(::google::protobuf::RepeatedPtrFie
   while((reg = filter_team.getNext()) != 0) {
     vector2d reg_img_center(reg->cen_x,reg->cen_y);
     vector3d reg_center3d;
-    _camera_params.image2field(reg_center3d,reg_img_center,_robot_height);
+    _grid->image2field(reg_center3d,reg_img_center);
     vector2d reg_center(reg_center3d.x,reg_center3d.y);
 
     //TODO: add confidence masking:
     //float conf = det.mask.get(reg->cen_x,reg->cen_y);
     double conf=1.0;
-    if (field_filter.isInFieldOrPlayableBoundary(reg_center) &&  ((_histogram_enable==false) || checkHistogram(reg,image)==true)) {
-      double area = getRegionArea(reg,_robot_height);
+    if (field_filter.isInFieldOrPlayableBoundary(reg_center) &&  ((_histogram_enable==false) || checkHistogram(reg,histogram)==true)) {
+      double area = getRegionArea(reg);
       double area_err = fabs(area - _center_marker_area_mean);
 
       conf *= GaussianVsUniform(area_err, sq(_center_marker_area_stddev), _center_marker_uniform);
@@ -266,13 +264,13 @@ void TeamDetector::findRobotsByTeamMarkerOnly(::google::protobuf::RepeatedPtrFie
 
 
 
-double TeamDetector::getRegionArea(const CMVision::Region * reg, double z) const {
+double TeamDetector::getRegionArea(const CMVision::Region * reg) const {
   // calculate area of bounding box in sq mm
   vector3d a,b;
   vector2d right(reg->x2+1,reg->y2+1);
   vector2d left(reg->x1,reg->y1);
-  _camera_params.image2field(a,right,z);
-  _camera_params.image2field(b,left,z);
+  _grid->image2field(a,right);
+  _grid->image2field(b,left);
   vector3d box = a-b;
 
   double box_area = fabs(box.x) * fabs(box.y);
@@ -285,15 +283,13 @@ double TeamDetector::getRegionArea(const CMVision::Region * reg, double z) const
 }
 
 
-bool TeamDetector::checkHistogram(const CMVision::Region * reg, const Image<raw8> * image) {
+bool TeamDetector::checkHistogram(const CMVision::Region * reg, CMVision::IntegralHistogram * histogram) {
 
   if(_histogram_pixel_scan_radius == 0) return(true);
 
-  histogram->clear();
-
   int ix = (int)(reg->cen_x);
   int iy = (int)(reg->cen_y);
-  int num = histogram->addBox(image,ix-_histogram_pixel_scan_radius,iy-_histogram_pixel_scan_radius,
+  int num = histogram->addBox(ix-_histogram_pixel_scan_radius,iy-_histogram_pixel_scan_radius,
               ix+_histogram_pixel_scan_radius,iy+_histogram_pixel_scan_radius);
 
   float inv_num = 1.0 / num;
@@ -306,7 +302,7 @@ bool TeamDetector::checkHistogram(const CMVision::Region * reg, const Image<raw8
   float f_greenness = (float)histogram->getChannel(color_id_field_green) * inv_num;
 
   float f_black_white =
-    (float)(histogram->getChannel(color_id_white) + histogram->getChannel(color_id_black) + histogram->getChannel(color_id_clear)) * inv_num;
+    (float)(histogram->getChannel(color_id_white) + histogram->getChannel(color_id_black) + histogram->getClear()) * inv_num;
 
   /*
   if(unlikely(verbose > 0)){
@@ -413,10 +409,10 @@ void TeamDetector::stripRobots(::google::protobuf::RepeatedPtrField< ::SSL_Detec
 
 
 
-void TeamDetector::findRobotsByModel(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, int team_color_id, const Image<raw8> * image, CMVision::ColorRegionList * colorlist, CMVision::RegionTree & reg_tree)
+void TeamDetector::findRobotsByModel(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, int team_color_id, CMVision::IntegralHistogram * histogram, CMVision::ColorRegionList * colorlist, CMVision::RegionTree & reg_tree)
 {
 
-  (void)image;
+  (void)histogram;
   const int MaxDetections = _other_markers_max_detections;
   Marker cen; // center marker
   Marker *markers = new Marker[MaxDetections];
@@ -426,7 +422,7 @@ void TeamDetector::findRobotsByModel(::google::protobuf::RepeatedPtrField< ::SSL
   // partially forget old detections
   //decaySeen();
 
-  filter_team.init( colorlist->getRegionList(team_color_id).getInitialElement());
+  filter_team.init( colorlist->getRegionList(team_color_id));
   const CMVision::Region * reg=0;
   SSL_DetectionRobot * robot=0;
 
@@ -435,12 +431,12 @@ void TeamDetector::findRobotsByModel(::google::protobuf::RepeatedPtrField< ::SSL
   while((reg = filter_team.getNext()) != 0) {
     vector2d reg_img_center(reg->cen_x,reg->cen_y);
     vector3d reg_center3d;
-    _camera_params.image2field(reg_center3d,reg_img_center,_robot_height);
+    _grid->image2field(reg_center3d,reg_img_center);
     vector2d reg_center(reg_center3d.x,reg_center3d.y);
     //TODO add masking:
     //if(det.mask.get(reg->cen_x,reg->cen_y) >= 0.5){
     if (field_filter.isInFieldOrPlayableBoundary(reg_center)) {
-      cen.set(reg,reg_center3d,getRegionArea(reg,_robot_height));
+      cen.set(reg,reg_center3d,getRegionArea(reg));
       int num_markers = 0;
 
       reg_tree.startQuery(*reg,marker_max_query_dist);
@@ -453,10 +449,10 @@ void TeamDetector::findRobotsByModel(::google::protobuf::RepeatedPtrField< ::SSL
         if(filter_others.check(*mreg) && model.usesColor(mreg->color)) {
           vector2d marker_img_center(mreg->cen_x,mreg->cen_y);
           vector3d marker_center3d;
-          _camera_params.image2field(marker_center3d,marker_img_center,_robot_height);
+          _grid->image2field(marker_center3d,marker_img_center);
           Marker &m = markers[num_markers];
 
-          m.set(mreg,marker_center3d,getRegionArea(mreg,_robot_height));
+          m.set(mreg,marker_center3d,getRegionArea(mreg));
           vector2f ofs = m.loc - cen.loc;
           m.dist = ofs.length();
           m.angle = ofs.angle();
@@ -485,7 +481,7 @@ void TeamDetector::findRobotsByModel(::google::protobuf::RepeatedPtrField< ::SSL
           markers[i].next_angle_dist = angle_pos(angle_diff(markers[i].angle,markers[j].angle));
         }
 
-        if (model.findPattern(res,markers,num_markers,_pattern_fit_params,_camera_params)) {
+        if (model.findPattern(res,markers,num_markers,_pattern_fit_params,_calibration)) {
               robot=addRobot(robots,res.conf,_max_robots*2);
               if (robot!=0) {
                 //setup robot:
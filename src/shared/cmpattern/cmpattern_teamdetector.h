@@ -181,6 +181,10 @@ protected:
   int    _max_robots;
   double _robot_height;
 
+  //calibration and image to field lookup grid at robot height, fetched in update()
+  CameraCalibrationSnapshot _calibration;
+  std::shared_ptr<const ImageToFieldGrid> _grid;
+
   double _center_marker_area_mean;
   double _center_marker_area_stddev;
   double _center_marker_uniform;
@@ -211,8 +215,8 @@ protected:
   int color_id_team;
 
 protected:
-    double getRegionArea(const CMVision::Region * reg, double z) const;
-    bool checkHistogram(const CMVision::Region * reg, const Image<raw8> * image);
+    double getRegionArea(const CMVision::Region * reg) const;
+    bool checkHistogram(const CMVision::Region * reg, CMVision::IntegralHistogram * histogram);
 
     //returns a mutable pointer if the add was successful
     //returns 0 if there already are max_robots with higher confidence than conf
@@ -229,15 +233,18 @@ public:
     VarList * getSettings() {
       return 0;
     }
-    CMVision::Histogram * histogram;
-
     void init(RobotPattern * robotPattern, Team * team);
 
-    void findRobotsByModel(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, int team_color_id, const Image<raw8> * image, CMVision::ColorRegionList * colorlist, CMVision::RegionTree & reg_tree);
+    //whether update() reads the histogram tables of the color-labeled image
+    bool usesHistogram() const {
+      return !_unique_patterns && _histogram_enable && _histogram_pixel_scan_radius > 0;
+    }
+
+    void findRobotsByModel(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, int team_color_id, CMVision::IntegralHistogram * histogram, CMVision::ColorRegionList * colorlist, CMVision::RegionTree & reg_tree);
 
-    void findRobotsByTeamMarkerOnly(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, int team_color_id, const Image<raw8> * image, CMVision::ColorRegionList * colorlist);
+    void findRobotsByTeamMarkerOnly(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, int team_color_id, CMVision::IntegralHistogram * histogram, CMVision::ColorRegionList * colorlist);
 
-    void update(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, int team_color_id, int max_robots, const Image<raw8> * image, CMVision::ColorRegionList * colorlist, CMVision::RegionTree & reg_tree);
+    void update(::google::protobuf::RepeatedPtrField< ::SSL_DetectionRobot >* robots, int team_color_id, int max_robots, CMVision::IntegralHistogram * histogram, int image_width, int image_height, CMVision::ColorRegionList * colorlist, CMVision::RegionTree & reg_tree);
 };
 
 }
@@ -19,20 +19,25 @@
 */
 //========================================================================
 #include "cmvision_histogram.h"
+#include <algorithm>
+#include <string.h>
 
 namespace CMVision {
 
-Histogram::Histogram(int _max_channels)
+Histogram::Histogram(int _max_channels, LUTChannelMode _mode)
 {
   if (_max_channels < 1) _max_channels=1;
   max_channels=_max_channels;
+  mode=_mode;
   channels=new int[max_channels];
+  clear();
 }
 
 void Histogram::clear() {
   for (int i=0;i<max_channels;i++) {
     channels[i]=0;
   }
+  clear_pixels=0;
 }
 
 int Histogram::addBox(const Image<raw8> * image, int x1, int y1, int x2, int y2) {
@@ -45,9 +50,22 @@ int Histogram::addBox(const Image<raw8> * image, int x1, int y1, int x2, int y2)
   x2 = bound(x2,0,image_width-1);
   y2 = bound(y2,0,image_height-1);
 
-  for(int y=y1; y<=y2; y++){
-    for(int x=x1; x<=x2; x++){
-      channels[data[y*image_width+x].v]++;
+  if (mode==LUTChannelMode_Bitwise) {
+    for(int y=y1; y<=y2; y++){
+      for(int x=x1; x<=x2; x++){
+        unsigned int m = data[y*image_width+x].v;
+        if (m==0) clear_pixels++;
+        for (; m!=0; m&=m-1) {
+          int c=__builtin_ctz(m);
+          if (c < max_channels) channels[c]++;
+        }
+      }
+    }
+  } else {
+    for(int y=y1; y<=y2; y++){
+      for(int x=x1; x<=x2; x++){
+        channels[data[y*image_width+x].v]++;
+      }
     }
   }
 
@@ -55,9 +73,15 @@ int Histogram::addBox(const Image<raw8> * image, int x1, int y1, int x2, int y2)
 }
 
 int Histogram::getChannel(int channel) {
+  if (channel < 0 || channel >= max_channels) return 0;
   return channels[channel];
 }
 
+int Histogram::getClear() {
+  //in numeric mode channel 0 is the clear one
+  return (mode==LUTChannelMode_Bitwise) ? clear_pixels : channels[0];
+}
+
 void Histogram::setChannel(int channel, int value) {
   channels[channel]=value;
 }
@@ -67,5 +91,231 @@ Histogram::~Histogram()
   delete[] channels;
 }
 
-};
+IntegralHistogram::IntegralHistogram()
+{
+  max_channels=1;
+  mode=LUTChannelMode_Numeric;
+  image=0;
+  runs=0;
+  reset(0,0,1);
+}
+
+void IntegralHistogram::reset(int _width, int _height, int _max_channels) {
+  width=_width;
+  height=_height;
+  max_channels=(_max_channels < 1) ? 1 : _max_channels;
+  //one count for every label, so that numeric labels need no bounds check
+  box_channels.assign(std::max(max_channels+1,256),0);
+  requested.assign(max_channels+1,false);
+  num_requested=0;
+  table_index.assign(max_channels+1,-1);
+  table_channels=0;
+  counted_pixels=0;
+  addBox(0,0,-1,-1);
+}
+
+void IntegralHistogram::setImage(const Image<raw8> * _image, int _max_channels, LUTChannelMode _mode) {
+  image=_image;
+  runs=0;
+  mode=_mode;
+  reset(image->getWidth(),image->getHeight(),_max_channels);
+}
+
+void IntegralHistogram::setRuns(const RunList * _runs, int _width, int _height, int _max_channels) {
+  image=0;
+  runs=_runs;
+  mode=LUTChannelMode_Numeric;
+  reset(_width,_height,_max_channels);
+
+  //the first run of each row is looked up when it is needed
+  row_runs.assign(height+1,-1);
+}
+
+int IntegralHistogram::getFirstRun(int y) {
+  if (row_runs[y] < 0) {
+    const uint16_t * ys = runs->getYArray();
+    row_runs[y] = std::lower_bound(ys, ys + runs->getUsedRuns(), y) - ys;
+  }
+  return row_runs[y];
+}
+
+int IntegralHistogram::addBox(int x1, int y1, int x2, int y2) {
+  if (width > 0 && height > 0) {
+    x1 = bound(x1,0,width-1);
+    y1 = bound(y1,0,height-1);
+    x2 = bound(x2,0,width-1);
+    y2 = bound(y2,0,height-1);
+  }
+  box_x1=x1;
+  box_y1=y1;
+  box_x2=x2;
+  box_y2=y2;
+  box_counted=false;
+  return((x2 - x1 + 1) * (y2 - y1 + 1));
+}
+
+int IntegralHistogram::getChannel(int channel) {
+  if (channel < 0 || channel >= max_channels) return 0;
+  return count(channel);
+}
+
+int IntegralHistogram::getClear() {
+  //in numeric mode channel 0 is the clear one
+  return count(mode==LUTChannelMode_Bitwise ? max_channels : 0);
+}
+
+int IntegralHistogram::count(int index) {
+  if (box_x1 > box_x2 || box_y1 > box_y2) return 0;
+  int area = (box_x2 - box_x1 + 1) * (box_y2 - box_y1 + 1);
 
+  if (!requested[index]) {
+    requested[index]=true;
+    num_requested++;
+  }
+  //the table would overflow for larger boxes
+  if (area < 65536) {
+    //building the table of 8 channels costs about as much as counting twice the image
+    long table_cost = 2L * width * height * ((num_requested + 7) / 8);
+    if (table_index[index] < 0 && counted_pixels > table_cost) buildTable();
+    if (table_index[index] >= 0) {
+      int n = (table_channels + 7) & ~7;
+      int stride = (width + 1) * n;
+      const uint16_t * top = table.data() + box_y1 * stride + table_index[index];
+      const uint16_t * bottom = table.data() + (box_y2 + 1) * stride + table_index[index];
+      uint16_t sum = bottom[(box_x2 + 1) * n] - top[(box_x2 + 1) * n]
+                     - bottom[box_x1 * n] + top[box_x1 * n];
+      return sum;
+    }
+  }
+
+  if (!box_counted) countBox();
+  return box_channels[index];
+}
+
+void IntegralHistogram::countBox() {
+  std::fill(box_channels.begin(), box_channels.begin() + max_channels + 1, 0);
+  counted_pixels += (box_x2 - box_x1 + 1) * (box_y2 - box_y1 + 1);
+  box_counted=true;
+
+  if (image != 0) {
+    const raw8 * data = image->getPixelData();
+    if (mode==LUTChannelMode_Bitwise) {
+      for (int y=box_y1; y<=box_y2; y++) {
+        for (int x=box_x1; x<=box_x2; x++) {
+          unsigned int m = data[y*width+x].v;
+          if (m==0) box_channels[max_channels]++;
+          for (; m!=0; m&=m-1) {
+            int c=__builtin_ctz(m);
+            if (c < max_channels) box_channels[c]++;
+          }
+        }
+      }
+    } else {
+      for (int y=box_y1; y<=box_y2; y++) {
+        for (int x=box_x1; x<=box_x2; x++) {
+          box_channels[data[y*width+x].v]++;
+        }
+      }
+    }
+    return;
+  }
+
+  //numeric runs, sorted by row and within a row by x
+  const uint16_t * xs = runs->getXArray();
+  const uint16_t * widths = runs->getWidthArray();
+  const raw8 * colors = runs->getColorArray();
+  for (int y=box_y1; y<=box_y2; y++) {
+    int covered=0;
+    int begin = getFirstRun(y);
+    int end = getFirstRun(y+1);
+    int i = std::upper_bound(xs + begin, xs + end, box_x1) - xs;
+    if (i > begin) i--;
+    //very short runs make this more expensive than counting the pixels
+    counted_pixels += i - begin;
+    for (; i < end && xs[i] <= box_x2; i++) {
+      int overlap = std::min(xs[i] + widths[i] - 1, box_x2) - std::max((int)xs[i], box_x1) + 1;
+      counted_pixels++;
+      if (overlap <= 0) continue;
+      covered += overlap;
+      box_channels[colors[i].v] += overlap;
+    }
+    box_channels[0] += (box_x2 - box_x1 + 1) - covered;
+  }
+}
+
+void IntegralHistogram::buildTable() {
+  //the table holds all channels asked for so far
+  table_channels=0;
+  for (int i=0; i<=max_channels; i++) {
+    table_index[i] = requested[i] ? table_channels++ : -1;
+  }
+  counted_pixels=0;
+
+  //for each label, whether it counts for each channel of the table
+  int n = (table_channels + 7) & ~7;
+  std::vector<uint16_t> hits(256 * n);
+  for (int v=0; v<256; v++) {
+    for (int i=0; i<=max_channels; i++) {
+      if (table_index[i] < 0) continue;
+      bool hit;
+      if (i==max_channels) {
+        hit = (v==0);
+      } else if (mode==LUTChannelMode_Bitwise) {
+        hit = ((v >> i) & 1) != 0;
+      } else {
+        hit = (v==i);
+      }
+      hits[v * n + table_index[i]] = hit;
+    }
+  }
+
+  int stride = (width + 1) * n;
+  table.resize((size_t)stride * (height + 1));
+  uint16_t * t = table.data();
+  std::fill(t, t + stride, 0);
+
+  const uint16_t * xs = (runs != 0) ? runs->getXArray() : 0;
+  const uint16_t * widths = (runs != 0) ? runs->getWidthArray() : 0;
+  const raw8 * colors = (runs != 0) ? runs->getColorArray() : 0;
+  for (int y=0; y<height; y++) {
+    //groups of 8 channels, whose sums the compiler can keep in one vector register
+    for (int g=0; g<n; g+=8) {
+      const uint16_t * above = t + y * stride + n + g;
+      uint16_t * current = t + (y + 1) * stride + g;
+      uint16_t sums[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+      std::fill(current, current + 8, 0);
+      current += n;
+      //adds the pixels of the row from x to end with the given label
+      auto addPixels = [&](int & x, int end, int label) {
+        uint16_t hit[8];
+        memcpy(hit, hits.data() + label * n + g, sizeof(hit));
+        for (; x < end; x++) {
+          //the copies tell the compiler that the rows do not overlap
+          uint16_t sum[8];
+          memcpy(sum, above + x * n, sizeof(sum));
+          for (int k=0; k<8; k++) {
+            sums[k] += hit[k];
+            sum[k] += sums[k];
+          }
+          memcpy(current + x * n, sum, sizeof(sum));
+        }
+      };
+      int x=0;
+      if (image != 0) {
+        const raw8 * row = image->getPixelData() + y * width;
+        while (x < width) {
+          addPixels(x, x + 1, row[x].v);
+        }
+      } else {
+        int end = getFirstRun(y+1);
+        for (int i=getFirstRun(y); i<end; i++) {
+          addPixels(x, xs[i], 0);
+          addPixels(x, std::min(xs[i] + widths[i], width), colors[i].v);
+        }
+        addPixels(x, width, 0);
+      }
+    }
+  }
+}
+
+};
@@ -20,7 +20,11 @@
 //========================================================================
 #ifndef CMVISION_HISTOGRAM_H
 #define CMVISION_HISTOGRAM_H
+#include <stdint.h>
+#include <vector>
 #include "image.h"
+#include "lut3d.h"
+#include "cmvision_region.h"
 
 namespace CMVision {
 
@@ -28,18 +32,78 @@ class Histogram{
 protected:
     int * channels;
     int max_channels;
+    LUTChannelMode mode;
+    int clear_pixels;
 public:
-    Histogram(int _max_channels);
+    //with LUTChannelMode_Bitwise the labels are bitmasks, a pixel counts for each of its channels
+    Histogram(int _max_channels, LUTChannelMode _mode = LUTChannelMode_Numeric);
     ~Histogram();
 
     //will sample a rectangular bounding box of a color-labeled image and add it to the histogram
     //the return value is the area of the box.
     int addBox(const Image<raw8> * image, int x1, int y1, int x2, int y2);
+    //returns 0 for channels that do not exist (e.g. an id of -1)
     int getChannel(int channel);
+    //number of pixels without any channel
+    int getClear();
     void setChannel(int channel, int value);
     void clear();
 };
 
+//histogram checks of many boxes in the same color-labeled image. A box is
+//counted in a single pass, over the pixels or, for an image given as its runs,
+//over the runs in the box. Once counting the boxes has cost as much as building
+//a summed-area table of the channels asked for, the table is built, which
+//counts any box in four lookups.
+class IntegralHistogram{
+protected:
+    int max_channels;
+    LUTChannelMode mode;
+    int width;
+    int height;
+    const Image<raw8> * image;
+    const RunList * runs;
+    std::vector<int> row_runs;
+
+    //the box of the last addBox() and its counts. In bitwise mode, index
+    //max_channels holds the clear pixels.
+    int box_x1, box_y1, box_x2, box_y2;
+    bool box_counted;
+    std::vector<int> box_channels;
+
+    //channels asked for, and their position in the table (-1 if not in it)
+    std::vector<bool> requested;
+    int num_requested;
+    std::vector<int> table_index;
+    long counted_pixels;
+    //sums of the channels of the table for each pixel, interleaved. They wrap
+    //around, which still gives exact counts for boxes below 65536 pixels.
+    std::vector<uint16_t> table;
+    int table_channels;
+
+    int getFirstRun(int y);
+    int count(int index);
+    void countBox();
+    void buildTable();
+    void reset(int _width, int _height, int _max_channels);
+public:
+    IntegralHistogram();
+
+    //starts over with a new image, the table is dropped
+    void setImage(const Image<raw8> * _image, int _max_channels, LUTChannelMode _mode = LUTChannelMode_Numeric);
+    //starts over with the numeric labels of an image given as its complete run-length
+    //encoding, sorted by row. Pixels that are not covered by a run are clear.
+    void setRuns(const RunList * _runs, int _width, int _height, int _max_channels);
+
+    //selects the box the following calls count in, clamped to the image like
+    //Histogram::addBox(). The return value is the area of the box.
+    int addBox(int x1, int y1, int x2, int y2);
+    //returns 0 for channels that do not exist (e.g. an id of -1)
+    int getChannel(int channel);
+    //number of pixels without any channel
+    int getClear();
+};
+
 }
 
 #endif
@@ -21,9 +21,342 @@
 */
 //========================================================================
 #include "cmvision_region.h"
+#include "convex_hull_image_mask.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CMV_REGION_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// The run finders return the end of the run that starts at x, i.e. the
+// first index after x whose label differs from row[x], or width.
+// The vector versions compare 16, 32 or 64 labels at once and jump to the
+// first difference with a bit scan, which pays off as most runs (clear
+// and field green) are long.
+
+int findRunEndScalar(const uint8_t * row, int x, int width) {
+  uint8_t m = row[x];
+  //fix by Stefan: stop if x==row-width
+  //(and don't access the row array in that case as it could cause a segfault)
+  //Note that the left argument of the && operator is always evaluated first and as
+  //such this expression should be safe.
+  while(x != width && row[x] == m) x++;
+  return x;
+}
+
+#ifdef CMV_REGION_X86_DISPATCH
+
+__attribute__((target("sse2")))
+int findRunEndSSE2(const uint8_t * row, int x, int width) {
+  const __m128i m = _mm_set1_epi8((char)row[x]);
+  x++;
+  for (; x + 16 <= width; x += 16) {
+    unsigned int diff = 0xFFFFu & ~(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(row + x)), m));
+    if (diff != 0) return x + __builtin_ctz(diff);
+  }
+  return findRunEndScalar(row, x - 1, width);
+}
+
+__attribute__((target("avx2")))
+int findRunEndAVX2(const uint8_t * row, int x, int width) {
+  const __m256i m = _mm256_set1_epi8((char)row[x]);
+  x++;
+  for (; x + 32 <= width; x += 32) {
+    unsigned int diff = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(row + x)), m));
+    if (diff != 0) return x + __builtin_ctz(diff);
+  }
+  return findRunEndScalar(row, x - 1, width);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+int findRunEndAVX512(const uint8_t * row, int x, int width) {
+  const __m512i m = _mm512_set1_epi8((char)row[x]);
+  x++;
+  for (; x + 64 <= width; x += 64) {
+    __mmask64 diff = _mm512_cmpneq_epi8_mask(_mm512_loadu_si512((const void *)(row + x)), m);
+    if (diff != 0) return x + __builtin_ctzll(diff);
+  }
+  if (x < width) {
+    // a masked load does not touch the bytes beyond the row
+    __mmask64 valid = (1ULL << (width - x)) - 1;
+    __mmask64 diff = _mm512_mask_cmpneq_epi8_mask(valid, _mm512_maskz_loadu_epi8(valid, row + x), m);
+    if (diff != 0) return x + __builtin_ctzll(diff);
+  }
+  return width;
+}
+
+#endif
+
+// The bitplane run finders do the same for a single channel of a bitwise
+// labeled row: they return the first index after x at which the channel
+// bit differs from the one of row[x], or width.
+
+int findPlaneRunEndScalar(const uint8_t * row, int x, int width, uint8_t bit) {
+  uint8_t m = row[x] & bit;
+  while(x != width && (row[x] & bit) == m) x++;
+  return x;
+}
+
+#ifdef CMV_REGION_X86_DISPATCH
+
+__attribute__((target("sse2")))
+int findPlaneRunEndSSE2(const uint8_t * row, int x, int width, uint8_t bit) {
+  const __m128i b = _mm_set1_epi8((char)bit);
+  const __m128i m = _mm_set1_epi8((char)(row[x] & bit));
+  x++;
+  for (; x + 16 <= width; x += 16) {
+    __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *)(row + x)), b);
+    unsigned int diff = 0xFFFFu & ~(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, m));
+    if (diff != 0) return x + __builtin_ctz(diff);
+  }
+  return findPlaneRunEndScalar(row, x - 1, width, bit);
+}
+
+__attribute__((target("avx2")))
+int findPlaneRunEndAVX2(const uint8_t * row, int x, int width, uint8_t bit) {
+  const __m256i b = _mm256_set1_epi8((char)bit);
+  const __m256i m = _mm256_set1_epi8((char)(row[x] & bit));
+  x++;
+  for (; x + 32 <= width; x += 32) {
+    __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(row + x)), b);
+    unsigned int diff = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, m));
+    if (diff != 0) return x + __builtin_ctz(diff);
+  }
+  return findPlaneRunEndScalar(row, x - 1, width, bit);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+int findPlaneRunEndAVX512(const uint8_t * row, int x, int width, uint8_t bit) {
+  const __m512i b = _mm512_set1_epi8((char)bit);
+  // a set bit ends at the first pixel without it and vice versa
+  const bool set = (row[x] & bit) != 0;
+  x++;
+  for (; x + 64 <= width; x += 64) {
+    __mmask64 has = _mm512_test_epi8_mask(_mm512_loadu_si512((const void *)(row + x)), b);
+    __mmask64 diff = set ? ~has : has;
+    if (diff != 0) return x + __builtin_ctzll(diff);
+  }
+  if (x < width) {
+    __mmask64 valid = (1ULL << (width - x)) - 1;
+    __mmask64 has = _mm512_mask_test_epi8_mask(valid, _mm512_maskz_loadu_epi8(valid, row + x), b);
+    __mmask64 diff = (set ? ~has : has) & valid;
+    if (diff != 0) return x + __builtin_ctzll(diff);
+  }
+  return width;
+}
+
+#endif
+
+// Where the encoders store their runs: the arrays of a RunList, or an
+// array of Run for the row buffers of thresholdAndEncodeRows().
+class RunArrays {
+public:
+  uint16_t * x;
+  uint16_t * y;
+  uint16_t * width;
+  raw8 * color;
+  int * parent;
+  int * next;
+  explicit RunArrays(CMVision::RunList * runlist) :
+    x(runlist->getXArray()), y(runlist->getYArray()), width(runlist->getWidthArray()),
+    color(runlist->getColorArray()), parent(runlist->getParentArray()), next(runlist->getNextArray()) {}
+  inline void store(int j, int _x, int _y, int _width, raw8 _color) {
+    x[j] = (uint16_t)_x;
+    y[j] = (uint16_t)_y;
+    width[j] = (uint16_t)_width;
+    color[j] = _color;
+    parent[j] = j;
+    next[j] = 0;
+  }
+};
+
+class RunStructs {
+public:
+  CMVision::Run * runs;
+  explicit RunStructs(CMVision::Run * _runs) : runs(_runs) {}
+  inline void store(int j, int _x, int _y, int _width, raw8 _color) {
+    CMVision::Run & r = runs[j];
+    r.x = _x;
+    r.y = _y;
+    r.width = _width;
+    r.color = _color;
+    r.parent = j;
+    r.next = 0;
+  }
+};
+
+template <int (*findRunEnd)(const uint8_t *, int, int), class RunOutput>
+int encodeRowWith(const raw8 * row, int width, int begin, int end, int y, RunOutput runs, int j, int max_runs) {
+  raw8 clear(0);
+  raw8 m;
+  int x,l;
+
+  // start of the clear stretch that reaches the end of the row, if any;
+  // everything outside of [begin,end) is clear
+  int clear_start = 0;
+
+  x = begin;
+  while(x < end){
+    m = row[x];
+    l = x;
+    x = findRunEnd((const uint8_t *)row, x, end);
+
+    if(m != clear) {
+      runs.store(j++, l, y, x - l, m);
+
+      if(j >= max_runs || x == width){
+        return j;
+      }
+      clear_start = x;
+    }
+  }
+
+  // the last run of a row is always stored, even if it is clear
+  runs.store(j++, clear_start, y, width - clear_start, clear);
+  return j;
+}
+
+template <class RunOutput>
+int encodeRowDispatch(const raw8 * row, int width, int begin, int end, int y, RunOutput runs, int j, int max_runs) {
+#ifdef CMV_REGION_X86_DISPATCH
+  switch (CMVisionThreshold::getInstructionSet()) {
+    case CMVisionThreshold::ISA_AVX512:
+      return encodeRowWith<findRunEndAVX512>(row, width, begin, end, y, runs, j, max_runs);
+    case CMVisionThreshold::ISA_AVX2:
+      return encodeRowWith<findRunEndAVX2>(row, width, begin, end, y, runs, j, max_runs);
+    case CMVisionThreshold::ISA_SSE41:
+      return encodeRowWith<findRunEndSSE2>(row, width, begin, end, y, runs, j, max_runs);
+    default:
+      break;
+  }
+#endif
+  return encodeRowWith<findRunEndScalar>(row, width, begin, end, y, runs, j, max_runs);
+}
+
+// Same as encodeRowWith() for the plane of one channel bit of a bitwise
+// labeled row. The runs of the channel get the bit as their color.
+template <int (*findPlaneRunEnd)(const uint8_t *, int, int, uint8_t)>
+int encodePlaneRowWith(const raw8 * row, int width, int begin, int end, int y, uint8_t bit,
+                       RunArrays runs, int j, int max_runs) {
+  int x,l;
+
+  int clear_start = 0;
+
+  x = begin;
+  while(x < end){
+    bool set = (row[x].v & bit) != 0;
+    l = x;
+    x = findPlaneRunEnd((const uint8_t *)row, x, end, bit);
+
+    if(set) {
+      runs.store(j++, l, y, x - l, raw8(bit));
+
+      if(j >= max_runs || x == width){
+        return j;
+      }
+      clear_start = x;
+    }
+  }
+
+  runs.store(j++, clear_start, y, width - clear_start, raw8(0));
+  return j;
+}
+
+int encodePlaneRow(const raw8 * row, int width, int begin, int end, int y, uint8_t bit,
+                   RunArrays runs, int j, int max_runs) {
+#ifdef CMV_REGION_X86_DISPATCH
+  switch (CMVisionThreshold::getInstructionSet()) {
+    case CMVisionThreshold::ISA_AVX512:
+      return encodePlaneRowWith<findPlaneRunEndAVX512>(row, width, begin, end, y, bit, runs, j, max_runs);
+    case CMVisionThreshold::ISA_AVX2:
+      return encodePlaneRowWith<findPlaneRunEndAVX2>(row, width, begin, end, y, bit, runs, j, max_runs);
+    case CMVisionThreshold::ISA_SSE41:
+      return encodePlaneRowWith<findPlaneRunEndSSE2>(row, width, begin, end, y, bit, runs, j, max_runs);
+    default:
+      break;
+  }
+#endif
+  return encodePlaneRowWith<findPlaneRunEndScalar>(row, width, begin, end, y, bit, runs, j, max_runs);
+}
+
+// the 16 bit coordinates of a RunList can not hold larger images
+bool fitsRunList(int width, int height) {
+  if(width <= CMVision::RunList::max_coordinate && height <= CMVision::RunList::max_coordinate) return true;
+  printf("Error: a %dx%d image is too large to be run length encoded (max %d pixels per side)\n",
+         width, height, CMVision::RunList::max_coordinate);
+  return false;
+}
+
+}
 
 namespace CMVision {
 
+ListCapacity::ListCapacity(int initial_capacity, int _limit) :
+  capacity(std::min(initial_capacity, _limit)), limit(_limit), last_used(0), high_water(0),
+  frames(0), overflows(0), grows(0)
+{
+}
+
+void ListCapacity::setLimit(int _limit)
+{
+  limit = _limit;
+  if (capacity > _limit) capacity = _limit;
+}
+
+bool ListCapacity::record(int used, bool truncated)
+// Grows the capacity by doubling, so that a stack reaches the size it
+// needs after a few frames and the lists are reallocated O(log n) times.
+{
+  frames++;
+  last_used = used;
+  if (used > high_water) high_water = used;
+  if (truncated) overflows++;
+
+  int current = capacity;
+  // keep a quarter of headroom above the high-water mark
+  if (!truncated && high_water < current - current / 4) return false;
+  int grown = (int)std::min(2LL * current, (long long)limit.load());
+  if (grown <= current) return false;
+  capacity = grown;
+  grows++;
+  return true;
+}
+
+ListArena::ListArena(int initial_runs, int initial_regions, int run_limit, int region_limit) :
+  runs(initial_runs, run_limit), regions(initial_regions, region_limit)
+{
+}
+
+// at the limit every frame may overflow, so only the 1st, 2nd, 4th, 8th... overflow is logged
+static void reportUsage(const ListCapacity & list, bool grown, bool truncated, const char * name)
+{
+  if (grown) {
+    printf("%s list capacity grown to %d (peak %d)\n", name, list.getCapacity(), list.getHighWater());
+  } else if (truncated && (list.getOverflows() & (list.getOverflows() - 1)) == 0) {
+    printf("Warning: %s list is at its capacity limit of %d, %ld of %ld frames were truncated\n",
+           name, list.getLimit(), list.getOverflows(), list.getFrames());
+  }
+}
+
+void ListArena::record(RunList * list)
+{
+  bool truncated = list->getUsedRuns() >= list->getMaxRuns();
+  bool grown = runs.record(list->getUsedRuns(), truncated);
+  reportUsage(runs, grown, truncated, "Run");
+}
+
+void ListArena::record(RegionList * list)
+{
+  bool truncated = list->getUsedRegions() >= list->getMaxRegions();
+  bool grown = regions.record(list->getUsedRegions(), truncated);
+  reportUsage(regions, grown, truncated, "Region");
+}
+
 RegionProcessing::RegionProcessing()
 {
 }
@@ -34,63 +367,155 @@ RegionProcessing::~RegionProcessing()
 }
 
 
-void RegionProcessing::encodeRuns(Image<raw8> * tmap, CMVision::RunList * runlist)
+int RegionProcessing::encodeRow(const raw8 * row, int width, int y, CMVision::Run * runs, int j, int max_runs)
+// Appends the runs of one row of the thresholded image at runs[j] and
+// returns the new number of runs. Stops once max_runs is reached.
+{
+  return encodeRow(row, width, 0, width, y, runs, j, max_runs);
+}
+
+int RegionProcessing::encodeRow(const raw8 * row, int width, int begin, int end, int y, CMVision::Run * runs, int j, int max_runs)
+// Same as above for a row whose labels outside of [begin,end) are all
+// clear. Those are never read, the runs are the same as for the full row.
+{
+  return encodeRowDispatch(row, width, begin, end, y, RunStructs(runs), j, max_runs);
+}
+
+void RegionProcessing::encodeRuns(Image<raw8> * tmap, CMVision::RunList * runlist, const MaskSpan * spans)
 // Changes the flat array version of the thresholded image into a run
 // length encoded version, which speeds up later processing since we
 // only have to look at the points where values change.
 {
 
   int max_runs = runlist->getMaxRuns();
-  CMVision::Run * runs = runlist->getRunArrayPointer();
+  RunArrays runs(runlist);
   raw8 * map = tmap->getPixelData();
   int width=tmap->getWidth();
   int height=tmap->getHeight();
 
-
-  raw8 clear(0);
-  raw8 m;
-  raw8 *row;
-  int x,y,j,l;
-  CMVision::Run r;
-
-  r.next = 0;
+  int y,j;
 
   j = 0;
+  runlist->setUsedRuns(0);
+  if(!fitsRunList(width, height)) return;
   for(y=0; y<height; y++){
-    row = &map[y * width];
-
-    r.y = y;
-
-    x = 0;
-    while(x < width){
-      m = row[x];
-      r.x = x;
-
-      l = x;
+    if(spans != nullptr){
+      j = encodeRowDispatch(&map[y * width], width, spans[y].begin, spans[y].end, y, runs, j, max_runs);
+    }else{
+      j = encodeRowDispatch(&map[y * width], width, 0, width, y, runs, j, max_runs);
+    }
+    if(j >= max_runs) break;
+  }
 
-      //fix by Stefan: stop if x==row-width
-      //(and don't access the row array in that case as it could cause a segfault)
-      //Note that the left argument of the && operator is always evaluated first and as
-      //such this expression should be safe.
-      while(x != width && row[x] == m) x++;
+  runlist->setUsedRuns(j);
+}
 
-      if(m != clear || x==width) {
-        r.color = m;
-        r.width = x - l;
-        r.parent = j;
-        runs[j++] = r;
+void RegionProcessing::encodeBitplanes(Image<raw8> * tmap, CMVision::RunList * runlist, int num_channels, const MaskSpan * spans)
+// Run length encodes an image labeled with a bitwise LUT, where a pixel
+// can belong to several channels. Every channel bit is encoded as a
+// plane of its own: the runs of channel 0 for all rows come first, then
+// the ones of channel 1 and so on. Each plane is a complete encoding of
+// the image as encodeRuns() would produce it for a single color.
+{
+  int max_runs = runlist->getMaxRuns();
+  RunArrays runs(runlist);
+  raw8 * map = tmap->getPixelData();
+  int width=tmap->getWidth();
+  int height=tmap->getHeight();
+  runlist->setUsedRuns(0);
+  if(!fitsRunList(width, height)) return;
+  if(num_channels > (int)LUT_MAX_BITWISE_CHANNELS) num_channels = LUT_MAX_BITWISE_CHANNELS;
+
+  // the channels present in each row; rows without a channel become a
+  // single clear run of its plane without being scanned again
+  static thread_local std::vector<uint8_t> row_bits;
+  row_bits.resize(height);
+  for(int y=0; y<height; y++){
+    int begin = spans != nullptr ? spans[y].begin : 0;
+    int end = spans != nullptr ? spans[y].end : width;
+    const uint8_t * row = (const uint8_t *)&map[y * width];
+    uint64_t word_bits = 0;
+    int x = begin;
+    for(; x + 8 <= end; x += 8){
+      uint64_t word;
+      memcpy(&word, row + x, 8);
+      word_bits |= word;
+    }
+    for(int shift=32; shift>=8; shift/=2) word_bits |= word_bits >> shift;
+    uint8_t bits = (uint8_t)word_bits;
+    for(; x<end; x++) bits |= row[x];
+    row_bits[y] = bits;
+  }
 
-        if(j >= max_runs){
-          runlist->setUsedRuns(j);
-          return;
-        }
+  int j = 0;
+  for(int c=0; c<num_channels && j<max_runs; c++){
+    uint8_t bit = (uint8_t)(1 << c);
+    for(int y=0; y<height; y++){
+      if((row_bits[y] & bit) == 0){
+        runs.store(j++, 0, y, width, raw8(0));
+      }else if(spans != nullptr){
+        j = encodePlaneRow(&map[y * width], width, spans[y].begin, spans[y].end, y, bit, runs, j, max_runs);
+      }else{
+        j = encodePlaneRow(&map[y * width], width, 0, width, y, bit, runs, j, max_runs);
       }
+      if(j >= max_runs) break;
     }
   }
 
   runlist->setUsedRuns(j);
 }
 
+bool RegionProcessing::thresholdAndEncodeRows(const RawImage * source, const LUTReadGuard & table, const ImageInterface * mask,
+                                              const MaskSpan * spans, int first_row, int end_row,
+                                              std::vector<CMVision::Run> & runs, int & used_runs, int max_runs)
+// Thresholds one row at a time into a small buffer that stays in the
+// cache and encodes it right away, instead of writing and rereading a
+// full thresholded image. With spans, only the pixels inside the span
+// of each row are looked at.
+{
+  static thread_local std::vector<raw8> row;
+
+  int width = source->getWidth();
+  int bytes_per_row = source->getNumBytes() / source->getHeight();
+  row.resize(width);
+
+  used_runs = 0;
+  if(!fitsRunList(width, source->getHeight())) return false;
+  for(int y=first_row; y<end_row; y++){
+    int begin = spans != nullptr ? spans[y].begin : 0;
+    int end = spans != nullptr ? spans[y].end : width;
+    if(!CMVisionThreshold::thresholdRow(source->getColorFormat(), (uint8_t *)row.data(),
+                                        source->getData() + (long)y * bytes_per_row, table,
+                                        mask->getData() + (long)y * width, width, begin, end)) {
+      return false;
+    }
+    // a row has at most width runs
+    if((int)runs.size() < used_runs + width) runs.resize(used_runs + width);
+    used_runs = encodeRow(row.data(), width, begin, end, y, runs.data(), used_runs, max_runs);
+    if(used_runs >= max_runs) return false;
+  }
+  return true;
+}
+
+void RegionProcessing::decodeRuns(CMVision::RunList * runlist, Image<raw8> * tmap)
+// Restores the thresholded image from a complete run length encoding.
+// Pixels that are not covered by a run are clear.
+{
+  const uint16_t * xs = runlist->getXArray();
+  const uint16_t * ys = runlist->getYArray();
+  const uint16_t * widths = runlist->getWidthArray();
+  const raw8 * colors = runlist->getColorArray();
+  int used_runs = runlist->getUsedRuns();
+  raw8 * map = tmap->getPixelData();
+  int width=tmap->getWidth();
+
+  memset((void *)map, 0, tmap->getNumBytes());
+  for(int i=0; i<used_runs; i++){
+    if(colors[i].v != 0) {
+      memset((void *)&map[ys[i] * width + xs[i]], colors[i].v, widths[i]);
+    }
+  }
+}
 
 
 
@@ -106,75 +531,218 @@ void RegionProcessing::connectComponents(CMVision::RunList * runlist)
 //   Read the papers on this library and have a good understanding of
 //   tree-based union find before you touch it
 {
-
-  CMVision::Run * map=runlist->getRunArrayPointer();
   int num = runlist->getUsedRuns();
+  if(num > 0) connectBand(runlist, 0, num);
+}
+
+
+
+void RegionProcessing::connectBand(CMVision::RunList * runlist, int begin, int end)
+// The algorithm of connectComponents() restricted to the runs
+// [begin,end), which have to be complete rows. All parents stay
+// within the band, so bands can be processed concurrently.
+// Only the start, end, color and parent of the runs are read in the
+// scan, each from an array of its own.
+{
+  const uint16_t * xs = runlist->getXArray();
+  const uint16_t * ys = runlist->getYArray();
+  const uint16_t * widths = runlist->getWidthArray();
+  const raw8 * colors = runlist->getColorArray();
+  int * parent = runlist->getParentArray();
   int l1,l2;
-  CMVision::Run r1,r2;
   int i,j,s;
+  // the runs at l1 and l2: start, end (exclusive), color and parent
+  int x1,e1,p1,x2,e2,p2;
+  raw8 c1,c2;
 
   // l2 starts on first scan line, l1 starts on second
-  l2 = 0;
-  l1 = 1;
-  while(map[l1].y == 0) l1++; // skip first line
+  l2 = begin;
+  l1 = begin;
+  while(l1 < end && ys[l1] == ys[begin]) l1++; // skip first line
+  if(l1 >= end) return;
 
   // Do rest in lock step
-  r1 = map[l1];
-  r2 = map[l2];
+  x1 = xs[l1]; e1 = x1 + widths[l1]; c1 = colors[l1]; p1 = parent[l1];
+  x2 = xs[l2]; e2 = x2 + widths[l2]; c2 = colors[l2]; p2 = parent[l2];
   s = l1;
-  while(l1 < num){
-    /*
-    printf("%6d:(%3d,%3d,%3d) %6d:(%3d,%3d,%3d)\n",
-	   l1,r1.x,r1.y,r1.width,
-	   l2,r2.x,r2.y,r2.width);
-    */
-
-    if(r1.color==r2.color && r1.color.v!=0) {
-      // case 1: r2.x <= r1.x < r2.x + r2.width
-      // case 2: r1.x <= r2.x < r1.x + r1.width
-      if((r2.x<=r1.x && r1.x<r2.x+r2.width) ||
-        (r1.x<=r2.x && r2.x<r1.x+r1.width)){
+  while(l1 < end){
+    if(c1==c2 && c1.v!=0) {
+      // case 1: x2 <= x1 < e2
+      // case 2: x1 <= x2 < e1
+      if((x2<=x1 && x1<e2) || (x1<=x2 && x2<e1)){
         if(s != l1){
           // if we didn't have a parent already, just take this one
-          map[l1].parent = r1.parent = r2.parent;
+          parent[l1] = p1 = p2;
           s = l1;
-        }else if(r1.parent != r2.parent){
+        }else if(p1 != p2){
           // otherwise union two parents if they are different
 
           // find terminal roots of each path up tree
-          i = r1.parent;
-          while(i != map[i].parent) i = map[i].parent;
-          j = r2.parent;
-          while(j != map[j].parent) j = map[j].parent;
+          i = p1;
+          while(i != parent[i]) i = parent[i];
+          j = p2;
+          while(j != parent[j]) j = parent[j];
 
           // union and compress paths; use smaller of two possible
           // representative indicies to preserve DAG property
           if(i < j){
-            map[j].parent = i;
-            map[l1].parent = map[l2].parent = r1.parent = r2.parent = i;
+            parent[j] = i;
+            parent[l1] = parent[l2] = p1 = p2 = i;
           }else{
-            map[i].parent = j;
-            map[l1].parent = map[l2].parent = r1.parent = r2.parent = j;
+            parent[i] = j;
+            parent[l1] = parent[l2] = p1 = p2 = j;
           }
         }
       }
     }
 
-    // Move to next point where values may change
-    i = (r2.x + r2.width) - (r1.x + r1.width);
-    if(i >= 0) r1 = map[++l1];
-    if(i <= 0) r2 = map[++l2];
+    // Move to next point where values may change; never read beyond the band
+    i = e2 - e1;
+    if(i >= 0 && ++l1 < end){
+      x1 = xs[l1]; e1 = x1 + widths[l1]; c1 = colors[l1]; p1 = parent[l1];
+    }
+    if(i <= 0){
+      ++l2;
+      x2 = xs[l2]; e2 = x2 + widths[l2]; c2 = colors[l2]; p2 = parent[l2];
+    }
   }
 
   // Now we need to compress all parent paths
-  for(i=0; i<num; i++){
-    j = map[i].parent;
-    map[i].parent = map[j].parent;
+  for(i=begin; i<end; i++){
+    j = parent[i];
+    parent[i] = parent[j];
   }
 }
 
+void RegionProcessing::connectComponents(CMVision::RunList * runlist, WorkerPool * pool)
+// Parallel version of connectComponents(): labels horizontal bands
+// independently, then joins the labels across the seams between them.
+// Like the serial version it leaves every run pointing to the lowest
+// run index of its region, so the results are identical.
+{
+  const uint16_t * xs = runlist->getXArray();
+  const uint16_t * ys = runlist->getYArray();
+  const uint16_t * widths = runlist->getWidthArray();
+  const raw8 * colors = runlist->getColorArray();
+  int * parent = runlist->getParentArray();
+  int num = runlist->getUsedRuns();
+  if(pool == nullptr || pool->getNumWorkers() == 0 || num == 0) {
+    if(num > 0) connectComponents(runlist);
+    return;
+  }
+
+  // split at row boundaries, a few bands per thread
+  const int max_bands = 64;
+  int first_row = ys[0];
+  int rows = ys[num - 1] - first_row + 1;
+  int num_bands = std::min(std::min(max_bands, 4 * (pool->getNumWorkers() + 1)), rows);
+  int starts[max_bands + 1];
+  for(int b=0; b<num_bands; b++){
+    int y = first_row + (int)((long)rows * b / num_bands);
+    starts[b] = std::lower_bound(ys, ys + num, y) - ys;
+  }
+  starts[num_bands] = num;
+
+  pool->run(num_bands, [&](int b) {
+    connectBand(runlist, starts[b], starts[b + 1]);
+  });
+
+  // Join the bands along their seams. After connectBand() every run
+  // points to the root of its band, so find takes a single step inside
+  // a band. Roots are only linked to smaller roots, as in the serial version.
+  int i,j,l1,l2,e1,e2,d;
+  for(int b=1; b<num_bands; b++){
+    l1 = starts[b];
+    e1 = l1;
+    while(e1 < num && ys[e1] == ys[l1]) e1++;
+    l2 = l1 - 1;
+    while(l2 > 0 && ys[l2 - 1] == ys[l1 - 1]) l2--;
+    e2 = starts[b];
+
+    while(l1 < e1 && l2 < e2){
+      int x1 = xs[l1], end1 = x1 + widths[l1];
+      int x2 = xs[l2], end2 = x2 + widths[l2];
+      if(colors[l1]==colors[l2] && colors[l1].v!=0 &&
+         ((x2<=x1 && x1<end2) || (x1<=x2 && x2<end1))){
+        i = parent[l1];
+        while(i != parent[i]) i = parent[i];
+        j = parent[l2];
+        while(j != parent[j]) j = parent[j];
+        if(i < j){
+          parent[j] = i;
+        }else if(j < i){
+          parent[i] = j;
+        }
+      }
+      d = end2 - end1;
+      if(d >= 0) l1++;
+      if(d <= 0) l2++;
+    }
+  }
+
+  // Point every root that got linked to its final root. Such a root is
+  // always the band root of a run on one of the seams.
+  for(int b=1; b<num_bands; b++){
+    l2 = starts[b] - 1;
+    while(l2 > 0 && ys[l2 - 1] == ys[starts[b] - 1]) l2--;
+    e1 = starts[b];
+    while(e1 < num && ys[e1] == ys[starts[b]]) e1++;
+    for(int k=l2; k<e1; k++){
+      j = k;
+      while(j != parent[j]) j = parent[j];
+      i = k;
+      while(i != j){
+        d = parent[i];
+        parent[i] = j;
+        i = d;
+      }
+    }
+  }
+
+  // Now every run is one step away from its final root. Roots are not
+  // written here, so bands can read each other's roots safely.
+  pool->run(num_bands, [&](int b) {
+    for(int k=starts[b]; k<starts[b + 1]; k++){
+      int p = parent[k];
+      int root = parent[p];
+      if(root != p) parent[k] = root;
+    }
+  });
+}
+
 
 
+void RegionProcessing::connectBitplanes(CMVision::RunList * runlist, WorkerPool * pool)
+// Connects the components of a list written by encodeBitplanes(). Runs
+// of different channels never connect, so every plane is labeled on
+// its own, concurrently if a pool is given. The parents are the same
+// as connectComponents() gives for each plane.
+{
+  const uint16_t * ys = runlist->getYArray();
+  int num = runlist->getUsedRuns();
+  if(num == 0) return;
+
+  // a plane starts where the rows start over
+  static thread_local std::vector<int> starts;
+  starts.clear();
+  starts.push_back(0);
+  for(int i=1; i<num; i++){
+    if(ys[i] < ys[i - 1]) starts.push_back(i);
+  }
+  starts.push_back(num);
+  int num_planes = (int)starts.size() - 1;
+
+  if(pool == nullptr || pool->getNumWorkers() == 0){
+    for(int p=0; p<num_planes; p++) connectBand(runlist, starts[p], starts[p + 1]);
+  }else{
+    // the workers have their own thread_local copies, so hand them ours
+    const int * plane = starts.data();
+    pool->run(num_planes, [&](int p) {
+      connectBand(runlist, plane[p], plane[p + 1]);
+    });
+  }
+}
+
 void RegionProcessing::extractRegions(CMVision::RegionList * reglist, CMVision::RunList * runlist)
 // Takes the list of runs and formats them into a region table,
 // gathering the various statistics along the way.  num is the number
@@ -183,28 +751,35 @@ void RegionProcessing::extractRegions(CMVision::RegionList * reglist, CMVision::
 // pass over the array of runs.
 {
   int b,i,n,a;
-  CMVision::Run r;
+  int x,y,w;
   CMVision::Region * reg = reglist->getRegionArrayPointer();
-  CMVision::Run * rmap = runlist->getRunArrayPointer();
+  const uint16_t * xs = runlist->getXArray();
+  const uint16_t * ys = runlist->getYArray();
+  const uint16_t * widths = runlist->getWidthArray();
+  const raw8 * colors = runlist->getColorArray();
+  int * parent = runlist->getParentArray();
+  int * next = runlist->getNextArray();
   int max_reg=reglist->getMaxRegions();
   int num = runlist->getUsedRuns();
 
   n = 0;
 
   for(i=0; i<num; i++){
-    if(rmap[i].color.v!=0){
-      r = rmap[i];
-      if(r.parent == i){
+    if(colors[i].v!=0){
+      x = xs[i];
+      y = ys[i];
+      w = widths[i];
+      if(parent[i] == i){
         // Add new region if this run is a root (i.e. self parented)
-        rmap[i].parent = b = n;  // renumber to point to region id
-        reg[b].color = r.color;
-        reg[b].area = r.width;
-        reg[b].x1 = r.x;
-        reg[b].y1 = r.y;
-        reg[b].x2 = r.x + r.width;
-        reg[b].y2 = r.y;
-        reg[b].cen_x = rangeSum(r.x,r.width);
-        reg[b].cen_y = r.y * r.width;
+        parent[i] = b = n;  // renumber to point to region id
+        reg[b].color = colors[i];
+        reg[b].area = w;
+        reg[b].x1 = x;
+        reg[b].y1 = y;
+        reg[b].x2 = x + w;
+        reg[b].y2 = y;
+        reg[b].cen_x = rangeSum(x,w);
+        reg[b].cen_y = y * w;
         reg[b].run_start = i;
         reg[b].iterator_id = i; // temporarily use to store last run
         n++;
@@ -214,16 +789,16 @@ void RegionProcessing::extractRegions(CMVision::RegionList * reglist, CMVision::
         }
       }else{
         // Otherwise update region stats incrementally
-        b = rmap[r.parent].parent;
-        rmap[i].parent = b; // update parent to identify region id
-        reg[b].area += r.width;
-        reg[b].x2 = max(r.x + r.width,reg[b].x2);
-        reg[b].x1 = min((int)r.x,reg[b].x1);
-        reg[b].y2 = r.y; // last set by lowest run
-        reg[b].cen_x += rangeSum(r.x,r.width);
-        reg[b].cen_y += r.y * r.width;
+        b = parent[parent[i]];
+        parent[i] = b; // update parent to identify region id
+        reg[b].area += w;
+        reg[b].x2 = max(x + w,reg[b].x2);
+        reg[b].x1 = min(x,reg[b].x1);
+        reg[b].y2 = y; // last set by lowest run
+        reg[b].cen_x += rangeSum(x,w);
+        reg[b].cen_y += y * w;
         // set previous run to point to this one as next
-        rmap[reg[b].iterator_id].next = i;
+        next[reg[b].iterator_id] = i;
         reg[b].iterator_id = i;
       }
     }
@@ -234,7 +809,7 @@ void RegionProcessing::extractRegions(CMVision::RegionList * reglist, CMVision::
     a = reg[i].area;
     reg[i].cen_x = (float)reg[i].cen_x / a;
     reg[i].cen_y = (float)reg[i].cen_y / a;
-    rmap[reg[i].iterator_id].next = 0; // -1;
+    next[reg[i].iterator_id] = 0; // -1;
     reg[i].iterator_id = 0;
     reg[i].x2--; // change to inclusive range
   }
@@ -247,31 +822,40 @@ void RegionProcessing::extractRegions(CMVision::RegionList * reglist, CMVision::
 
 
 
-int RegionProcessing::separateRegions(CMVision::ColorRegionList * colorlist, CMVision::RegionList * reglist, int min_area, double min_pixel_ratio)
-// Splits the various regions in the region table a separate list for
-// each color.  The lists are threaded through the table using the
-// region's 'next' field.  Returns the maximal area of the regions,
-// which can be used later to speed up sorting.
+int RegionProcessing::separateRegions(CMVision::ColorRegionList * colorlist, CMVision::RegionList * reglist, int min_area, double min_pixel_ratio,
+                                      LUTChannelMode mode)
+// Splits the various regions in the region table into an array for
+// each color, all of them kept in the one array of the color list.
+// Returns the maximal area of the regions.
+// In bitwise mode the regions come with the bit of their channel as
+// color, which is replaced by the channel id here.
 {
   CMVision::Region * p;
-  int i; // ,l;
+  int i;
   uint8_t c;
   int area,max_area;
   int num_regions=reglist->getUsedRegions();
   CMVision::Region * reg = reglist->getRegionArrayPointer();
   int num_colors=colorlist->getNumColorRegions();
-  CMVision::RegionLinkedList * color=colorlist->getColorRegionArrayPointer();
 
-  // clear out the region list head table
-  for(i=0; i<num_colors; i++){
-    color[i].reset();
-  }
+  // sized like the region list, so it only grows along with it
+  colorlist->reserve(reglist->getMaxRegions());
+  colorlist->reset();
+  CMVision::Region ** regions = colorlist->getRegionArrayPointer();
+  uint64_t * keys = colorlist->getKeyArrayPointer();
+  int * starts = colorlist->getStartArrayPointer();
+
+  // the indices of the regions that are kept
+  static thread_local std::vector<int> kept;
+  kept.clear();
 
-  // step over the table, adding successive
-  // regions to the front of each list
+  // count the regions of each color, starts[c+1] holds the count of c
   max_area = 0;
   for(i=0; i<num_regions; i++){
     p = &reg[i];
+    if(mode == LUTChannelMode_Bitwise && p->color.v != 0){
+      p->color = raw8(__builtin_ctz(p->color.v));
+    }
     c = p->color.v;
     area = p->area;
     if (c >= num_colors) {
@@ -281,85 +865,76 @@ int RegionProcessing::separateRegions(CMVision::ColorRegionList * colorlist, CMV
         double pixelRatio = p->area / (double) region_area;
       if(area >= min_area && pixelRatio > min_pixel_ratio){
         if(area > max_area) max_area = area;
-        color[c].insertFront(p);
+        kept.push_back(i);
+        starts[c + 1]++;
       }
     }
   }
 
-  return(max_area);
-}
-
-
-
-// These are the tweaking values for the radix sort given below
-// Feel free to change them, though these values seemed to work well
-// in testing.  Don't worry about extra passes to get all 32 bits of
-// the area; the implementation only does as many passes as needed to
-// touch the most significant set bit (MSB of largest region's area)
-#define CMV_RBITS 6
-#define CMV_RADIX (1 << CMV_RBITS)
-#define CMV_RMASK (CMV_RADIX-1)
-
-CMVision::Region * RegionProcessing::sortRegionListByArea(CMVision::Region *list,int passes)
-// Sorts a list of regions by their area field.
-// Uses a linked list based radix sort to process the list.
-{
-  CMVision::Region *tbl[CMV_RADIX],*p,*pn;
-  int slot,shift;
-  int i,j;
-
-  // Handle trivial cases
-  if(!list || !list->next) return(list);
-
-  // Initialize table
-  for(j=0; j<CMV_RADIX; j++) tbl[j] = NULL;
-
-  for(i=0; i<passes; i++){
-    // split list into buckets
-    shift = CMV_RBITS * i;
-    p = list;
-    while(p){
-      pn = p->next;
-      slot = ((p->area) >> shift) & CMV_RMASK;
-      p->next = tbl[slot];
-      tbl[slot] = p;
-      p = pn;
-    }
-
-    // integrate back into partially ordered list
-    list = NULL;
-    for(j=0; j<CMV_RADIX; j++){
-      p = tbl[j];
-      tbl[j] = NULL; // clear out table for next pass
-      while(p){
-        pn = p->next;
-        p->next = list;
-        list = p;
-        p = pn;
-      }
-    }
+  // step over the kept regions backwards, appending them to their colors,
+  // so that each color starts out in descending order of index
+  for(i=0; i<num_colors; i++){
+    starts[i + 1] += starts[i];
+  }
+  for(int n=(int)kept.size()-1; n>=0; n--){
+    i = kept[n];
+    int k = starts[reg[i].color.v]++;
+    regions[k] = &reg[i];
+    keys[k] = ((uint64_t)reg[i].area << 32) | (uint32_t)i;
+  }
+  // the appending moved every start to the end of its color
+  for(i=num_colors; i>0; i--){
+    starts[i] = starts[i - 1];
   }
+  starts[0] = 0;
 
-  return(list);
+  return(max_area);
 }
 
-void RegionProcessing::sortRegions(CMVision::ColorRegionList * colors,int max_area)
-// Sorts entire region table by area, using the above
-// function to sort each threaded region list.
+void RegionProcessing::sortRegions(CMVision::ColorRegionList * colors)
+// Sorts the regions of every color by area, largest first. Regions of
+// the same area stay in the descending order of their index in the
+// region table that separateRegions() left them in. Only the keys are
+// sorted, with an LSD radix sort over the bytes of the area that are in
+// use, and the regions are looked up from them afterwards.
 {
-  int i,p;
-  // do minimal number of passes sufficient to touch all set bits
-  p = 0;
-  while(max_area != 0){
-    max_area >>= CMV_RBITS;
-    p++;
-  }
-
+  static thread_local std::vector<uint64_t> buffer;
   int num_colors=colors->getNumColorRegions();
-  CMVision::RegionLinkedList * color = colors->getColorRegionArrayPointer();
-  // sort each list
-  for(i=0; i<num_colors; i++){
-    color[i].setFront(sortRegionListByArea(color[i].getInitialElement(),p));
+  CMVision::Region ** regions = colors->getRegionArrayPointer();
+  uint64_t * keys = colors->getKeyArrayPointer();
+  const int * starts = colors->getStartArrayPointer();
+  if(starts[num_colors] == 0) return;
+  buffer.resize(starts[num_colors]);
+
+  // all regions point into the same table, so any of them gives its start
+  CMVision::Region * table = regions[0] - (uint32_t)keys[0];
+  for(int c=0; c<num_colors; c++){
+    int n = starts[c + 1] - starts[c];
+    uint64_t * from = keys + starts[c];
+    uint64_t * to = buffer.data() + starts[c];
+    if(n < 64){
+      // keys are unique, so this gives the same order
+      std::sort(from, from + n, std::greater<uint64_t>());
+    }else{
+      uint32_t max_area = 0;
+      for(int k=0; k<n; k++) max_area = std::max(max_area, (uint32_t)(from[k] >> 32));
+      for(int shift=32; shift<64 && (max_area >> (shift - 32)) != 0; shift+=8){
+        int offsets[256] = {0};
+        for(int k=0; k<n; k++) offsets[(from[k] >> shift) & 0xff]++;
+        // largest bucket first
+        int sum = 0;
+        for(int d=255; d>=0; d--){
+          int count = offsets[d];
+          offsets[d] = sum;
+          sum += count;
+        }
+        for(int k=0; k<n; k++) to[offsets[(from[k] >> shift) & 0xff]++] = from[k];
+        std::swap(from, to);
+      }
+    }
+    for(int k=0; k<n; k++){
+      regions[starts[c] + k] = table + (uint32_t)from[k];
+    }
   }
 }
 
@@ -416,12 +991,21 @@ void ImageProcessor::processYUV444(const ImageInterface * image, int min_blob_ar
 }
 
 void ImageProcessor::processThresholded(Image<raw8> *_img_thresholded, int min_blob_area, double min_pixel_ratio) {
-  CMVision::RegionProcessing::encodeRuns(_img_thresholded, runlist);
+  LUTChannelMode mode = lut->getChannelMode();
+  if (mode == LUTChannelMode_Bitwise) {
+    CMVision::RegionProcessing::encodeBitplanes(_img_thresholded, runlist, lut->getChannelCount());
+  } else {
+    CMVision::RegionProcessing::encodeRuns(_img_thresholded, runlist);
+  }
   if (runlist->getUsedRuns() == runlist->getMaxRuns()) {
     printf("Warning: runlength encoder exceeded current max run size of %d\n",runlist->getMaxRuns());
   }
   //Connect the components of the runlength map:
-  CMVision::RegionProcessing::connectComponents(runlist);
+  if (mode == LUTChannelMode_Bitwise) {
+    CMVision::RegionProcessing::connectBitplanes(runlist);
+  } else {
+    CMVision::RegionProcessing::connectComponents(runlist);
+  }
 
   //Extract Regions from runlength map:
   CMVision::RegionProcessing::extractRegions(reglist, runlist);
@@ -431,9 +1015,9 @@ void ImageProcessor::processThresholded(Image<raw8> *_img_thresholded, int min_b
   }
 
   //Separate Regions by colors:
-  int max_area = CMVision::RegionProcessing::separateRegions(colorlist, reglist, min_blob_area, min_pixel_ratio);
+  CMVision::RegionProcessing::separateRegions(colorlist, reglist, min_blob_area, min_pixel_ratio, mode);
 
-  CMVision::RegionProcessing::sortRegions(colorlist,max_area);
+  CMVision::RegionProcessing::sortRegions(colorlist);
 }
 
 ColorRegionList * ImageProcessor::getColorRegionList() {
@@ -27,6 +27,12 @@
 #include "nkdtree.h"
 #include "cmvision_threshold.h"
 #include "lut3d.h"
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+class WorkerPool;
+struct MaskSpan;
 
 namespace CMVision {
 
@@ -39,31 +45,107 @@ public:
 };
 
 
+/*!
+  \class  RunList
+  \brief  The runs of a frame, with one array per field
+
+  Labeling and region extraction read one or two fields of every run, so
+  the fields are kept in separate arrays instead of an array of Run. The
+  coordinates are 16 bit, which limits images to RunList::max_coordinate
+  pixels in width and height. getRun() and setRun() convert single runs.
+*/
 class RunList {
 private:
-  Run * runs;
+  uint16_t * xs;
+  uint16_t * ys;
+  uint16_t * widths;
+  raw8 * colors;
+  int * parents;
+  int * nexts;
   int max_runs;
   int used_runs;
+  void allocate(int n) {
+    xs=new uint16_t[n];
+    ys=new uint16_t[n];
+    widths=new uint16_t[n];
+    colors=new raw8[n];
+    parents=new int[n];
+    nexts=new int[n];
+    max_runs=n;
+  }
+  void release() {
+    delete[] xs;
+    delete[] ys;
+    delete[] widths;
+    delete[] colors;
+    delete[] parents;
+    delete[] nexts;
+  }
 public:
+  static const int max_coordinate = 65535;
+  //bytes stored per run, over all arrays
+  static const int bytes_per_run = 3*sizeof(uint16_t) + sizeof(raw8) + 2*sizeof(int);
+
   RunList(int _max_runs) {
-    runs=new Run[_max_runs];
-    max_runs=_max_runs;
+    allocate(_max_runs);
     used_runs=0;
   }
+  RunList(const RunList &) = delete;
+  RunList & operator=(const RunList &) = delete;
   void setUsedRuns(int runs) {
     used_runs=runs;
   }
-  int getUsedRuns() {
+  int getUsedRuns() const {
     return used_runs;
   }
   ~RunList() {
-    delete[] runs;
+    release();
+  }
+  //grows the list to hold at least n runs, dropping its contents. Never shrinks.
+  void reserve(int n) {
+    if (n <= max_runs) return;
+    release();
+    allocate(n);
+    used_runs=0;
+  }
+  Run getRun(int i) const {
+    Run r;
+    r.x=xs[i];
+    r.y=ys[i];
+    r.width=widths[i];
+    r.color=colors[i];
+    r.parent=parents[i];
+    r.next=nexts[i];
+    return r;
+  }
+  void setRun(int i, const Run & r) {
+    xs[i]=(uint16_t)r.x;
+    ys[i]=(uint16_t)r.y;
+    widths[i]=(uint16_t)r.width;
+    colors[i]=r.color;
+    parents[i]=r.parent;
+    nexts[i]=r.next;
   }
 public:
-  Run * getRunArrayPointer() {
-    return runs;
+  uint16_t * getXArray() const {
+    return xs;
   }
-  int getMaxRuns() {
+  uint16_t * getYArray() const {
+    return ys;
+  }
+  uint16_t * getWidthArray() const {
+    return widths;
+  }
+  raw8 * getColorArray() const {
+    return colors;
+  }
+  int * getParentArray() const {
+    return parents;
+  }
+  int * getNextArray() const {
+    return nexts;
+  }
+  int getMaxRuns() const {
     return max_runs;
   }
 };
@@ -78,7 +160,6 @@ class Region{
   int area;          // occupied area in pixels
   int run_start;     // first run index for this region
   int iterator_id;   // id to prevent duplicate hits by an iterator
-  Region *next;      // next region in list
   Region *tree_next; // next pointer for use in spatial lookup trees
 
   // accessor for centroid
@@ -112,6 +193,14 @@ public:
   ~RegionList() {
     delete[] regions;
   }
+  //grows the list to hold at least n regions, dropping its contents. Never shrinks.
+  void reserve(int n) {
+    if (n <= max_regions) return;
+    delete[] regions;
+    regions=new Region[n];
+    max_regions=n;
+    used_regions=0;
+  }
 public:
   Region * getRegionArrayPointer() const {
     return regions;
@@ -122,71 +211,185 @@ public:
 };
 
 
-class RegionLinkedList {
+/*!
+  \class  ListCapacity
+  \brief  The size of one kind of list (runs or regions) for all frames of a stack
+
+  A list is sized to the capacity before a frame is written into it and never
+  grows while it is. Afterwards the usage of the frame is recorded: once the
+  high-water mark comes close to the capacity, the capacity doubles for the
+  following frames. A truncated list doubles it as well and is counted as an
+  overflow. The capacity never exceeds the limit.
+
+  Only the capture thread of the stack writes, the counters can be read from
+  any thread.
+*/
+class ListCapacity {
 protected:
-  Region * _first;
-  int _num;
+  std::atomic<int> capacity;
+  std::atomic<int> limit;
+  std::atomic<int> last_used;
+  std::atomic<int> high_water;
+  std::atomic<long> frames;
+  std::atomic<long> overflows;
+  std::atomic<int> grows;
 public:
-  RegionLinkedList() {
-    reset();
+  ListCapacity(int initial_capacity, int _limit);
+  void setLimit(int _limit);
+  //records the number of entries a frame used, truncated tells whether some did not fit.
+  //returns true if the capacity grew.
+  bool record(int used, bool truncated);
+  int getCapacity() const {
+    return capacity;
+  }
+  int getLimit() const {
+    return limit;
+  }
+  int getLastUsed() const {
+    return last_used;
+  }
+  int getHighWater() const {
+    return high_water;
   }
-  Region * getInitialElement() const {
-    return _first;
+  long getFrames() const {
+    return frames;
   }
+  long getOverflows() const {
+    return overflows;
+  }
+  int getGrows() const {
+    return grows;
+  }
+};
+
+/*!
+  \class  ListArena
+  \brief  Sizes the run and region lists of all frames of one stack
+
+  The plugins that fill a list call prepare() before writing it, which is the
+  only place the lists are reallocated, and record() afterwards.
+*/
+class ListArena {
+public:
+  ListCapacity runs;
+  ListCapacity regions;
+  ListArena(int initial_runs=50000, int initial_regions=50000, int run_limit=4000000, int region_limit=1000000);
+  void prepare(RunList * list) {
+    list->reserve(runs.getCapacity());
+  }
+  void prepare(RegionList * list) {
+    list->reserve(regions.getCapacity());
+  }
+  //records the usage of a list the caller has written, see ListCapacity::record()
+  void record(RunList * list);
+  void record(RegionList * list);
+};
+
+
+/*!
+  \class  RegionArray
+  \brief  The regions of one color, sorted by area with the largest first
+
+  A view into a ColorRegionList, valid until the list is written again.
+*/
+class RegionArray {
+protected:
+  Region * const * _regions;
+  int _num;
+public:
+  RegionArray() : _regions(0), _num(0) {}
+  RegionArray(Region * const * regions, int num) : _regions(regions), _num(num) {}
   int getNumRegions() const {
-   return _num;
-  };
-  void setFront(Region * r) {
-    _first=r;
+    return _num;
   }
-  void setNum(int num) {
-    _num=num;
+  Region * operator[](int idx) const {
+    return _regions[idx];
   }
-  void reset() {
-    _first=0;
-    _num=0;
+  Region * const * begin() const {
+    return _regions;
   }
-  inline void insertFront(Region * r) {
-    r->next=_first;
-    _first=r;
-    _num++;
+  Region * const * end() const {
+    return _regions + _num;
   }
 };
 
+/*!
+  \class  ColorRegionList
+  \brief  The regions of a RegionList, grouped by color
+
+  The regions of all colors are kept in one array, those of a color next
+  to each other. Sorting works on a key per region that holds its area and
+  its index in the region table.
+*/
 class ColorRegionList {
 private:
-  RegionLinkedList * color_regions;
+  Region ** regions;
+  uint64_t * keys;
+  int max_regions;
+  int * starts;      // color c has the entries [starts[c],starts[c+1])
   int num_color_regions;
 public:
   ColorRegionList(int _num_color_regions) {
-    color_regions=new RegionLinkedList[_num_color_regions];
     num_color_regions=_num_color_regions;
+    starts=new int[_num_color_regions+1];
+    max_regions=0;
+    regions=0;
+    keys=0;
+    reset();
   }
   ~ColorRegionList() {
-    delete[] color_regions;
+    delete[] starts;
+    delete[] regions;
+    delete[] keys;
   }
-public:
-  const RegionLinkedList & getRegionList(int idx) const {
-    return color_regions[idx];
+  ColorRegionList(const ColorRegionList &) = delete;
+  ColorRegionList & operator=(const ColorRegionList &) = delete;
+  //removes the regions of all colors
+  void reset() {
+    for (int i=0; i<=num_color_regions; i++) starts[i]=0;
+  }
+  //grows the list to hold at least n regions, dropping its contents. Never shrinks.
+  void reserve(int n) {
+    if (n <= max_regions) return;
+    delete[] regions;
+    delete[] keys;
+    regions=new Region *[n];
+    keys=new uint64_t[n];
+    max_regions=n;
+    reset();
   }
-  RegionLinkedList * getColorRegionArrayPointer() const {
-    return color_regions;
+public:
+  RegionArray getRegionList(int idx) const {
+    return RegionArray(regions + starts[idx], starts[idx+1] - starts[idx]);
   }
   int getNumColorRegions() const {
     return num_color_regions;
   }
+  int getMaxRegions() const {
+    return max_regions;
+  }
+  Region ** getRegionArrayPointer() const {
+    return regions;
+  }
+  uint64_t * getKeyArrayPointer() const {
+    return keys;
+  }
+  int * getStartArrayPointer() const {
+    return starts;
+  }
 };
 
 
 class RegionFilter{
 protected:
-  const CMVision::Region *reg;
+  RegionArray list;
+  int idx;
   int w,h;
   ClosedRangeInt area;
   ClosedRangeInt width;
   ClosedRangeInt height;
 public:
-  RegionFilter() {reg=0; w=0; h=0; area.set(0,1000000); width.set(0,1000); height.set(0,1000); }
+  RegionFilter() {idx=0; w=0; h=0; area.set(0,1000000); width.set(0,1000); height.set(0,1000); }
   void setArea(ClosedRangeInt & _area) {
     area=_area;
   }
@@ -224,31 +427,30 @@ public:
     return(area.inside(reg.area) && width.inside(w) && height.inside(h));
   }
 
-  void init(const CMVision::Region *region_list) {
-    reg = region_list;
+  void init(const RegionArray & region_list) {
+    list = region_list;
 
     // skip too-large regions in sorted region list
-    while(reg!=0 && reg->area>area.max) reg = reg->next;
+    idx = std::partition_point(list.begin(), list.end(),
+                               [this](const CMVision::Region * r) { return r->area > area.max; }) - list.begin();
   }
 
   const CMVision::Region * getNext()
   {
-    // terminate when no regions, or no suitably large ones
-    if(reg==0) return(0);
-
     // find the next region matching our ranges
-    while(reg!=0) {
+    while(idx < list.getNumRegions()) {
+      const CMVision::Region * reg = list[idx++];
       w = reg->width();
       h = reg->height();
 
-      if(reg->area < area.min) return(0);
+      // terminate when there are no suitably large ones left
+      if(reg->area < area.min) {
+        idx = list.getNumRegions();
+        return(0);
+      }
       if(width.inside(w) && height.inside(h)){
-        const CMVision::Region *match = reg;
-        reg = reg->next;
-        return(match);
+        return(reg);
       }
-
-      reg = reg->next;
     }
     return(0);
   }
@@ -286,20 +488,41 @@ protected:
     return(rs / 6);
   }
 
+  static void connectBand(CMVision::RunList * runlist, int begin, int end);
+
 
 public:
     RegionProcessing();
 
     ~RegionProcessing();
 
-    static void encodeRuns(Image<raw8> * tmap, CMVision::RunList * runlist);
+    static int  encodeRow(const raw8 * row, int width, int y, CMVision::Run * runs, int j, int max_runs);
+    //only reads [begin,end) of the row, everything outside has to be clear:
+    static int  encodeRow(const raw8 * row, int width, int begin, int end, int y, CMVision::Run * runs, int j, int max_runs);
+    //spans (one per row, may be null) skips the parts of the rows that are known to be clear.
+    //images larger than RunList::max_coordinate give an empty list:
+    static void encodeRuns(Image<raw8> * tmap, CMVision::RunList * runlist, const MaskSpan * spans = nullptr);
+    //encodes every channel bit of a bitwise labeled image as a plane of its own, one after the other:
+    static void encodeBitplanes(Image<raw8> * tmap, CMVision::RunList * runlist, int num_channels, const MaskSpan * spans = nullptr);
+    //threshold and encode rows [first_row,end_row) without writing a thresholded image.
+    //spans (one per image row, may be null) limits the work to the spans of the image mask.
+    //returns false if the format is not supported or max_runs is exceeded:
+    static bool thresholdAndEncodeRows(const RawImage * source, const LUTReadGuard & table, const ImageInterface * mask,
+                                       const MaskSpan * spans, int first_row, int end_row,
+                                       std::vector<CMVision::Run> & runs, int & used_runs, int max_runs);
+    static void decodeRuns(CMVision::RunList * runlist, Image<raw8> * tmap);
     static void connectComponents(CMVision::RunList * runlist);
+    //same result as above, but labels bands of rows in parallel on the pool:
+    static void connectComponents(CMVision::RunList * runlist, WorkerPool * pool);
+    //connects the planes written by encodeBitplanes(), one per thread of the pool (may be null):
+    static void connectBitplanes(CMVision::RunList * runlist, WorkerPool * pool = nullptr);
     static void extractRegions(CMVision::RegionList * reglist, CMVision::RunList * runlist);
     //returns the max area found:
-    static int  separateRegions(CMVision::ColorRegionList * colorlist, CMVision::RegionList * reglist, int min_area, double min_pixel_ratio);
+    static int  separateRegions(CMVision::ColorRegionList * colorlist, CMVision::RegionList * reglist, int min_area, double min_pixel_ratio,
+                                LUTChannelMode mode = LUTChannelMode_Numeric);
 
-    static CMVision::Region * sortRegionListByArea(CMVision::Region *list,int passes);
-    static void sortRegions(CMVision::ColorRegionList * colors,int max_area);
+    //sorts the regions of every color by area, largest first:
+    static void sortRegions(CMVision::ColorRegionList * colors);
 
 };
 
@@ -20,114 +20,309 @@
 */
 //========================================================================
 #include "cmvision_threshold.h"
-#ifdef __AVX2__
-#include <x86intrin.h>
+#include <algorithm>
+#include <cstring>
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CMV_THRESHOLD_X86_DISPATCH
+#include <immintrin.h>
 #endif
 
-CMVisionThreshold::CMVisionThreshold()
-{
-}
+namespace {
 
+/// the LUT parameters the per-pixel kernels need
+struct ThresholdParams {
+  const lut_mask_t * LUT;
+  int X_SHIFT;
+  int Y_SHIFT;
+  int Z_SHIFT;
+  // bit offsets of the x, y and z cell index within a table index, they depend on the layout
+  int X_POS;
+  int Y_POS;
+  int Z_POS;
+  int TOTAL_BITS;
+};
 
-CMVisionThreshold::~CMVisionThreshold()
-{
+ThresholdParams getThresholdParams(const LUTReadGuard & table) {
+  const LUT3D * lut = table.getLUT();
+  ThresholdParams p;
+  p.LUT = table.getTable();
+  p.X_SHIFT = lut->X_SHIFT;
+  p.Y_SHIFT = lut->Y_SHIFT;
+  p.Z_SHIFT = lut->Z_SHIFT;
+  unsigned int x_pos, y_pos, z_pos;
+  lut->getIndexPositions(table.getLayout(), x_pos, y_pos, z_pos);
+  p.X_POS = x_pos;
+  p.Y_POS = y_pos;
+  p.Z_POS = z_pos;
+  p.TOTAL_BITS = lut->TOTAL_BITS;
+  return p;
 }
 
-bool CMVisionThreshold::thresholdImageYUV422_UYVY(Image<raw8> * target, const RawImage * source, YUVLUT * lut, const ImageInterface* mask) {
-  if (source->getColorFormat()!=COLOR_YUV422_UYVY) {
-    //TODO add YUV444 and maybe even 411 mode
-    fprintf(stderr,"CMVision thresholdImageYUV422_UYVY assumes YUV422 as input, but found %s\n", Colors::colorFormatToString(source->getColorFormat()).c_str());
-    return false;
+/// thresholds the UYVY pixels [begin,end) (begin and end have to be even)
+void thresholdUYVYScalar(const uint8_t * source, uint8_t * target, const uint8_t * mask,
+                         unsigned int begin, unsigned int end, const ThresholdParams & p) {
+  const uyvy * source_pointer = (const uyvy *)source;
+  const lut_mask_t * LUT = p.LUT;
+  for (unsigned int i = begin; i < end; i += 2) {
+    uyvy px = source_pointer[(i >> 0x01)];
+    int B = ((px.u >> p.Y_SHIFT) << p.Y_POS);
+    int C = ((px.v >> p.Z_SHIFT) << p.Z_POS);
+    target[i] = mask[i] & LUT[(((px.y1 >> p.X_SHIFT) << p.X_POS) | B | C)];
+    target[i + 1] = mask[i + 1] & LUT[(((px.y2 >> p.X_SHIFT) << p.X_POS) | B | C)];
   }
+}
 
-  register lut_mask_t * LUT = lut->getTable();
+/// thresholds the YUV444 pixels [begin,end)
+void thresholdYUV444Scalar(const uint8_t * source, uint8_t * target, const uint8_t * mask,
+                           unsigned int begin, unsigned int end, const ThresholdParams & p) {
+  const yuv * source_pointer = (const yuv *)source;
+  const lut_mask_t * LUT = p.LUT;
+  for (unsigned int i = begin; i < end; i++) {
+    yuv px = source_pointer[i];
+    target[i] = mask[i] & LUT[(((px.y >> p.X_SHIFT) << p.X_POS) | ((px.u >> p.Y_SHIFT) << p.Y_POS) | ((px.v >> p.Z_SHIFT) << p.Z_POS))];
+  }
+}
 
-  register unsigned int          target_size    = target->getNumPixels();
-  register uyvy *       source_pointer = (uyvy*)(source->getData());
-  register raw8 *      target_pointer = target->getPixelData();
-  register unsigned char *      mask_pointer = mask->getData();
+#ifdef CMV_THRESHOLD_X86_DISPATCH
 
-  if (target->getNumPixels() != source->getNumPixels()) {
-    fprintf(stderr, "CMVision YUV422_UYVY thresholding: source (num=%d  w=%d  h=%d) and target (num=%d w=%d h=%d) pixel counts do not match!\n", source->getNumPixels(),source->getWidth(),source->getHeight(), target->getNumPixels(),target->getWidth(),target->getHeight());
-    return false;
-  }
+// The vector kernels compute the LUT indices of 4, 8 or 16 pixels at once.
+// The AVX2 and AVX-512 versions then fetch the entries with a gather, which
+// loads 32 bit at byte granularity; the tables are allocated LUT3D::LUT_PADDING
+// bytes larger, so reading 3 bytes past the last entry is safe. SSE4.1 has no
+// gather, there the lookups stay scalar.
+//
+// Every kernel does as many full vectors as fit (without reading past the
+// end of the source) and leaves the remaining pixels to the scalar loop.
 
-  lut->lock();
-  int X_SHIFT=lut->X_SHIFT;
-  int Y_SHIFT=lut->Y_SHIFT;
-  int Z_SHIFT=lut->Z_SHIFT;
-  int Z_AND_Y_BITS=lut->Z_AND_Y_BITS;
-  int Z_BITS = lut->Z_BITS;
-  uyvy p;
-  for (unsigned int i=0;i<target_size;i+=2) {
-    p=source_pointer[(i >> 0x01)];
-    register int B=((p.u >> Y_SHIFT) << Z_BITS);
-    register int C=(p.v >> Z_SHIFT);
-    target_pointer[i] =  mask_pointer[i] & LUT[(((p.y1 >> X_SHIFT) << Z_AND_Y_BITS) | B | C)];
-    target_pointer[i+1] =  mask_pointer[i+1] & LUT[(((p.y2 >> X_SHIFT) << Z_AND_Y_BITS) | B | C)];
-  }
-  lut->unlock();
-  return true;
-}
+// moves the 3 bytes of each of 4 YUV444 pixels into the low bytes of a 32 bit lane
+#define CMV_YUV444_SHUFFLE -128, 11, 10, 9, -128, 8, 7, 6, -128, 5, 4, 3, -128, 2, 1, 0
 
-bool CMVisionThreshold::thresholdImageYUV444(Image<raw8> * target, const ImageInterface * source, YUVLUT * lut, const ImageInterface* mask) {
-  if (source->getColorFormat()!=COLOR_YUV444) {
-    fprintf(stderr,"CMVision thresholdImageYUV444 assumes YUV444 as input, but found %s\n", Colors::colorFormatToString(source->getColorFormat()).c_str());
-    return false;
-  }
+__attribute__((target("sse4.1")))
+void thresholdUYVYSSE41(const uint8_t * source, uint8_t * target, const uint8_t * mask,
+                        unsigned int num, const ThresholdParams & p) {
+  const __m128i lo8 = _mm_set1_epi32(0xFF);
+  const __m128i x_shift = _mm_cvtsi32_si128(p.X_SHIFT);
+  const __m128i y_shift = _mm_cvtsi32_si128(p.Y_SHIFT);
+  const __m128i z_shift = _mm_cvtsi32_si128(p.Z_SHIFT);
+  const __m128i x_pos = _mm_cvtsi32_si128(p.X_POS);
+  const __m128i y_pos = _mm_cvtsi32_si128(p.Y_POS);
+  const __m128i z_pos = _mm_cvtsi32_si128(p.Z_POS);
+  alignas(16) uint16_t idx[8];
 
-  register lut_mask_t * LUT = lut->getTable();
+  unsigned int i = 0;
+  for (; i + 8 <= num; i += 8) {
+    __m128i w = _mm_loadu_si128((const __m128i *)(source + i * 2));
+    __m128i u = _mm_and_si128(w, lo8);
+    __m128i y1 = _mm_and_si128(_mm_srli_epi32(w, 8), lo8);
+    __m128i v = _mm_and_si128(_mm_srli_epi32(w, 16), lo8);
+    __m128i y2 = _mm_srli_epi32(w, 24);
+    __m128i uv = _mm_or_si128(_mm_sll_epi32(_mm_srl_epi32(u, y_shift), y_pos), _mm_sll_epi32(_mm_srl_epi32(v, z_shift), z_pos));
+    __m128i i1 = _mm_or_si128(_mm_sll_epi32(_mm_srl_epi32(y1, x_shift), x_pos), uv);
+    __m128i i2 = _mm_or_si128(_mm_sll_epi32(_mm_srl_epi32(y2, x_shift), x_pos), uv);
+    // interleave to pixel order: y1 index in the low, y2 index in the high half
+    _mm_store_si128((__m128i *)idx, _mm_or_si128(i1, _mm_slli_epi32(i2, 16)));
+    for (int j = 0; j < 8; j++) {
+      target[i + j] = mask[i + j] & p.LUT[idx[j]];
+    }
+  }
+  thresholdUYVYScalar(source, target, mask, i, num, p);
+}
 
-  register unsigned int          target_size    = target->getNumPixels();
-  register yuv  *                source_pointer = (yuv*)(source->getData());
-  register raw8 *                target_pointer = target->getPixelData();
-  register unsigned char *       mask_pointer = mask->getData();
+__attribute__((target("sse4.1")))
+void thresholdYUV444SSE41(const uint8_t * source, uint8_t * target, const uint8_t * mask,
+                          unsigned int num, const ThresholdParams & p) {
+  const __m128i shuffle = _mm_set_epi8(CMV_YUV444_SHUFFLE);
+  const __m128i lo8 = _mm_set1_epi32(0xFF);
+  const __m128i x_shift = _mm_cvtsi32_si128(p.X_SHIFT);
+  const __m128i y_shift = _mm_cvtsi32_si128(p.Y_SHIFT);
+  const __m128i z_shift = _mm_cvtsi32_si128(p.Z_SHIFT);
+  const __m128i x_pos = _mm_cvtsi32_si128(p.X_POS);
+  const __m128i y_pos = _mm_cvtsi32_si128(p.Y_POS);
+  const __m128i z_pos = _mm_cvtsi32_si128(p.Z_POS);
+  alignas(16) uint16_t idx[8];
 
-  if (target->getNumPixels() != source->getNumPixels()) {
-     fprintf(stderr, "CMVision YUV444 thresholding: source (num=%d  w=%d  h=%d) and target (num=%d w=%d h=%d) pixel counts do not match!\n", source->getNumPixels(),source->getWidth(),source->getHeight(), target->getNumPixels(),target->getWidth(),target->getHeight());
-    return false;
+  unsigned int i = 0;
+  // the second load of an iteration reads 4 bytes beyond its 4 pixels
+  for (; (i + 8) * 3 + 4 <= num * 3; i += 8) {
+    __m128i index[2];
+    for (int k = 0; k < 2; k++) {
+      __m128i w = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(source + i * 3 + k * 12)), shuffle);
+      __m128i y = _mm_and_si128(w, lo8);
+      __m128i u = _mm_and_si128(_mm_srli_epi32(w, 8), lo8);
+      __m128i v = _mm_srli_epi32(w, 16);
+      index[k] = _mm_or_si128(_mm_or_si128(_mm_sll_epi32(_mm_srl_epi32(y, x_shift), x_pos),
+                                           _mm_sll_epi32(_mm_srl_epi32(u, y_shift), y_pos)),
+                              _mm_sll_epi32(_mm_srl_epi32(v, z_shift), z_pos));
+    }
+    _mm_store_si128((__m128i *)idx, _mm_packus_epi32(index[0], index[1]));
+    for (int j = 0; j < 8; j++) {
+      target[i + j] = mask[i + j] & p.LUT[idx[j]];
+    }
   }
+  thresholdYUV444Scalar(source, target, mask, i, num, p);
+}
+
+__attribute__((target("avx2")))
+inline __m256i lookupUYVYAVX2(__m256i w, const ThresholdParams & p) {
+  const __m256i lo8 = _mm256_set1_epi32(0xFF);
+  const __m128i x_shift = _mm_cvtsi32_si128(p.X_SHIFT);
+  const __m128i y_shift = _mm_cvtsi32_si128(p.Y_SHIFT);
+  const __m128i z_shift = _mm_cvtsi32_si128(p.Z_SHIFT);
+  const __m128i x_pos = _mm_cvtsi32_si128(p.X_POS);
+  const __m128i y_pos = _mm_cvtsi32_si128(p.Y_POS);
+  const __m128i z_pos = _mm_cvtsi32_si128(p.Z_POS);
+  __m256i u = _mm256_and_si256(w, lo8);
+  __m256i y1 = _mm256_and_si256(_mm256_srli_epi32(w, 8), lo8);
+  __m256i v = _mm256_and_si256(_mm256_srli_epi32(w, 16), lo8);
+  __m256i y2 = _mm256_srli_epi32(w, 24);
+  __m256i uv = _mm256_or_si256(_mm256_sll_epi32(_mm256_srl_epi32(u, y_shift), y_pos), _mm256_sll_epi32(_mm256_srl_epi32(v, z_shift), z_pos));
+  __m256i i1 = _mm256_or_si256(_mm256_sll_epi32(_mm256_srl_epi32(y1, x_shift), x_pos), uv);
+  __m256i i2 = _mm256_or_si256(_mm256_sll_epi32(_mm256_srl_epi32(y2, x_shift), x_pos), uv);
+  __m256i l1 = _mm256_and_si256(_mm256_i32gather_epi32((const int *)p.LUT, i1, 1), lo8);
+  __m256i l2 = _mm256_and_si256(_mm256_i32gather_epi32((const int *)p.LUT, i2, 1), lo8);
+  // the two pixels of each macro pixel end up in the low 16 bit, in pixel order
+  return _mm256_or_si256(l1, _mm256_slli_epi32(l2, 8));
+}
 
-  lut->lock();
-  int X_SHIFT=lut->X_SHIFT;
-  int Y_SHIFT=lut->Y_SHIFT;
-  int Z_SHIFT=lut->Z_SHIFT;
-  int Z_AND_Y_BITS=lut->Z_AND_Y_BITS;
-  int Z_BITS = lut->Z_BITS;
-  yuv p;
-  for (unsigned int i=0;i<target_size;i++) {
-    p=source_pointer[i];
-    target_pointer[i] =  mask_pointer[i] & LUT[(((p.y >> X_SHIFT) << Z_AND_Y_BITS) | ((p.u >> Y_SHIFT) << Z_BITS) | (p.v >> Z_SHIFT))];
+__attribute__((target("avx2")))
+void thresholdUYVYAVX2(const uint8_t * source, uint8_t * target, const uint8_t * mask,
+                       unsigned int num, const ThresholdParams & p) {
+  unsigned int i = 0;
+  for (; i + 32 <= num; i += 32) {
+    __m256i r0 = lookupUYVYAVX2(_mm256_loadu_si256((const __m256i *)(source + i * 2)), p);
+    __m256i r1 = lookupUYVYAVX2(_mm256_loadu_si256((const __m256i *)(source + i * 2 + 32)), p);
+    // packus works per 128 bit lane, the permute restores the pixel order
+    __m256i pixels = _mm256_permute4x64_epi64(_mm256_packus_epi32(r0, r1), 0xD8);
+    __m256i m = _mm256_loadu_si256((const __m256i *)(mask + i));
+    _mm256_storeu_si256((__m256i *)(target + i), _mm256_and_si256(pixels, m));
   }
-  lut->unlock();
+  thresholdUYVYScalar(source, target, mask, i, num, p);
+}
 
-  return true;
+__attribute__((target("avx2")))
+inline __m256i lookupYUV444AVX2(const uint8_t * source, const ThresholdParams & p) {
+  const __m256i shuffle = _mm256_broadcastsi128_si256(_mm_set_epi8(CMV_YUV444_SHUFFLE));
+  const __m256i lo8 = _mm256_set1_epi32(0xFF);
+  const __m128i x_shift = _mm_cvtsi32_si128(p.X_SHIFT);
+  const __m128i y_shift = _mm_cvtsi32_si128(p.Y_SHIFT);
+  const __m128i z_shift = _mm_cvtsi32_si128(p.Z_SHIFT);
+  const __m128i x_pos = _mm_cvtsi32_si128(p.X_POS);
+  const __m128i y_pos = _mm_cvtsi32_si128(p.Y_POS);
+  const __m128i z_pos = _mm_cvtsi32_si128(p.Z_POS);
+  __m256i w = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)source)),
+                                      _mm_loadu_si128((const __m128i *)(source + 12)), 1);
+  w = _mm256_shuffle_epi8(w, shuffle);
+  __m256i y = _mm256_and_si256(w, lo8);
+  __m256i u = _mm256_and_si256(_mm256_srli_epi32(w, 8), lo8);
+  __m256i v = _mm256_srli_epi32(w, 16);
+  __m256i index = _mm256_or_si256(_mm256_or_si256(_mm256_sll_epi32(_mm256_srl_epi32(y, x_shift), x_pos),
+                                                  _mm256_sll_epi32(_mm256_srl_epi32(u, y_shift), y_pos)),
+                                  _mm256_sll_epi32(_mm256_srl_epi32(v, z_shift), z_pos));
+  return _mm256_and_si256(_mm256_i32gather_epi32((const int *)p.LUT, index, 1), lo8);
 }
 
+__attribute__((target("avx2")))
+void thresholdYUV444AVX2(const uint8_t * source, uint8_t * target, const uint8_t * mask,
+                         unsigned int num, const ThresholdParams & p) {
+  unsigned int i = 0;
+  // the last load of an iteration reads 4 bytes beyond its 4 pixels
+  for (; (i + 16) * 3 + 4 <= num * 3; i += 16) {
+    __m256i r0 = lookupYUV444AVX2(source + i * 3, p);
+    __m256i r1 = lookupYUV444AVX2(source + i * 3 + 24, p);
+    __m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(r0, r1), 0xD8);
+    __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0xD8);
+    __m128i m = _mm_loadu_si128((const __m128i *)(mask + i));
+    _mm_storeu_si128((__m128i *)(target + i), _mm_and_si128(_mm256_castsi256_si128(bytes), m));
+  }
+  thresholdYUV444Scalar(source, target, mask, i, num, p);
+}
 
+// gcc 12 warns about the _mm512_undefined_epi32() inside its own intrinsics
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
 
-bool CMVisionThreshold::thresholdImageRGB(Image<raw8> * target, const ImageInterface * source, RGBLUT * lut, const ImageInterface* mask) {
-  if (source->getColorFormat()!=COLOR_RGB8) {
-    fprintf(stderr,"CMVision RGB thresholding assumes RGB8 as input, but found %s\n", Colors::colorFormatToString(source->getColorFormat()).c_str());
-    return false;
+__attribute__((target("avx512f,avx512bw")))
+void thresholdUYVYAVX512(const uint8_t * source, uint8_t * target, const uint8_t * mask,
+                         unsigned int num, const ThresholdParams & p) {
+  const __m512i lo8 = _mm512_set1_epi32(0xFF);
+  const __m128i x_shift = _mm_cvtsi32_si128(p.X_SHIFT);
+  const __m128i y_shift = _mm_cvtsi32_si128(p.Y_SHIFT);
+  const __m128i z_shift = _mm_cvtsi32_si128(p.Z_SHIFT);
+  const __m128i x_pos = _mm_cvtsi32_si128(p.X_POS);
+  const __m128i y_pos = _mm_cvtsi32_si128(p.Y_POS);
+  const __m128i z_pos = _mm_cvtsi32_si128(p.Z_POS);
+
+  unsigned int i = 0;
+  for (; i + 32 <= num; i += 32) {
+    __m512i w = _mm512_loadu_si512((const void *)(source + i * 2));
+    __m512i u = _mm512_and_si512(w, lo8);
+    __m512i y1 = _mm512_and_si512(_mm512_srli_epi32(w, 8), lo8);
+    __m512i v = _mm512_and_si512(_mm512_srli_epi32(w, 16), lo8);
+    __m512i y2 = _mm512_srli_epi32(w, 24);
+    __m512i uv = _mm512_or_si512(_mm512_sll_epi32(_mm512_srl_epi32(u, y_shift), y_pos), _mm512_sll_epi32(_mm512_srl_epi32(v, z_shift), z_pos));
+    __m512i i1 = _mm512_or_si512(_mm512_sll_epi32(_mm512_srl_epi32(y1, x_shift), x_pos), uv);
+    __m512i i2 = _mm512_or_si512(_mm512_sll_epi32(_mm512_srl_epi32(y2, x_shift), x_pos), uv);
+    __m512i l1 = _mm512_and_si512(_mm512_i32gather_epi32(i1, (const void *)p.LUT, 1), lo8);
+    __m512i l2 = _mm512_and_si512(_mm512_i32gather_epi32(i2, (const void *)p.LUT, 1), lo8);
+    __m256i pixels = _mm512_cvtepi32_epi16(_mm512_or_si512(l1, _mm512_slli_epi32(l2, 8)));
+    __m256i m = _mm256_loadu_si256((const __m256i *)(mask + i));
+    _mm256_storeu_si256((__m256i *)(target + i), _mm256_and_si256(pixels, m));
   }
+  thresholdUYVYScalar(source, target, mask, i, num, p);
+}
 
-  register lut_mask_t * LUT = lut->getTable();
-  int source_size    = source->getNumPixels();
-  const rgb * source_pointer = (const rgb*)(source->getData());
-  auto * target_pointer = (uint8_t*) target->getPixelData();
-  auto * mask_pointer = mask->getData();
+__attribute__((target("avx512f,avx512bw")))
+void thresholdYUV444AVX512(const uint8_t * source, uint8_t * target, const uint8_t * mask,
+                           unsigned int num, const ThresholdParams & p) {
+  const __m512i shuffle = _mm512_broadcast_i32x4(_mm_set_epi8(CMV_YUV444_SHUFFLE));
+  const __m512i lo8 = _mm512_set1_epi32(0xFF);
+  const __m128i x_shift = _mm_cvtsi32_si128(p.X_SHIFT);
+  const __m128i y_shift = _mm_cvtsi32_si128(p.Y_SHIFT);
+  const __m128i z_shift = _mm_cvtsi32_si128(p.Z_SHIFT);
+  const __m128i x_pos = _mm_cvtsi32_si128(p.X_POS);
+  const __m128i y_pos = _mm_cvtsi32_si128(p.Y_POS);
+  const __m128i z_pos = _mm_cvtsi32_si128(p.Z_POS);
 
-  if (target->getNumPixels() != source->getNumPixels()) {
-    fprintf(stderr, "CMVision RGB thresholding: source (num=%d  w=%d  h=%d) and target (num=%d w=%d h=%d) pixel counts do not match!\n", source->getNumPixels(),source->getWidth(),source->getHeight(), target->getNumPixels(),target->getWidth(),target->getHeight());
-    return false;
+  unsigned int i = 0;
+  // the last load of an iteration reads 4 bytes beyond its 4 pixels
+  for (; (i + 16) * 3 + 4 <= num * 3; i += 16) {
+    const uint8_t * s = source + i * 3;
+    __m512i w = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i *)s));
+    w = _mm512_inserti32x4(w, _mm_loadu_si128((const __m128i *)(s + 12)), 1);
+    w = _mm512_inserti32x4(w, _mm_loadu_si128((const __m128i *)(s + 24)), 2);
+    w = _mm512_inserti32x4(w, _mm_loadu_si128((const __m128i *)(s + 36)), 3);
+    w = _mm512_shuffle_epi8(w, shuffle);
+    __m512i y = _mm512_and_si512(w, lo8);
+    __m512i u = _mm512_and_si512(_mm512_srli_epi32(w, 8), lo8);
+    __m512i v = _mm512_srli_epi32(w, 16);
+    __m512i index = _mm512_or_si512(_mm512_or_si512(_mm512_sll_epi32(_mm512_srl_epi32(y, x_shift), x_pos),
+                                                    _mm512_sll_epi32(_mm512_srl_epi32(u, y_shift), y_pos)),
+                                    _mm512_sll_epi32(_mm512_srl_epi32(v, z_shift), z_pos));
+    __m128i pixels = _mm512_cvtepi32_epi8(_mm512_i32gather_epi32(index, (const void *)p.LUT, 1));
+    __m128i m = _mm_loadu_si128((const __m128i *)(mask + i));
+    _mm_storeu_si128((__m128i *)(target + i), _mm_and_si128(pixels, m));
   }
+  thresholdYUV444Scalar(source, target, mask, i, num, p);
+}
+
+#pragma GCC diagnostic pop
+
+#undef CMV_YUV444_SHUFFLE
+
+#endif
 
-  int X_SHIFT=lut->X_SHIFT;
-  int Y_SHIFT=lut->Y_SHIFT;
-  int Z_SHIFT=lut->Z_SHIFT;
-  int Z_AND_Y_BITS=lut->Z_AND_Y_BITS;
-  int Z_BITS = lut->Z_BITS;
+void thresholdRGB(const uint8_t * source, uint8_t * target_pointer, const uint8_t * mask_pointer,
+                  unsigned int num, const ThresholdParams & params) {
+  const lut_mask_t * LUT = params.LUT;
+  int source_size = (int)num;
+  const rgb * source_pointer = (const rgb*)source;
+  int X_SHIFT=params.X_SHIFT;
+  int Y_SHIFT=params.Y_SHIFT;
+  int Z_SHIFT=params.Z_SHIFT;
+  int X_POS=params.X_POS;
+  int Y_POS=params.Y_POS;
+  int Z_POS=params.Z_POS;
 
 #ifdef __AVX2__
   // unpacking from: https://docs.google.com/presentation/d/1I0-SiHid1hTsv7tjLST2dYW5YF5AJVfs9l4Rg9rvz48/edit#slide=id.g1eefe20b_0_125
@@ -145,7 +340,8 @@ bool CMVisionThreshold::thresholdImageRGB(Image<raw8> * target, const ImageInter
   const rgb* p=&source_pointer[0];
   const uint8_t* source_pixel = (const uint8_t*)p;
 
-  for (int i=0; i<source_size; i+=16) {
+  int i=0;
+  for (; i+16<=source_size; i+=16) {
 
     // crazy RGB unpacking
     const __m128i chunk0 = _mm_loadu_si128((const __m128i*)(source_pixel));
@@ -166,9 +362,9 @@ bool CMVisionThreshold::thresholdImageRGB(Image<raw8> * target, const ImageInter
     __m256i g = _mm256_cvtepu8_epi16(green);
 
     // do the original shifts on 16 values in parallel
-    __m256i rs = _mm256_slli_epi16(_mm256_srli_epi16(r, X_SHIFT), Z_AND_Y_BITS);
-    __m256i gs = _mm256_slli_epi16(_mm256_srli_epi16(g, Y_SHIFT), Z_BITS);
-    __m256i bs = _mm256_srli_epi16(b, Z_SHIFT);
+    __m256i rs = _mm256_slli_epi16(_mm256_srli_epi16(r, X_SHIFT), X_POS);
+    __m256i gs = _mm256_slli_epi16(_mm256_srli_epi16(g, Y_SHIFT), Y_POS);
+    __m256i bs = _mm256_slli_epi16(_mm256_srli_epi16(b, Z_SHIFT), Z_POS);
 
     // construct LUT indices (ORing)
     __m256i result = _mm256_or_si256(rs, _mm256_or_si256(gs, bs));
@@ -177,16 +373,207 @@ bool CMVisionThreshold::thresholdImageRGB(Image<raw8> * target, const ImageInter
 
 #pragma GCC unroll 16
     for(int j=0; j<16; j++) {
-      target_pointer[i+j] = mask_pointer[i] & LUT[idx[j]];
+      target_pointer[i+j] = mask_pointer[i+j] & LUT[idx[j]];
     }
   }
 #else
+  int i=0;
+#endif
   #pragma GCC unroll 4
-  for (int i=0; i<source_size; i++) {
+  for (; i<source_size; i++) {
     rgb p=source_pointer[i];
-    target_pointer[i] = mask_pointer[i] & LUT[(((p.r >> X_SHIFT) << Z_AND_Y_BITS) | ((p.g >> Y_SHIFT) << Z_BITS) | (p.b >> Z_SHIFT))];
+    target_pointer[i] = mask_pointer[i] & LUT[(((p.r >> X_SHIFT) << X_POS) | ((p.g >> Y_SHIFT) << Y_POS) | ((p.b >> Z_SHIFT) << Z_POS))];
+  }
+}
+
+typedef void (*ThresholdKernel)(const uint8_t * source, uint8_t * target, const uint8_t * mask,
+                                unsigned int num, const ThresholdParams & p);
+
+void thresholdUYVYPlain(const uint8_t * source, uint8_t * target, const uint8_t * mask,
+                        unsigned int num, const ThresholdParams & p) {
+  thresholdUYVYScalar(source, target, mask, 0, num, p);
+}
+
+void thresholdYUV444Plain(const uint8_t * source, uint8_t * target, const uint8_t * mask,
+                          unsigned int num, const ThresholdParams & p) {
+  thresholdYUV444Scalar(source, target, mask, 0, num, p);
+}
+
+/// the instruction set the vector kernels are picked for, detected once at runtime
+CMVisionThreshold::InstructionSet detectInstructionSet() {
+#ifdef CMV_THRESHOLD_X86_DISPATCH
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) return CMVisionThreshold::ISA_AVX512;
+  if (__builtin_cpu_supports("avx2")) return CMVisionThreshold::ISA_AVX2;
+  if (__builtin_cpu_supports("sse4.1")) return CMVisionThreshold::ISA_SSE41;
+#endif
+  return CMVisionThreshold::ISA_SCALAR;
+}
+
+ThresholdKernel selectUYVYKernel(CMVisionThreshold::InstructionSet isa, const ThresholdParams & p) {
+#ifdef CMV_THRESHOLD_X86_DISPATCH
+  switch (isa) {
+    case CMVisionThreshold::ISA_AVX512:
+      return thresholdUYVYAVX512;
+    case CMVisionThreshold::ISA_AVX2:
+      return thresholdUYVYAVX2;
+    case CMVisionThreshold::ISA_SSE41:
+      // the SSE kernel collects the indices in 16 bit
+      return p.TOTAL_BITS <= 16 ? thresholdUYVYSSE41 : thresholdUYVYPlain;
+    default:
+      break;
   }
+#else
+  (void)isa;
+  (void)p;
+#endif
+  return thresholdUYVYPlain;
+}
+
+ThresholdKernel selectYUV444Kernel(CMVisionThreshold::InstructionSet isa, const ThresholdParams & p) {
+#ifdef CMV_THRESHOLD_X86_DISPATCH
+  switch (isa) {
+    case CMVisionThreshold::ISA_AVX512:
+      return thresholdYUV444AVX512;
+    case CMVisionThreshold::ISA_AVX2:
+      return thresholdYUV444AVX2;
+    case CMVisionThreshold::ISA_SSE41:
+      return p.TOTAL_BITS <= 16 ? thresholdYUV444SSE41 : thresholdYUV444Plain;
+    default:
+      break;
+  }
+#else
+  (void)isa;
+  (void)p;
 #endif
+  return thresholdYUV444Plain;
+}
+
+}
+
+CMVisionThreshold::InstructionSet CMVisionThreshold::instruction_set = detectInstructionSet();
+
+CMVisionThreshold::InstructionSet CMVisionThreshold::getInstructionSet() {
+  return instruction_set;
+}
+
+void CMVisionThreshold::setInstructionSet(InstructionSet isa) {
+  // never pick something the cpu can not execute
+  InstructionSet supported = detectInstructionSet();
+  instruction_set = isa < supported ? isa : supported;
+}
 
+const char * CMVisionThreshold::getInstructionSetName(InstructionSet isa) {
+  switch (isa) {
+    case ISA_AVX512:
+      return "avx512";
+    case ISA_AVX2:
+      return "avx2";
+    case ISA_SSE41:
+      return "sse4.1";
+    default:
+      return "scalar";
+  }
+}
+
+CMVisionThreshold::CMVisionThreshold()
+{
+}
+
+
+CMVisionThreshold::~CMVisionThreshold()
+{
+}
+
+bool CMVisionThreshold::thresholdImageYUV422_UYVY(Image<raw8> * target, const RawImage * source, YUVLUT * lut, const ImageInterface* mask) {
+  if (source->getColorFormat()!=COLOR_YUV422_UYVY) {
+    //TODO add YUV444 and maybe even 411 mode
+    fprintf(stderr,"CMVision thresholdImageYUV422_UYVY assumes YUV422 as input, but found %s\n", Colors::colorFormatToString(source->getColorFormat()).c_str());
+    return false;
+  }
+
+  if (target->getNumPixels() != source->getNumPixels()) {
+    fprintf(stderr, "CMVision YUV422_UYVY thresholding: source (num=%d  w=%d  h=%d) and target (num=%d w=%d h=%d) pixel counts do not match!\n", source->getNumPixels(),source->getWidth(),source->getHeight(), target->getNumPixels(),target->getWidth(),target->getHeight());
+    return false;
+  }
+
+  LUTReadGuard table(lut);
+  ThresholdParams p = getThresholdParams(table);
+  ThresholdKernel kernel = selectUYVYKernel(instruction_set, p);
+  kernel(source->getData(), (uint8_t *)target->getPixelData(), mask->getData(), target->getNumPixels(), p);
   return true;
 }
+
+bool CMVisionThreshold::thresholdImageYUV444(Image<raw8> * target, const ImageInterface * source, YUVLUT * lut, const ImageInterface* mask) {
+  if (source->getColorFormat()!=COLOR_YUV444) {
+    fprintf(stderr,"CMVision thresholdImageYUV444 assumes YUV444 as input, but found %s\n", Colors::colorFormatToString(source->getColorFormat()).c_str());
+    return false;
+  }
+
+  if (target->getNumPixels() != source->getNumPixels()) {
+     fprintf(stderr, "CMVision YUV444 thresholding: source (num=%d  w=%d  h=%d) and target (num=%d w=%d h=%d) pixel counts do not match!\n", source->getNumPixels(),source->getWidth(),source->getHeight(), target->getNumPixels(),target->getWidth(),target->getHeight());
+    return false;
+  }
+
+  LUTReadGuard table(lut);
+  ThresholdParams p = getThresholdParams(table);
+  ThresholdKernel kernel = selectYUV444Kernel(instruction_set, p);
+  kernel(source->getData(), (uint8_t *)target->getPixelData(), mask->getData(), target->getNumPixels(), p);
+
+  return true;
+}
+
+
+
+bool CMVisionThreshold::thresholdImageRGB(Image<raw8> * target, const ImageInterface * source, RGBLUT * lut, const ImageInterface* mask) {
+  if (source->getColorFormat()!=COLOR_RGB8) {
+    fprintf(stderr,"CMVision RGB thresholding assumes RGB8 as input, but found %s\n", Colors::colorFormatToString(source->getColorFormat()).c_str());
+    return false;
+  }
+
+  if (target->getNumPixels() != source->getNumPixels()) {
+    fprintf(stderr, "CMVision RGB thresholding: source (num=%d  w=%d  h=%d) and target (num=%d w=%d h=%d) pixel counts do not match!\n", source->getNumPixels(),source->getWidth(),source->getHeight(), target->getNumPixels(),target->getWidth(),target->getHeight());
+    return false;
+  }
+
+  LUTReadGuard table(lut);
+  thresholdRGB(source->getData(), (uint8_t *)target->getPixelData(), mask->getData(), target->getNumPixels(), getThresholdParams(table));
+  return true;
+}
+
+bool CMVisionThreshold::thresholdPixels(ColorFormat format, uint8_t * target, const uint8_t * source,
+                                        const LUTReadGuard & table, const uint8_t * mask, int num) {
+  ThresholdParams p = getThresholdParams(table);
+  if (format == COLOR_YUV422_UYVY) {
+    selectUYVYKernel(instruction_set, p)(source, target, mask, num, p);
+  } else if (format == COLOR_YUV444) {
+    selectYUV444Kernel(instruction_set, p)(source, target, mask, num, p);
+  } else if (format == COLOR_RGB8) {
+    thresholdRGB(source, target, mask, num, p);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool CMVisionThreshold::thresholdRow(ColorFormat format, uint8_t * target, const uint8_t * source,
+                                     const LUTReadGuard & table, const uint8_t * mask, int width, int begin, int end) {
+  int bytes_per_pixel;
+  if (format == COLOR_YUV422_UYVY) {
+    // pixel pairs share their chroma, so the span has to start and end on a pair
+    begin &= ~1;
+    end = std::min(width, (end + 1) & ~1);
+    bytes_per_pixel = 2;
+  } else if (format == COLOR_YUV444 || format == COLOR_RGB8) {
+    bytes_per_pixel = 3;
+  } else {
+    return false;
+  }
+  if (begin >= end) {
+    memset(target, 0, width);
+    return true;
+  }
+  memset(target, 0, begin);
+  memset(target + end, 0, width - end);
+  return thresholdPixels(format, target + begin, source + (long)begin * bytes_per_pixel, table, mask + begin, end - begin);
+}
@@ -38,9 +38,36 @@ public:
 
     ~CMVisionThreshold();
 
+  /// instruction sets the YUV thresholding (and run-length encoding) kernels are available for, in ascending order
+  enum InstructionSet {
+    ISA_SCALAR,
+    ISA_SSE41,
+    ISA_AVX2,
+    ISA_AVX512
+  };
+
+  /// the instruction set used for thresholding, by default the best one the cpu supports
+  static InstructionSet getInstructionSet();
+  /// restricts thresholding to \p isa, e.g. to compare the kernels. Sets beyond what the cpu supports are ignored.
+  static void setInstructionSet(InstructionSet isa);
+  static const char * getInstructionSetName(InstructionSet isa);
+
   static bool thresholdImageYUV422_UYVY(Image<raw8> * target, const RawImage * source, YUVLUT * lut, const ImageInterface* mask);
   static bool thresholdImageYUV444(Image<raw8> * target, const ImageInterface * source, YUVLUT * lut, const ImageInterface* mask);
   static bool thresholdImageRGB(Image<raw8> * target, const ImageInterface * source, RGBLUT * lut, const ImageInterface* mask);
+
+  /// thresholds \p num consecutive pixels, e.g. a single row, of a YUV422, YUV444 or RGB8 image
+  /// with the published table of a LUT. For RGB8 that has to be the derived RGB LUT. A single guard
+  /// can be shared by all threads working on a frame. Returns false for unsupported formats.
+  static bool thresholdPixels(ColorFormat format, uint8_t * target, const uint8_t * source,
+                              const LUTReadGuard & table, const uint8_t * mask, int num);
+  /// like thresholdPixels() for a row of \p width pixels, but only looks at the pixels [begin,end)
+  /// (e.g. the span of the image mask) and clears the rest of the row.
+  static bool thresholdRow(ColorFormat format, uint8_t * target, const uint8_t * source,
+                           const LUTReadGuard & table, const uint8_t * mask, int width, int begin, int end);
+
+private:
+  static InstructionSet instruction_set;
 };
 
 #endif
@@ -3,12 +3,16 @@
 #include <iostream>
 #include <algorithm>
 #include <limits>
+#include <stddef.h>
+#include <string.h>
+#include <thread>
 #include "field.h"
 #include "field_default_constants.h"
 #include "geomalgo.h"
+#include "worker_pool.h"
 
 CameraParameters::CameraParameters(int camera_index_, RoboCupField * field_) :
-        p_alpha(Eigen::VectorXd(1)) {
+        p_alpha(Eigen::VectorXd(1)), grid_calibration() {
   focal_length = new VarDouble("focal length", 500.0);
   principal_point_x = new VarDouble("principal point x", 390.0);
   principal_point_y = new VarDouble("principal point y", 290.0);
@@ -216,217 +220,665 @@ void CameraParameters::radialDistortion(
   pd = pd.norm(rd);
 }
 
-void CameraParameters::field2image(
-    const GVector::vector3d<double> &p_f,
-    GVector::vector2d<double> &p_i) const {
+void CameraCalibrationSnapshot::setRotation(const Quaternion<double> &q) {
+  quaternion[0] = q.x;
+  quaternion[1] = q.y;
+  quaternion[2] = q.z;
+  quaternion[3] = q.w;
+
+  // Same terms as Quaternion::rotateVectorByQuaternion()
+  Quaternion<double> q_inv = q;
+  q_inv.invert();
+  const Quaternion<double> *rotations[2] = {&q, &q_inv};
+  double (*matrices[2])[3] = {rotation, rotation_inv};
+  for (int i = 0; i < 2; i++) {
+    const Quaternion<double> &r = *rotations[i];
+    double (*m)[3] = matrices[i];
+    double x2 = r.x * r.x;
+    double y2 = r.y * r.y;
+    double z2 = r.z * r.z;
+    double xy = r.x * r.y;
+    double xz = r.x * r.z;
+    double yz = r.y * r.z;
+    double wx = r.w * r.x;
+    double wy = r.w * r.y;
+    double wz = r.w * r.z;
+    m[0][0] = 1.0 - 2.0 * (y2 + z2);
+    m[0][1] = 2.0 * (xy - wz);
+    m[0][2] = 2.0 * (xz + wy);
+    m[1][0] = 2.0 * (xy + wz);
+    m[1][1] = 1.0 - 2.0 * (x2 + z2);
+    m[1][2] = 2.0 * (yz - wx);
+    m[2][0] = 2.0 * (xz - wy);
+    m[2][1] = 2.0 * (yz + wx);
+    m[2][2] = 1.0 - 2.0 * (x2 + y2);
+  }
 
-  if(use_opencv_model->getBool()) {
-    cv::Mat src(1, 3, CV_64FC1);
-    cv::Mat dst(1, 2, CV_64FC1);
-    src.ptr<cv::Point3d>(0)->x = p_f.x;
-    src.ptr<cv::Point3d>(0)->y = p_f.y;
-    src.ptr<cv::Point3d>(0)->z = p_f.z;
-    cv::projectPoints(src, extrinsic_parameters->rvec, extrinsic_parameters->tvec, intrinsic_parameters->camera_mat, intrinsic_parameters->dist_coeffs, dst);
-    p_i.x = dst.at<double>(0);
-    p_i.y = dst.at<double>(1);
-  } else {
-    Quaternion<double> q_field2cam = Quaternion<double>(
-        q0->getDouble(),q1->getDouble(),q2->getDouble(),q3->getDouble());
-    q_field2cam.norm();
-    GVector::vector3d<double> translation = GVector::vector3d<double>(
-        tx->getDouble(),ty->getDouble(),tz->getDouble());
-
-    // First transform the point from the field into the coordinate system of the
-    // camera
-    GVector::vector3d<double> p_c =
-        q_field2cam.rotateVectorByQuaternion(p_f) + translation;
-    GVector::vector2d<double> p_un =
-        GVector::vector2d<double>(p_c.x/p_c.z, p_c.y/p_c.z);
-
-    // Apply distortion
-    GVector::vector2d<double> p_d;
-    radialDistortion(p_un,p_d);
-
-    // Then project from the camera coordinate system onto the image plane using
-    // the instrinsic parameters
-    p_i = focal_length->getDouble() * p_d +
-          GVector::vector2d<double>(principal_point_x->getDouble(),
-                                    principal_point_y->getDouble());
+  for (int i = 0; i < 3; i++) {
+    position[i] = rotation_inv[i][0] * (0.0 - translation[0]) +
+                  rotation_inv[i][1] * (0.0 - translation[1]) +
+                  rotation_inv[i][2] * (0.0 - translation[2]);
   }
 }
 
-void CameraParameters::field2image(
-    GVector::vector3d<double> &p_f, GVector::vector2d<double> &p_i,
-    Eigen::VectorXd &p) const {
-  Quaternion<double> q_field2cam = Quaternion<double>(
-      q0->getDouble(),q1->getDouble(),q2->getDouble(),q3->getDouble());
-  q_field2cam.norm();
-  GVector::vector3d<double> translation = GVector::vector3d<double>(
-      tx->getDouble(),ty->getDouble(),tz->getDouble());
+bool CameraCalibrationSnapshot::operator==(const CameraCalibrationSnapshot &other) const {
+  // all members behind the model flag are doubles, without padding in between
+  return opencv_model == other.opencv_model &&
+         memcmp(&focal_length_x, &other.focal_length_x,
+                sizeof(CameraCalibrationSnapshot) - offsetof(CameraCalibrationSnapshot, focal_length_x)) == 0;
+}
 
-  GVector::vector3d<double> aa_diff(p[Q_1], p[Q_2], p[Q_3]);
-  GVector::vector3d<double> t_diff(p[T_1], p[T_2], p[T_3]);
+// The projection kernels below are shared by the single point and the batch
+// versions; the batch versions only decide on the camera model once.
 
-  // Create a quaternion out of the 3D rotational representation
-  Quaternion<double> q_diff;
-  q_diff.setAxis(aa_diff.norm(), aa_diff.length());
+// Distorted radius of the legacy model, as CameraParameters::radialDistortion()
+// for a > DBL_MIN and ru > 0
+static inline double distortedRadius(double a, double ru) {
+  static const double c1 = pow(2.0 / 3.0, 1.0 / 3.0);
+  static const double c2 = pow(2.0 * 3.0 * 3.0, 1.0 / 3.0);
+  double b = -9.0*a*a*ru + a*sqrt(a*(12.0 + 81.0*a*ru*ru));
+  b = (b < 0.0) ? (-pow(b, 1.0 / 3.0)) : pow(b, 1.0 / 3.0);
+  return c1 / b - b / (c2 * a);
+}
 
+static inline void field2imageLegacy(
+    const CameraCalibrationSnapshot &s, const GVector::vector3d<double> &p_f,
+    GVector::vector2d<double> &p_i) {
   // First transform the point from the field into the coordinate system of the
   // camera
-  GVector::vector3d<double> p_c =
-      (q_diff * q_field2cam ).rotateVectorByQuaternion(p_f) + translation +
-      t_diff;
-  GVector::vector2d<double> p_un =
-      GVector::vector2d<double>(p_c.x/p_c.z, p_c.y/p_c.z);
-
-  // Apply distortion
-  GVector::vector2d<double> p_d;
-  radialDistortion(p_un,p_d,distortion->getDouble() + p[DIST]);
+  double x = s.rotation[0][0] * p_f.x + s.rotation[0][1] * p_f.y + s.rotation[0][2] * p_f.z + s.translation[0];
+  double y = s.rotation[1][0] * p_f.x + s.rotation[1][1] * p_f.y + s.rotation[1][2] * p_f.z + s.translation[1];
+  double z = s.rotation[2][0] * p_f.x + s.rotation[2][1] * p_f.y + s.rotation[2][2] * p_f.z + s.translation[2];
+  double un_x = x / z;
+  double un_y = y / z;
+
+  // Apply distortion, as CameraParameters::radialDistortion()
+  double ru = sqrt(un_x * un_x + un_y * un_y);
+  double d_x = un_x;
+  double d_y = un_y;
+  if (s.distortion > DBL_MIN && ru > 0.0) {
+    double f = distortedRadius(s.distortion, ru) / ru;
+    d_x = un_x * f;
+    d_y = un_y * f;
+  }
 
   // Then project from the camera coordinate system onto the image plane using
   // the instrinsic parameters
-  p_i = (focal_length->getDouble() + p[FOCAL_LENGTH]) * p_d +
-      GVector::vector2d<double>(principal_point_x->getDouble() + p[PP_X],
-                                principal_point_y->getDouble() + p[PP_Y]);
+  p_i.x = s.focal_length_x * d_x + s.principal_point_x;
+  p_i.y = s.focal_length_y * d_y + s.principal_point_y;
 }
 
-void CameraParameters::image2field(
-    GVector::vector3d<double> &p_f, const GVector::vector2d<double> &p_i,
-    double z) const {
-  if(use_opencv_model->getBool()) {
-    cv::Mat p_i_mat(3, 1, CV_64FC1);
+static inline void field2imageOpenCV(
+    const CameraCalibrationSnapshot &s, const GVector::vector3d<double> &p_f,
+    GVector::vector2d<double> &p_i) {
+  // Same model as cv::projectPoints() with five distortion coefficients
+  double x = s.rotation[0][0] * p_f.x + s.rotation[0][1] * p_f.y + s.rotation[0][2] * p_f.z + s.translation[0];
+  double y = s.rotation[1][0] * p_f.x + s.rotation[1][1] * p_f.y + s.rotation[1][2] * p_f.z + s.translation[1];
+  double z = s.rotation[2][0] * p_f.x + s.rotation[2][1] * p_f.y + s.rotation[2][2] * p_f.z + s.translation[2];
+  z = (z != 0.0) ? 1.0 / z : 1.0;
+  x *= z;
+  y *= z;
+
+  const double *k = s.dist_coeffs;
+  double r2 = x * x + y * y;
+  double r4 = r2 * r2;
+  double r6 = r4 * r2;
+  double a1 = 2.0 * x * y;
+  double a2 = r2 + 2.0 * x * x;
+  double a3 = r2 + 2.0 * y * y;
+  double cdist = 1.0 + k[0] * r2 + k[1] * r4 + k[4] * r6;
+  double d_x = x * cdist + k[2] * a1 + k[3] * a2;
+  double d_y = y * cdist + k[2] * a3 + k[3] * a1;
+
+  p_i.x = d_x * s.focal_length_x + s.principal_point_x;
+  p_i.y = d_y * s.focal_length_y + s.principal_point_y;
+}
 
-    p_i_mat.ptr<cv::Point3d>(0)->x = p_i.x;
-    p_i_mat.ptr<cv::Point3d>(0)->y = p_i.y;
-    p_i_mat.ptr<cv::Point3d>(0)->z = 1;
+static inline void image2fieldRay(
+    const CameraCalibrationSnapshot &s, double ray_x, double ray_y,
+    GVector::vector3d<double> &p_f, double z) {
+  // Transform the ray (ray_x, ray_y, 1) into world coordinates and intersect
+  // it with the plane at height z
+  double v_x = s.rotation_inv[0][0] * ray_x + s.rotation_inv[0][1] * ray_y + s.rotation_inv[0][2];
+  double v_y = s.rotation_inv[1][0] * ray_x + s.rotation_inv[1][1] * ray_y + s.rotation_inv[1][2];
+  double v_z = s.rotation_inv[2][0] * ray_x + s.rotation_inv[2][1] * ray_y + s.rotation_inv[2][2];
+  double t = (z - s.position[2]) / v_z;
+  p_f.x = s.position[0] + v_x * t;
+  p_f.y = s.position[1] + v_y * t;
+  p_f.z = z;
+}
 
-    /**
-     * Calculation is based on:
-     * https://stackoverflow.com/questions/12299870/computing-x-y-coordinate-3d-from-image-point
-     */
+static inline void image2fieldLegacy(
+    const CameraCalibrationSnapshot &s, const GVector::vector2d<double> &p_i,
+    GVector::vector3d<double> &p_f, double z) {
+  // Undo scaling and offset
+  double d_x = (p_i.x - s.principal_point_x) / s.focal_length_x;
+  double d_y = (p_i.y - s.principal_point_y) / s.focal_length_y;
+
+  // Compensate for distortion (undistort), the principal point stays put
+  double rd = sqrt(d_x * d_x + d_y * d_y);
+  if (rd > 0.0) {
+    double ru = rd * (1.0 + rd * rd * s.distortion);
+    double f = ru / rd;
+    d_x *= f;
+    d_y *= f;
+  }
+  image2fieldRay(s, d_x, d_y, p_f, z);
+}
 
-    const cv::Mat &tvec = extrinsic_parameters->tvec;
-    const cv::Mat &rotation_mat_inv = extrinsic_parameters->rotation_mat_inv;
-    const cv::Mat &camera_mat_inv = intrinsic_parameters->camera_mat_inv;
-    const cv::Mat &right_side_mat = extrinsic_parameters->right_side_mat;
-    const cv::Mat left_side_mat = rotation_mat_inv * camera_mat_inv * p_i_mat;
+static inline void image2fieldOpenCV(
+    const CameraCalibrationSnapshot &s, const GVector::vector2d<double> &p_i,
+    GVector::vector3d<double> &p_f, double z) {
+  /**
+   * Calculation is based on:
+   * https://stackoverflow.com/questions/12299870/computing-x-y-coordinate-3d-from-image-point
+   * Like before, the distortion coefficients are not applied here.
+   */
+  image2fieldRay(s, (p_i.x - s.principal_point_x) / s.focal_length_x,
+                 (p_i.y - s.principal_point_y) / s.focal_length_y, p_f, z);
+}
 
-    double right_side_mat_z = right_side_mat.at<double>(2, 0);
-    double left_side_mat_z = left_side_mat.at<double>(2, 0);
-    double s = (z + right_side_mat_z) / left_side_mat_z;
+void CameraCalibrationSnapshot::field2image(
+    const GVector::vector3d<double> &p_f, GVector::vector2d<double> &p_i) const {
+  if (opencv_model) {
+    field2imageOpenCV(*this, p_f, p_i);
+  } else {
+    field2imageLegacy(*this, p_f, p_i);
+  }
+}
 
-    cv::Mat p_f_mat = rotation_mat_inv * (s * camera_mat_inv * p_i_mat - tvec);
+void CameraCalibrationSnapshot::image2field(
+    GVector::vector3d<double> &p_f, const GVector::vector2d<double> &p_i,
+    double z) const {
+  if (opencv_model) {
+    image2fieldOpenCV(*this, p_i, p_f, z);
+  } else {
+    image2fieldLegacy(*this, p_i, p_f, z);
+  }
+}
 
-    p_f.x = p_f_mat.at<cv::Point3d>(0).x;
-    p_f.y = p_f_mat.at<cv::Point3d>(0).y;
-    p_f.z = p_f_mat.at<cv::Point3d>(0).z;
+void CameraCalibrationSnapshot::field2image(
+    int n, const GVector::vector3d<double> *p_f,
+    GVector::vector2d<double> *p_i) const {
+  if (opencv_model) {
+    for (int i = 0; i < n; i++) {
+      field2imageOpenCV(*this, p_f[i], p_i[i]);
+    }
   } else {
-    // Undo scaling and offset
-    GVector::vector2d<double> p_d(
-        (p_i.x - principal_point_x->getDouble()) / focal_length->getDouble(),
-        (p_i.y - principal_point_y->getDouble()) / focal_length->getDouble());
+    for (int i = 0; i < n; i++) {
+      field2imageLegacy(*this, p_f[i], p_i[i]);
+    }
+  }
+}
 
-    // Compensate for distortion (undistort)
-    GVector::vector2d<double> p_un;
-    radialDistortionInv(p_un, p_d);
+void CameraCalibrationSnapshot::image2field(
+    int n, const GVector::vector2d<double> *p_i,
+    GVector::vector3d<double> *p_f, double z) const {
+  if (opencv_model) {
+    for (int i = 0; i < n; i++) {
+      image2fieldOpenCV(*this, p_i[i], p_f[i], z);
+    }
+  } else {
+    for (int i = 0; i < n; i++) {
+      image2fieldLegacy(*this, p_i[i], p_f[i], z);
+    }
+  }
+}
 
-    // Now we got a ray on the z axis
-    GVector::vector3d<double> v(p_un.x, p_un.y, 1);
+void CameraParameters::getSnapshot(CameraCalibrationSnapshot &snapshot) const {
+  memset(&snapshot, 0, sizeof(CameraCalibrationSnapshot));
+  snapshot.opencv_model = use_opencv_model->getBool();
+  if (snapshot.opencv_model) {
+    const cv::Mat &camera_mat = intrinsic_parameters->camera_mat;
+    snapshot.focal_length_x = camera_mat.at<double>(0, 0);
+    snapshot.focal_length_y = camera_mat.at<double>(1, 1);
+    snapshot.principal_point_x = camera_mat.at<double>(0, 2);
+    snapshot.principal_point_y = camera_mat.at<double>(1, 2);
+    for (int i = 0; i < 5; i++) {
+      snapshot.dist_coeffs[i] = intrinsic_parameters->dist_coeffs.at<double>(i);
+    }
+
+    cv::Matx33d rotation_mat;
+    cv::Rodrigues(extrinsic_parameters->rvec, rotation_mat);
+    const cv::Mat &rotation_mat_inv = extrinsic_parameters->rotation_mat_inv;
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        snapshot.rotation[i][j] = rotation_mat(i, j);
+        snapshot.rotation_inv[i][j] = rotation_mat_inv.at<double>(i, j);
+      }
+      snapshot.translation[i] = extrinsic_parameters->tvec.at<double>(i);
+    }
+    for (int i = 0; i < 3; i++) {
+      snapshot.position[i] = -extrinsic_parameters->right_side_mat.at<double>(i, 0);
+    }
+  } else {
+    snapshot.focal_length_x = focal_length->getDouble();
+    snapshot.focal_length_y = snapshot.focal_length_x;
+    snapshot.principal_point_x = principal_point_x->getDouble();
+    snapshot.principal_point_y = principal_point_y->getDouble();
+    snapshot.distortion = distortion->getDouble();
+    snapshot.translation[0] = tx->getDouble();
+    snapshot.translation[1] = ty->getDouble();
+    snapshot.translation[2] = tz->getDouble();
 
-    // Transform this ray into world coordinates
     Quaternion<double> q_field2cam = Quaternion<double>(
         q0->getDouble(),q1->getDouble(),q2->getDouble(),q3->getDouble());
     q_field2cam.norm();
-    GVector::vector3d<double> translation =
-        GVector::vector3d<double>(tx->getDouble(),ty->getDouble(),tz->getDouble());
-
-    Quaternion<double> q_field2cam_inv = q_field2cam;
-    q_field2cam_inv.invert();
-    GVector::vector3d<double> v_in_w =
-        q_field2cam_inv.rotateVectorByQuaternion(v);
-    GVector::vector3d<double> zero_in_w =
-        q_field2cam_inv.rotateVectorByQuaternion(
-            GVector::vector3d<double>(0,0,0) - translation);
-
-    // Compute the the point where the rays intersects the field
-    double t = GVector::ray_plane_intersect(
-        GVector::vector3d<double>(0,0,z), GVector::vector3d<double>(0,0,1).norm(),
-        zero_in_w, v_in_w.norm());
-
-    // Set p_f
-    p_f = zero_in_w + v_in_w.norm() * t;
+    snapshot.setRotation(q_field2cam);
   }
 }
 
+void CameraParameters::applyCalibrationDelta(
+    CameraCalibrationSnapshot &snapshot, const Eigen::VectorXd &p) {
+  snapshot.focal_length_x += p[FOCAL_LENGTH];
+  snapshot.focal_length_y = snapshot.focal_length_x;
+  snapshot.principal_point_x += p[PP_X];
+  snapshot.principal_point_y += p[PP_Y];
+  snapshot.distortion += p[DIST];
+  snapshot.translation[0] += p[T_1];
+  snapshot.translation[1] += p[T_2];
+  snapshot.translation[2] += p[T_3];
 
-double CameraParameters::calc_chisqr(
-    std::vector<GVector::vector3d<double> > &p_f,
-    std::vector<GVector::vector2d<double> > &p_i, Eigen::VectorXd &p,
-    int cal_type) {
-  assert(p_f.size() == p_i.size());
+  // Create a quaternion out of the 3D rotational representation
+  GVector::vector3d<double> aa_diff(p[Q_1], p[Q_2], p[Q_3]);
+  Quaternion<double> q_diff;
+  q_diff.setAxis(aa_diff.norm(), aa_diff.length());
+  Quaternion<double> q_field2cam(
+      snapshot.quaternion[0], snapshot.quaternion[1],
+      snapshot.quaternion[2], snapshot.quaternion[3]);
+  snapshot.setRotation(q_diff * q_field2cam);
+}
+
+void CameraParameters::field2image(
+    const GVector::vector3d<double> &p_f,
+    GVector::vector2d<double> &p_i) const {
+  CameraCalibrationSnapshot snapshot;
+  getSnapshot(snapshot);
+  snapshot.field2image(p_f, p_i);
+}
+
+void CameraParameters::field2image(
+    GVector::vector3d<double> &p_f, GVector::vector2d<double> &p_i,
+    Eigen::VectorXd &p) const {
+  CameraCalibrationSnapshot snapshot;
+  getSnapshot(snapshot);
+  applyCalibrationDelta(snapshot, p);
+  snapshot.field2image(p_f, p_i);
+}
 
-  double cov_cx_inv =
-      1.0 / additional_calibration_information->cov_corner_x->getDouble();
-  double cov_cy_inv =
-      1.0 / additional_calibration_information->cov_corner_y->getDouble();
+void CameraParameters::image2field(
+    GVector::vector3d<double> &p_f, const GVector::vector2d<double> &p_i,
+    double z) const {
+  CameraCalibrationSnapshot snapshot;
+  getSnapshot(snapshot);
+  snapshot.image2field(p_f, p_i, z);
+}
 
-  double cov_lsx_inv =
-      1.0 / additional_calibration_information->cov_ls_x->getDouble();
-  double cov_lsy_inv =
-      1.0 / additional_calibration_information->cov_ls_y->getDouble();
+void CameraParameters::image2field(
+    int n, const GVector::vector2d<double> *p_i,
+    GVector::vector3d<double> *p_f, double z) const {
+  CameraCalibrationSnapshot snapshot;
+  getSnapshot(snapshot);
+  snapshot.image2field(n, p_i, p_f, z);
+}
 
-  double chisqr(0);
+std::shared_ptr<const ImageToFieldGrid> CameraParameters::getImageToFieldGrid(
+    double z, int width, int height) const {
+  CameraCalibrationSnapshot calibration;
+  getSnapshot(calibration);
+  return getImageToFieldGrid(calibration, z, width, height);
+}
 
-  // Iterate over manual points
-  auto it_p_f  = p_f.begin();
-  auto it_p_i  = p_i.begin();
+std::shared_ptr<const ImageToFieldGrid> CameraParameters::getImageToFieldGrid(
+    const CameraCalibrationSnapshot &calibration, double z, int width, int height) const {
+  // Heights are tunable settings, so only a few recent grids are kept
+  static const unsigned int max_grids = 8;
 
-  for (; it_p_f != p_f.end(); it_p_f++, it_p_i++)
-  {
-    GVector::vector2d<double> proj_p;
-    field2image(*it_p_f, proj_p, p);
-    chisqr += (proj_p.x - it_p_i->x) * (proj_p.x - it_p_i->x) * cov_cx_inv +
-        (proj_p.y - it_p_i->y) * (proj_p.y - it_p_i->y) * cov_cy_inv;
+  std::lock_guard<std::mutex> lock(grid_mutex);
+  if (calibration != grid_calibration) {
+    grids.clear();
+    grid_calibration = calibration;
+  }
+  for (const auto &grid : grids) {
+    if (grid->getHeight() == z && grid->getImageWidth() == width &&
+        grid->getImageHeight() == height) {
+      return grid;
+    }
+  }
+  if (grids.size() >= max_grids) {
+    grids.erase(grids.begin());
   }
+  grids.push_back(std::make_shared<const ImageToFieldGrid>(calibration, z, width, height));
+  return grids.back();
+}
 
-  // Iterate of line edge points, but only when performing a full estimation
-  if (cal_type & FULL_ESTIMATION)
-  {
-    auto ls_it = calibrationSegments.begin();
+ImageToFieldGrid::ImageToFieldGrid(
+    const CameraCalibrationSnapshot &calibration, double z_, int width_, int height_, int step) :
+        z(z_), width(width_), height(height_) {
+  step = std::max(step, 1);
+  cols = (std::max(width, 1) + step - 1) / step + 1;
+  rows = (std::max(height, 1) + step - 1) / step + 1;
+  inv_step = 1.0 / step;
+  nodes.resize(2 * cols * rows);
+
+  std::vector<GVector::vector2d<double> > p_i(cols);
+  std::vector<GVector::vector3d<double> > p_f(cols);
+  for (int r = 0; r < rows; r++) {
+    for (int c = 0; c < cols; c++) {
+      p_i[c].set(c * step, r * step);
+    }
+    calibration.image2field(cols, p_i.data(), p_f.data(), z);
+    float *row = &nodes[2 * r * cols];
+    for (int c = 0; c < cols; c++) {
+      row[2 * c] = (float)p_f[c].x;
+      row[2 * c + 1] = (float)p_f[c].y;
+    }
+  }
+}
 
-    int i = 0;
-    for (; ls_it != calibrationSegments.end(); ls_it++) {
-      auto imgPts_it = (*ls_it).points.begin();
-      for (; imgPts_it != (*ls_it).points.end(); imgPts_it++) {
-        // Integrate only if a valid point on line
-        if (imgPts_it->detected) {
-          GVector::vector2d<double> proj_p;
-          double alpha = p_alpha(i) + p(STATE_SPACE_DIMENSION + i);
-
-          // Calculate point on segment
-          GVector::vector3d<double> alpha_point;
-          if (ls_it->straightLine) {
-            alpha_point = alpha * (*ls_it).p1 + (1.0 - alpha) * (*ls_it).p2;
-          } else {
-            double theta = alpha * (*ls_it).theta1 + (1.0 - alpha) * (*ls_it).theta2;
-            alpha_point = ls_it->center +
-                ls_it->radius*GVector::vector3d<double>(
-                    cos(theta),sin(theta),0.0);
-          }
+namespace {
+
+// One term of the calibration error: a control point, or a detected edge
+// point on a field line or arc at the position given by its alpha
+struct CalibrationResidual {
+  const CameraParameters::CalibrationData * segment;
+  int alpha_index;
+  GVector::vector3d<double> p_f;
+  GVector::vector2d<double> p_i;
+};
+
+// residuals per task of the worker pool
+const int kResidualsPerTask = 64;
+
+void collectCalibrationResiduals(
+    const std::vector<GVector::vector3d<double> > &p_f,
+    const std::vector<GVector::vector2d<double> > &p_i,
+    const std::vector<CameraParameters::CalibrationData> &segments,
+    bool with_segments, std::vector<CalibrationResidual> &residuals) {
+  residuals.clear();
+  for (size_t k = 0; k < p_f.size(); k++) {
+    residuals.push_back({nullptr, -1, p_f[k], p_i[k]});
+  }
+  if (!with_segments) {
+    return;
+  }
+  int i = 0;
+  for (const auto &segment : segments) {
+    for (const auto &point : segment.points) {
+      if (point.detected) {
+        residuals.push_back({&segment, i++, GVector::vector3d<double>(0, 0, 0), point.img_point});
+      }
+    }
+  }
+}
+
+// Point on a line or arc segment at position alpha, and its derivative by alpha
+GVector::vector3d<double> pointOnSegment(
+    const CameraParameters::CalibrationData &segment, double alpha,
+    GVector::vector3d<double> *tangent) {
+  if (segment.straightLine) {
+    if (tangent != nullptr) {
+      *tangent = segment.p1 - segment.p2;
+    }
+    return alpha * segment.p1 + (1.0 - alpha) * segment.p2;
+  }
+  double theta = alpha * segment.theta1 + (1.0 - alpha) * segment.theta2;
+  if (tangent != nullptr) {
+    *tangent = (segment.radius * (segment.theta1 - segment.theta2)) *
+        GVector::vector3d<double>(-sin(theta), cos(theta), 0.0);
+  }
+  return segment.center + segment.radius * GVector::vector3d<double>(cos(theta), sin(theta), 0.0);
+}
+
+// field2image of the legacy model, together with its derivatives by the
+// calibration changes p of CameraParameters::applyCalibrationDelta() at p = 0
+// and by the field point
+void field2imageJacobian(
+    const CameraCalibrationSnapshot &s, const GVector::vector3d<double> &p_f,
+    GVector::vector2d<double> &p_i,
+    double j_p[2][CameraParameters::STATE_SPACE_DIMENSION], double j_f[2][3]) {
+  // rotated point and point in camera coordinates
+  double u[3], c[3];
+  for (int k = 0; k < 3; k++) {
+    u[k] = s.rotation[k][0] * p_f.x + s.rotation[k][1] * p_f.y + s.rotation[k][2] * p_f.z;
+    c[k] = u[k] + s.translation[k];
+  }
+  double iz = 1.0 / c[2];
+  double x = c[0] * iz;
+  double y = c[1] * iz;
+
+  // distortion: ru = rd * (1 + a * rd^2), image point = f * (rd / ru) * (x, y) + pp
+  double a = s.distortion;
+  double ru = sqrt(x * x + y * y);
+  double scale = 1.0;
+  double dscale_dru = 0.0;
+  double dscale_da = (a >= 0.0) ? -ru * ru : 0.0;
+  if (a > DBL_MIN && ru > 0.0) {
+    double rd = distortedRadius(a, ru);
+    double drd_dru = 1.0 / (1.0 + 3.0 * a * rd * rd);
+    scale = rd / ru;
+    dscale_dru = (drd_dru - scale) / ru;
+    dscale_da = -rd * rd * rd * drd_dru / ru;
+  }
+  double d_x = scale * x;
+  double d_y = scale * y;
+  p_i.x = s.focal_length_x * d_x + s.principal_point_x;
+  p_i.y = s.focal_length_y * d_y + s.principal_point_y;
+
+  // derivative of the image point by (x, y)
+  double m[2][2];
+  double gx = (ru > 0.0) ? dscale_dru * x / ru : 0.0;
+  double gy = (ru > 0.0) ? dscale_dru * y / ru : 0.0;
+  m[0][0] = s.focal_length_x * (scale + x * gx);
+  m[0][1] = s.focal_length_x * (x * gy);
+  m[1][0] = s.focal_length_y * (y * gx);
+  m[1][1] = s.focal_length_y * (scale + y * gy);
+
+  // derivative of the image point by the point in camera coordinates
+  double g[2][3];
+  for (int r = 0; r < 2; r++) {
+    g[r][0] = m[r][0] * iz;
+    g[r][1] = m[r][1] * iz;
+    g[r][2] = -(m[r][0] * x + m[r][1] * y) * iz;
+  }
+
+  j_p[0][CameraParameters::FOCAL_LENGTH] = d_x;
+  j_p[1][CameraParameters::FOCAL_LENGTH] = d_y;
+  j_p[0][CameraParameters::PP_X] = 1.0;
+  j_p[1][CameraParameters::PP_X] = 0.0;
+  j_p[0][CameraParameters::PP_Y] = 0.0;
+  j_p[1][CameraParameters::PP_Y] = 1.0;
+  j_p[0][CameraParameters::DIST] = s.focal_length_x * x * dscale_da;
+  j_p[1][CameraParameters::DIST] = s.focal_length_y * y * dscale_da;
+  for (int r = 0; r < 2; r++) {
+    for (int k = 0; k < 3; k++) {
+      j_f[r][k] = g[r][0] * s.rotation[0][k] + g[r][1] * s.rotation[1][k] + g[r][2] * s.rotation[2][k];
+    }
+    // q_diff * q rotates the field point by q_diff first, so a small rotation
+    // w moves the point in field coordinates by w x p_f
+    j_p[r][CameraParameters::Q_1] = j_f[r][2] * p_f.y - j_f[r][1] * p_f.z;
+    j_p[r][CameraParameters::Q_2] = j_f[r][0] * p_f.z - j_f[r][2] * p_f.x;
+    j_p[r][CameraParameters::Q_3] = j_f[r][1] * p_f.x - j_f[r][0] * p_f.y;
+    j_p[r][CameraParameters::T_1] = g[r][0];
+    j_p[r][CameraParameters::T_2] = g[r][1];
+    j_p[r][CameraParameters::T_3] = g[r][2];
+  }
+}
 
-          // Project into image plane
-          field2image(alpha_point, proj_p, p);
+// Weighted squared error of the residuals [begin, end)
+double sumCalibrationError(
+    const std::vector<CalibrationResidual> &residuals, int begin, int end,
+    const CameraCalibrationSnapshot &calibration,
+    const Eigen::VectorXd &p_alpha, const Eigen::VectorXd &p,
+    const double weights[4]) {
+  double chisqr(0);
+  for (int k = begin; k < end; k++) {
+    const CalibrationResidual &r = residuals[k];
+    GVector::vector2d<double> proj_p;
+    const double *w = weights;
+    if (r.segment == nullptr) {
+      calibration.field2image(r.p_f, proj_p);
+    } else {
+      double alpha = p_alpha(r.alpha_index) +
+          p(CameraParameters::STATE_SPACE_DIMENSION + r.alpha_index);
+      calibration.field2image(pointOnSegment(*r.segment, alpha, nullptr), proj_p);
+      w = weights + 2;
+    }
+    chisqr += (proj_p.x - r.p_i.x) * (proj_p.x - r.p_i.x) * w[0] +
+        (proj_p.y - r.p_i.y) * (proj_p.y - r.p_i.y) * w[1];
+  }
+  return chisqr;
+}
+
+// chisqr of CameraParameters::calc_chisqr(), summed in a fixed order of chunks
+double calcCalibrationError(
+    const std::vector<CalibrationResidual> &residuals,
+    const CameraCalibrationSnapshot &calibration,
+    const Eigen::VectorXd &p_alpha, const Eigen::VectorXd &p,
+    const double weights[4], WorkerPool *pool) {
+  int n = (int)residuals.size();
+  int num_tasks = (n + kResidualsPerTask - 1) / kResidualsPerTask;
+  std::vector<double> sums(num_tasks);
+  auto task = [&](int t) {
+    sums[t] = sumCalibrationError(residuals, t * kResidualsPerTask,
+                                  std::min(n, (t + 1) * kResidualsPerTask),
+                                  calibration, p_alpha, p, weights);
+  };
+  if (pool != nullptr) {
+    pool->run(num_tasks, task);
+  } else {
+    for (int t = 0; t < num_tasks; t++) task(t);
+  }
+  double chisqr(0);
+  for (double sum : sums) chisqr += sum;
+  return chisqr;
+}
+
+// Normal equations J^T W J and J^T W e of the calibration residuals. Each
+// alpha belongs to a single residual, so its part of J^T W J is stored as one
+// column against the camera parameters plus one diagonal entry.
+struct CalibrationNormalEquations {
+  static const int N = CameraParameters::STATE_SPACE_DIMENSION;
+  typedef Eigen::Matrix<double, N, N> Matrix;
+  typedef Eigen::Matrix<double, N, 1> Vector;
+
+  Matrix a_pp;
+  Vector b_p;
+  std::vector<Vector> a_p_alpha;
+  std::vector<double> a_alpha;
+  std::vector<double> b_alpha;
+
+  void build(const std::vector<CalibrationResidual> &residuals,
+             const CameraCalibrationSnapshot &calibration,
+             const Eigen::VectorXd &p_alpha, int num_alpha, const bool estimated[N],
+             const double weights[4], WorkerPool *pool) {
+    int n = (int)residuals.size();
+    int num_tasks = (n + kResidualsPerTask - 1) / kResidualsPerTask;
+    // p_alpha keeps the alphas of the last full estimation, only the first
+    // num_alpha of them are estimated now (none for the four point calibration)
+    a_p_alpha.assign(num_alpha, Vector::Zero());
+    a_alpha.assign(num_alpha, 0.0);
+    b_alpha.assign(num_alpha, 0.0);
+    std::vector<Matrix> task_a(num_tasks);
+    std::vector<Vector> task_b(num_tasks);
+
+    auto task = [&](int t) {
+      Matrix a = Matrix::Zero();
+      Vector b = Vector::Zero();
+      int end = std::min(n, (t + 1) * kResidualsPerTask);
+      for (int k = t * kResidualsPerTask; k < end; k++) {
+        const CalibrationResidual &r = residuals[k];
+        GVector::vector3d<double> tangent;
+        GVector::vector3d<double> point = r.segment == nullptr ? r.p_f :
+            pointOnSegment(*r.segment, p_alpha(r.alpha_index), &tangent);
+        const double *w = r.segment == nullptr ? weights : weights + 2;
 
-          chisqr += (proj_p.x-imgPts_it->img_point.x) *
-              (proj_p.x-imgPts_it->img_point.x) * cov_lsx_inv +
-              (proj_p.y - imgPts_it->img_point.y) *
-              (proj_p.y - imgPts_it->img_point.y) * cov_lsy_inv;
-          i++;
+        GVector::vector2d<double> proj_p;
+        double j_p[2][N];
+        double j_f[2][3];
+        field2imageJacobian(calibration, point, proj_p, j_p, j_f);
+        Eigen::Matrix<double, 2, N> J;
+        for (int i = 0; i < N; i++) {
+          J(0, i) = estimated[i] ? j_p[0][i] : 0.0;
+          J(1, i) = estimated[i] ? j_p[1][i] : 0.0;
+        }
+        Eigen::Vector2d e(proj_p.x - r.p_i.x, proj_p.y - r.p_i.y);
+        Eigen::Vector2d w_e(w[0] * e(0), w[1] * e(1));
+        Eigen::Matrix<double, N, 2> jt_w = J.transpose();
+        jt_w.col(0) *= w[0];
+        jt_w.col(1) *= w[1];
+        a += jt_w * J;
+        b += J.transpose() * w_e;
+
+        if (r.segment != nullptr) {
+          Eigen::Vector2d j_alpha(
+              j_f[0][0] * tangent.x + j_f[0][1] * tangent.y + j_f[0][2] * tangent.z,
+              j_f[1][0] * tangent.x + j_f[1][1] * tangent.y + j_f[1][2] * tangent.z);
+          a_p_alpha[r.alpha_index] = jt_w * j_alpha;
+          a_alpha[r.alpha_index] = w[0] * j_alpha(0) * j_alpha(0) + w[1] * j_alpha(1) * j_alpha(1);
+          b_alpha[r.alpha_index] = j_alpha.dot(w_e);
         }
       }
+      task_a[t] = a;
+      task_b[t] = b;
+    };
+    if (pool != nullptr) {
+      pool->run(num_tasks, task);
+    } else {
+      for (int t = 0; t < num_tasks; t++) task(t);
+    }
+
+    a_pp.setZero();
+    b_p.setZero();
+    for (int t = 0; t < num_tasks; t++) {
+      a_pp += task_a[t];
+      b_p += task_b[t];
     }
   }
-  return chisqr;
+
+  // Solves (J^T W J + lambda I) new_p = -J^T W e. The alphas are eliminated
+  // first (Schur complement), which leaves a system of only N unknowns.
+  void solve(double lambda, Eigen::VectorXd &new_p) const {
+    int num_alpha = (int)a_alpha.size();
+    Matrix s = a_pp + Matrix::Identity() * lambda;
+    Vector g = b_p;
+    for (int i = 0; i < num_alpha; i++) {
+      double d = a_alpha[i] + lambda;
+      s -= a_p_alpha[i] * a_p_alpha[i].transpose() / d;
+      g -= a_p_alpha[i] * (b_alpha[i] / d);
+    }
+    Vector dp = s.llt().solve(-g);
+
+    new_p.resize(N + num_alpha);
+    new_p.head(N) = dp;
+    for (int i = 0; i < num_alpha; i++) {
+      new_p(N + i) = (-b_alpha[i] - a_p_alpha[i].dot(dp)) / (a_alpha[i] + lambda);
+    }
+  }
+};
+
+}
+
+double CameraParameters::calc_chisqr(
+    std::vector<GVector::vector3d<double> > &p_f,
+    std::vector<GVector::vector2d<double> > &p_i, Eigen::VectorXd &p,
+    int cal_type) {
+  assert(p_f.size() == p_i.size());
+
+  const double weights[4] = {
+      1.0 / additional_calibration_information->cov_corner_x->getDouble(),
+      1.0 / additional_calibration_information->cov_corner_y->getDouble(),
+      1.0 / additional_calibration_information->cov_ls_x->getDouble(),
+      1.0 / additional_calibration_information->cov_ls_y->getDouble()};
+
+  std::vector<CalibrationResidual> residuals;
+  collectCalibrationResiduals(p_f, p_i, calibrationSegments,
+                              (cal_type & FULL_ESTIMATION) != 0, residuals);
+
+  CameraCalibrationSnapshot calibration;
+  getSnapshot(calibration);
+  applyCalibrationDelta(calibration, p);
+  return calcCalibrationError(residuals, calibration, p_alpha, p, weights, nullptr);
 }
 
 double CameraParameters::do_calibration(int cal_type) {
@@ -459,14 +911,14 @@ double CameraParameters::do_calibration(int cal_type) {
 
 double CameraParameters::calculateFourPointRmse(std::vector<GVector::vector3d<double> > &p_f,
                                                 std::vector<GVector::vector2d<double> > &p_i) const {
+  CameraCalibrationSnapshot calibration;
+  getSnapshot(calibration);
   auto it_p_f  = p_f.begin();
   auto it_p_i  = p_i.begin();
   double sum = 0;
   for (; it_p_f != p_f.end(); it_p_f++, it_p_i++) {
     GVector::vector2d<double> proj_p;
-    field2image(*it_p_f, proj_p);
-    GVector::vector3d<double> some_point;
-    image2field(some_point,proj_p, 0);
+    calibration.field2image(*it_p_f, proj_p);
 
     double diff_x = proj_p.x - it_p_i->x;
     double diff_y = proj_p.y - it_p_i->y;
@@ -476,6 +928,8 @@ double CameraParameters::calculateFourPointRmse(std::vector<GVector::vector3d<do
 }
 
 void CameraParameters::updateCalibrationDataPoints() {
+  CameraCalibrationSnapshot calibration;
+  getSnapshot(calibration);
   for (auto & segment : calibrationSegments) {
     if (!segment.straightLine) {
       continue;
@@ -483,7 +937,7 @@ void CameraParameters::updateCalibrationDataPoints() {
 
     for (auto & imgPt : segment.points) {
       if (imgPt.detected) {
-        image2field(imgPt.world_point, imgPt.img_point, 0.0);
+        calibration.image2field(imgPt.world_point, imgPt.img_point, 0.0);
 
         GVector::vector2d<double> line0(segment.p1.x, segment.p1.y);
         GVector::vector2d<double> line1(segment.p2.x, segment.p2.y);
@@ -491,7 +945,7 @@ void CameraParameters::updateCalibrationDataPoints() {
         GVector::vector2d<double> closestPoint = GVector::closest_point_on_line(line0, line1, point);
         imgPt.world_closestPointToSegment.x = closestPoint.x;
         imgPt.world_closestPointToSegment.y = closestPoint.y;
-        field2image(imgPt.world_closestPointToSegment, imgPt.img_closestPointToSegment);
+        calibration.field2image(imgPt.world_closestPointToSegment, imgPt.img_closestPointToSegment);
       }
     }
   }
@@ -837,157 +1291,60 @@ void CameraParameters::calibrate(
   Eigen::VectorXd p(STATE_SPACE_DIMENSION + num_alpha);
   p.setZero();
 
+  const double weights[4] = {
+      1.0 / additional_calibration_information->cov_corner_x->getDouble(),
+      1.0 / additional_calibration_information->cov_corner_y->getDouble(),
+      1.0 / additional_calibration_information->cov_ls_x->getDouble(),
+      1.0 / additional_calibration_information->cov_ls_y->getDouble()};
+
+  bool estimated[STATE_SPACE_DIMENSION] = {};
+  for (int i : p_to_est) {
+    estimated[i] = true;
+  }
+
+  std::vector<CalibrationResidual> residuals;
+  collectCalibrationResiduals(p_f, p_i, calibrationSegments,
+                              (cal_type & FULL_ESTIMATION) != 0, residuals);
+
+  // Residuals are evaluated in parallel once there are enough of them
+  WorkerPool * pool = 0;
+  int num_cpus = (int)std::thread::hardware_concurrency();
+  if (num_cpus > 1 && (int)residuals.size() > kResidualsPerTask) {
+    pool = new WorkerPool(num_cpus - 1);
+  }
+
   // Calculate first chisqr for all points using the start parameters
-  double old_chisqr = calc_chisqr(p_f, p_i, p, cal_type);
+  CameraCalibrationSnapshot calibration;
+  getSnapshot(calibration);
+  double old_chisqr = calcCalibrationError(residuals, calibration, p_alpha, p, weights, pool);
 
 #ifndef NDEBUG
   std::cerr << "Chi-square: "<< old_chisqr << std::endl;
 #endif
 
-  // Create and fill corner measurement covariance matrix
-  Eigen::Matrix2d cov_corner_inv;
-  cov_corner_inv <<
-      1 / additional_calibration_information->cov_corner_x->getDouble(), 0 , 0 ,
-      1 / additional_calibration_information->cov_corner_y->getDouble();
-
-  // Create and fill line segment measurement covariance matrix
-  Eigen::Matrix2d cov_ls_inv;
-  cov_ls_inv << 1 / additional_calibration_information->cov_ls_x->getDouble(),
-      0 , 0 , 1 / additional_calibration_information->cov_ls_y->getDouble();
-
-  // Matrices for A, b and the Jacobian J
-  Eigen::MatrixXd alpha(STATE_SPACE_DIMENSION + num_alpha,
-                        STATE_SPACE_DIMENSION + num_alpha);
-  Eigen::VectorXd beta(STATE_SPACE_DIMENSION + num_alpha, 1);
-  Eigen::MatrixXd J(2, STATE_SPACE_DIMENSION + num_alpha);
+  CalibrationNormalEquations normal_equations;
+  Eigen::VectorXd new_p(STATE_SPACE_DIMENSION + num_alpha);
 
   bool stop_optimization(false);
   int convergence_counter(0);
+  int iteration(0);
   double t_start=GetTimeSec();
   while (!stop_optimization) {
-    // Calculate Jacobi-Matrix, alpha and beta
-    // Iterate over alle point pairs
-    auto it_p_f  = p_f.begin();
-    auto it_p_i  = p_i.begin();
-
-    double epsilon = sqrt(std::numeric_limits<double>::epsilon());
+    double t_iteration=GetTimeSec();
 
-    alpha.setZero();
-    beta.setZero();
-
-    for (; it_p_f != p_f.end(); it_p_f++, it_p_i++) {
-      J.setZero();
-
-      GVector::vector2d<double> proj_p;
-      field2image(*it_p_f, proj_p, p);
-      proj_p = proj_p - *it_p_i;
-
-      auto it = p_to_est.begin();
-      for (; it != p_to_est.end(); it++) {
-        int i = *it;
-
-        Eigen::VectorXd p_diff = p;
-        p_diff(i) = p_diff(i) + epsilon;
-
-        GVector::vector2d<double> proj_p_diff;
-        field2image(*it_p_f, proj_p_diff, p_diff);
-        J(0,i) = ((proj_p_diff.x - (*it_p_i).x) - proj_p.x) / epsilon;
-        J(1,i) = ((proj_p_diff.y - (*it_p_i).y) - proj_p.y) / epsilon;
-      }
-
-      alpha += J.transpose() * cov_corner_inv * J;
-      beta += J.transpose() * cov_corner_inv *
-          Eigen::Vector2d(proj_p.x, proj_p.y);
-    }
-
-    if (cal_type & FULL_ESTIMATION) {
-      // First, calculate how many alpha we need to estimate
-      auto ls_it = calibrationSegments.begin();
-
-      int i = 0;
-      for (; ls_it != calibrationSegments.end(); ls_it++) {
-        auto pts_it = (*ls_it).points.begin();
-        for (; pts_it != (*ls_it).points.end(); pts_it++) {
-          if (pts_it->detected) {
-            GVector::vector2d<double> proj_p;
-            GVector::vector3d<double >alpha_point;
-            if (ls_it->straightLine) {
-              alpha_point = p_alpha(i) * (*ls_it).p1 + (1 - p_alpha(i)) * (*ls_it).p2;
-            } else {
-              double theta = p_alpha(i) * (*ls_it).theta1 + (1.0 - p_alpha(i)) * (*ls_it).theta2;
-              alpha_point = ls_it->center + ls_it->radius*GVector::vector3d<double>(cos(theta),sin(theta),0.0);
-            }
-            field2image(alpha_point, proj_p, p);
-            proj_p = proj_p - (*pts_it).img_point;
-
-            J.setZero();
-
-            auto it = p_to_est.begin();
-            for (; it != p_to_est.end(); it++) {
-              int j = *it;
-              Eigen::VectorXd p_diff = p;
-              p_diff(j) = p_diff(j) + epsilon;
-              GVector::vector2d<double> proj_p_diff;
-              field2image(alpha_point, proj_p_diff, p_diff);
-              J(0,j) = ((proj_p_diff.x - (*pts_it).img_point.x) - proj_p.x) /
-                  epsilon;
-              J(1,j) = ((proj_p_diff.y - (*pts_it).img_point.y) - proj_p.y) /
-                  epsilon;
-            }
-
-            double my_alpha = p_alpha(i) + epsilon;
-            if (ls_it->straightLine) {
-              alpha_point = my_alpha * (*ls_it).p1 + (1 - my_alpha) *
-                  (*ls_it).p2;
-            } else {
-              double theta = my_alpha * (*ls_it).theta1 + (1.0 - my_alpha) *
-                  (*ls_it).theta2;
-              alpha_point = ls_it->center +
-                  ls_it->radius*GVector::vector3d<double>(cos(theta),
-                                                          sin(theta),0.0);
-            }
-
-
-            GVector::vector2d<double> proj_p_diff;
-            field2image(alpha_point, proj_p_diff);
-            J(0,STATE_SPACE_DIMENSION + i) =
-                ((proj_p_diff.x - (*pts_it).img_point.x) - proj_p.x) / epsilon;
-            J(1,STATE_SPACE_DIMENSION + i) =
-                ((proj_p_diff.y - (*pts_it).img_point.y) - proj_p.y) / epsilon;
-
-            alpha += J.transpose() * cov_ls_inv * J;
-            beta += J.transpose() * cov_ls_inv *
-                Eigen::Vector2d(proj_p.x, proj_p.y);
-            i++;
-          }
-        }
-      }
-    }
-
-    // Augment alpha
-    alpha += Eigen::MatrixXd::Identity(
-        STATE_SPACE_DIMENSION + num_alpha, STATE_SPACE_DIMENSION + num_alpha)
-        * lambda;
-
-    // Solve for x
-    Eigen::VectorXd new_p(STATE_SPACE_DIMENSION + num_alpha);
-
-    // Due to an API change we need to check for
-    // the right call at compile time
-#ifdef EIGEN_WORLD_VERSION
-    // alpha.llt().solve(-beta, &new_p); -- modify 1/15/16
-    //  -- move to Eigen3 structure -
-    //  -- http://eigen.tuxfamily.org/dox/Eigen2ToEigen3.html
-    new_p = alpha.llt().solve(-beta);
-#else
-    Eigen::Cholesky<Eigen::MatrixXd> c(alpha);
-    new_p = c.solve(-beta);
-#endif
+    // Set up the normal equations with the analytic Jacobian at the current
+    // calibration and solve them
+    getSnapshot(calibration);
+    normal_equations.build(residuals, calibration, p_alpha, num_alpha, estimated, weights, pool);
+    normal_equations.solve(lambda, new_p);
 
     // Calculate chisqr again
-    double chisqr = calc_chisqr(p_f, p_i, new_p, cal_type);
+    CameraCalibrationSnapshot new_calibration = calibration;
+    applyCalibrationDelta(new_calibration, new_p);
+    double chisqr = calcCalibrationError(residuals, new_calibration, p_alpha, new_p, weights, pool);
+    bool accepted = chisqr < old_chisqr;
 
-    if (chisqr < old_chisqr) {
+    if (accepted) {
       focal_length->setDouble(focal_length->getDouble() + new_p[FOCAL_LENGTH]);
       principal_point_x->setDouble(
           principal_point_x->getDouble() + new_p[PP_X]);
@@ -1032,18 +1389,25 @@ void CameraParameters::calibrate(
       }
 
       old_chisqr = chisqr;
-#ifndef NDEBUG
-      std::cerr << "Chi-square: "<< old_chisqr << std::endl;
-#endif
     } else {
       lambda *= 10;
       if (convergence_counter++ > 10) stop_optimization = true;
     }
+
+    std::cout << "Calibration iteration " << ++iteration
+              << ": chi-square " << chisqr << (accepted ? "" : " (rejected)")
+              << ", lambda " << lambda
+              << ", " << (GetTimeSec() - t_iteration) * 1000.0 << " ms" << std::endl;
+
     if ((GetTimeSec() - t_start) >
         additional_calibration_information->convergence_timeout->getDouble()) {
       stop_optimization=true;
     }
   }
+  std::cout << "Calibration of " << residuals.size() << " points took "
+            << iteration << " iterations, "
+            << (GetTimeSec() - t_start) * 1000.0 << " ms" << std::endl;
+  delete pool;
 
 // Debug output starts here
 #ifndef NDEBUG
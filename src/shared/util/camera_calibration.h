@@ -28,12 +28,62 @@
 
 #include <Eigen/Core>
 #include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include "camera_parameters.h"
 #include "field.h"
 #include "messages_robocup_ssl_geometry.pb.h"
 #include "timer.h"
 
+class ImageToFieldGrid;
+
+/*!
+  \struct CameraCalibrationSnapshot
+
+  \brief Plain copy of the calibration of one camera.
+
+  Both camera models are stored the same way: intrinsics, a distortion
+  model and the rigid transform between field and camera. Projecting
+  through a snapshot neither takes the locks of the VarTypes nor
+  allocates. Take one per frame with CameraParameters::getSnapshot();
+  later changes of the calibration are not reflected.
+**/
+struct CameraCalibrationSnapshot {
+  bool opencv_model;
+
+  double focal_length_x;
+  double focal_length_y;
+  double principal_point_x;
+  double principal_point_y;
+  // radial distortion of the legacy model, see CameraParameters::radialDistortion()
+  double distortion;
+  // k1, k2, p1, p2, k3 of the OpenCV model
+  double dist_coeffs[5];
+
+  // rotation of the legacy model as normalized quaternion (x, y, z, w)
+  double quaternion[4];
+  // field to camera coordinates: p_c = rotation * p_f + translation
+  double rotation[3][3];
+  double translation[3];
+  // camera to field coordinates
+  double rotation_inv[3][3];
+  double position[3];
+
+  void field2image(const GVector::vector3d<double>& p_f, GVector::vector2d<double>& p_i) const;
+  void image2field(GVector::vector3d<double>& p_f, const GVector::vector2d<double>& p_i, double z) const;
+  void field2image(int n, const GVector::vector3d<double>* p_f, GVector::vector2d<double>* p_i) const;
+  void image2field(int n, const GVector::vector2d<double>* p_i, GVector::vector3d<double>* p_f, double z) const;
+
+  /** set the rotation of the legacy model, and everything derived from it */
+  void setRotation(const Quaternion<double>& q);
+
+  bool operator==(const CameraCalibrationSnapshot& other) const;
+  bool operator!=(const CameraCalibrationSnapshot& other) const { return !(*this == other); }
+};
+
 /*!
   \class CameraParameters
 
@@ -77,9 +127,20 @@ class CameraParameters {
   CameraExtrinsicParameters* extrinsic_parameters;
 
   void quaternionFromOpenCVCalibration(double Q[]) const;
+  /** copy the current calibration, for projections that should not touch the VarTypes */
+  void getSnapshot(CameraCalibrationSnapshot& snapshot) const;
+  /** apply the changes p of the legacy model (FOCAL_LENGTH ... T_3) to a snapshot */
+  static void applyCalibrationDelta(CameraCalibrationSnapshot& snapshot, const Eigen::VectorXd& p);
   GVector::vector3d<double> getWorldLocation() const;
   void field2image(const GVector::vector3d<double>& p_f, GVector::vector2d<double>& p_i) const;
   void image2field(GVector::vector3d<double>& p_f, const GVector::vector2d<double>& p_i, double z) const;
+  /** project n image points onto the plane at height z, reading the calibration only once */
+  void image2field(int n, const GVector::vector2d<double>* p_i, GVector::vector3d<double>* p_f, double z) const;
+  /** cached lookup grid for image2field at height z, rebuilt only when the calibration changes */
+  std::shared_ptr<const ImageToFieldGrid> getImageToFieldGrid(double z, int width, int height) const;
+  /** same, for a snapshot of this camera that the caller already took */
+  std::shared_ptr<const ImageToFieldGrid> getImageToFieldGrid(const CameraCalibrationSnapshot& calibration,
+                                                              double z, int width, int height) const;
   void calibrate(std::vector<GVector::vector3d<double> >& p_f,
                  std::vector<GVector::vector2d<double> >& p_i,
                  int cal_type);
@@ -218,6 +279,63 @@ class CameraParameters {
   double do_calibration(int cal_type);
   void reset() const;
   void detectCalibrationCorners();
+
+ private:
+  mutable std::mutex grid_mutex;
+  mutable CameraCalibrationSnapshot grid_calibration;
+  mutable std::vector<std::shared_ptr<const ImageToFieldGrid> > grids;
+};
+
+/*!
+  \class ImageToFieldGrid
+
+  \brief Precomputed image2field projection onto a plane of fixed height.
+
+  The exact projection is evaluated at every step-th pixel of the image
+  (including one node past the right and bottom border); points in between
+  are interpolated bilinearly. With the default step the interpolation error
+  stays far below the size of a pixel on the field. Points outside of the
+  image are extrapolated from the nearest cell.
+**/
+class ImageToFieldGrid {
+ public:
+  static const int default_step = 8;
+
+  ImageToFieldGrid(const CameraCalibrationSnapshot& calibration, double z, int width, int height, int step = default_step);
+
+  double getHeight() const { return z; }
+  int getImageWidth() const { return width; }
+  int getImageHeight() const { return height; }
+
+  void image2field(GVector::vector3d<double>& p_f, const GVector::vector2d<double>& p_i) const {
+    double fx = p_i.x * inv_step;
+    double fy = p_i.y * inv_step;
+    int c = std::min(std::max((int)floor(fx), 0), cols - 2);
+    int r = std::min(std::max((int)floor(fy), 0), rows - 2);
+    double a = fx - c;
+    double b = fy - r;
+    const float* n0 = &nodes[2 * (r * cols + c)];
+    const float* n1 = n0 + 2 * cols;
+    p_f.x = (1.0 - b) * ((1.0 - a) * n0[0] + a * n0[2]) + b * ((1.0 - a) * n1[0] + a * n1[2]);
+    p_f.y = (1.0 - b) * ((1.0 - a) * n0[1] + a * n0[3]) + b * ((1.0 - a) * n1[1] + a * n1[3]);
+    p_f.z = z;
+  }
+
+  void image2field(int n, const GVector::vector2d<double>* p_i, GVector::vector3d<double>* p_f) const {
+    for (int i = 0; i < n; i++) {
+      image2field(p_f[i], p_i[i]);
+    }
+  }
+
+ private:
+  double z;
+  int width;
+  int height;
+  int cols;
+  int rows;
+  double inv_step;
+  // field x and y of every node, row by row
+  std::vector<float> nodes;
 };
 
 #endif
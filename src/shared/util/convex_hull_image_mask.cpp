@@ -3,11 +3,26 @@
 #include <tuple>
 #include <iostream>
 
-void computeMask(const ConvexHull &convex_hull, Image<raw8> &mask) {
+void computeSpans(const Image<raw8> &mask, std::vector<MaskSpan> &spans) {
+  const int width = mask.getWidth();
+  spans.resize(mask.getHeight());
+  for (int y = 0; y < mask.getHeight(); ++y) {
+    const unsigned char *row = mask.getData() + y * width;
+    int begin = 0;
+    while (begin < width && row[begin] == 0) ++begin;
+    int end = width;
+    while (end > begin && row[end - 1] == 0) --end;
+    spans[y].begin = begin;
+    spans[y].end = end;
+  }
+}
+
+void computeMask(const ConvexHull &convex_hull, Image<raw8> &mask, std::vector<MaskSpan> &spans) {
   const auto WHITE = raw8(255);
 
   if(convex_hull._points.empty()) {
     mask.fillColor(WHITE);
+    computeSpans(mask, spans);
     return;
   }
 
@@ -19,8 +34,10 @@ void computeMask(const ConvexHull &convex_hull, Image<raw8> &mask) {
     mask.drawLine(a.x, a.y, b.x, b.y, WHITE);
   }
 
-  if (convex_hull.getNumPoints() < 3)
+  if (convex_hull.getNumPoints() < 3) {
+    computeSpans(mask, spans);
     return;
+  }
 
   // linescan, top - bot, left - right
   // first find where the whites should be painted, and then paint them
@@ -41,6 +58,7 @@ void computeMask(const ConvexHull &convex_hull, Image<raw8> &mask) {
     for (int x = minX; x < maxX + 1; ++x)
       mask.setPixel(x, y, WHITE);
   }
+  computeSpans(mask, spans);
 }
 
 void ConvexHullImageMask::slotMaskPointsRead() {
@@ -82,7 +100,7 @@ void ConvexHullImageMask::reset() {
   lock();
 
   _convex_hull.clear();
-  computeMask(_convex_hull, _mask);
+  computeMask(_convex_hull, _mask, _spans);
   _v_list->resetToDefault();
 
   unlock();
@@ -92,7 +110,7 @@ void ConvexHullImageMask::_addPoint(const int x, const int y, const bool add_to_
   const bool changed = _convex_hull.addPoint(x, y);
 
   if (changed) {
-    computeMask(_convex_hull, _mask);
+    computeMask(_convex_hull, _mask, _spans);
 
     if (add_to_list) {
       VarTypes::VarList *point = new VarTypes::VarList();
@@ -119,7 +137,7 @@ void ConvexHullImageMask::removePoint(const int x, const int y, const int margin
       changed = _convex_hull.removePoint(x + w, y + h);
 
   if (changed) {
-    computeMask(_convex_hull, _mask);
+    computeMask(_convex_hull, _mask, _spans);
 
     _v_list->resetToDefault();
     for (auto it = _convex_hull.begin(); it != _convex_hull.end(); ++it) {
@@ -139,7 +157,7 @@ void ConvexHullImageMask::removePoint(const int x, const int y, const int margin
 void ConvexHullImageMask::setSize(const int w, const int h) {
   lock();
   _mask.allocate(w, h);
-  computeMask(_convex_hull, _mask);
+  computeMask(_convex_hull, _mask, _spans);
   unlock();
 }
 
@@ -179,6 +197,10 @@ const Image<raw8>& ConvexHullImageMask::getMask() const {
   return _mask;
 }
 
+const std::vector<MaskSpan>& ConvexHullImageMask::getSpans() const {
+  return _spans;
+}
+
 const ConvexHull& ConvexHullImageMask::getConvexHull() const {
   return _convex_hull;
 }
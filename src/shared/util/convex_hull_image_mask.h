@@ -5,12 +5,20 @@
 #include "convex_hull.h"
 #include "VarTypes.h"
 #include <qmutex.h>
+#include <vector>
+
+/// All masked pixels of a row lie within [begin,end), begin==end if there are none.
+struct MaskSpan {
+  int begin;
+  int end;
+};
 
 class ConvexHullImageMask : public QObject {
   Q_OBJECT
  private:
   ConvexHull _convex_hull;
   Image<raw8> _mask;
+  std::vector<MaskSpan> _spans;
   VarTypes::VarExternal * _v_settings;
   VarTypes::VarList * _v_list;
   mutable QMutex mutex;
@@ -28,6 +36,8 @@ class ConvexHullImageMask : public QObject {
   int getWidth() const;
   int getHeight() const;
   const Image<raw8>& getMask() const;
+  /// one span per row of the mask, only valid while locked (like getMask())
+  const std::vector<MaskSpan>& getSpans() const;
   const ConvexHull& getConvexHull() const;
 
   void lock() const;
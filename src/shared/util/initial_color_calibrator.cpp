@@ -25,6 +25,9 @@
 #include "camera_calibration.h"
 #include "lut3d.h"
 #include "initial_color_calibrator.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <thread>
 
 
 ColorClazz::ColorClazz(
@@ -40,66 +43,110 @@ ColorClazz::ColorClazz(
         maxAngle(maxAngle) {
 }
 
-float InitialColorCalibrator::ratedYuvColorDist(const yuv &c1, const ColorClazz &colorClazz) {
-  yuv c2 = colorClazz.color_yuv;
-  float midToC1U = c1.u - 127;
-  float midToC2U = c2.u - 127;
-  float midToC1V = c1.v - 127;
-  float midToC2V = c2.v - 127;
-  float normFac1 = std::sqrt(midToC1U * midToC1U + midToC1V * midToC1V);
-  float normFac2 = std::sqrt(midToC2U * midToC2U + midToC2V * midToC2V);
-  midToC1U *= 1 / normFac1;
-  midToC1V *= 1 / normFac1;
-  midToC2U *= 1 / normFac2;
-  midToC2V *= 1 / normFac2;
-  float scalar = midToC1U * midToC2U + midToC1V * midToC2V;
+// the chroma direction of a color, (u,v) relative to the gray axis, normalized
+static void chromaDirection(const yuv &c, float &dir_u, float &dir_v) {
+  float midToU = c.u - 127;
+  float midToV = c.v - 127;
+  float normFac = std::sqrt(midToU * midToU + midToV * midToV);
+  dir_u = midToU * (1 / normFac);
+  dir_v = midToV * (1 / normFac);
+}
+
+float InitialColorCalibrator::angleBonus(float dir_u, float dir_v, const ColorClazz &colorClazz,
+                                         float clazz_dir_u, float clazz_dir_v) {
+  float scalar = dir_u * clazz_dir_u + dir_v * clazz_dir_v;
   float angle = std::acos(scalar);
   float relAngle = angle / colorClazz.maxAngle;
   float dMaxHalf = colorClazz.maxDistance * 0.5f;
 
-  float bonus;
   if (relAngle < 1) {
     // give bonus for good angles
-    bonus = (1 - relAngle) * dMaxHalf;
-  } else {
-    // give penalty for bad angles
-    bonus = -relAngle * dMaxHalf;
+    return (1 - relAngle) * dMaxHalf;
   }
-
-  float y = c1.y - c2.y;
-  float u = c1.u - c2.u;
-  float v = c1.v - c2.v;
-
-  float yuvDist = y * y + u * u + v * v;
-  return (yuvDist - bonus) * colorClazz.weight;
+  // give penalty for bad angles
+  return -relAngle * dMaxHalf;
 }
 
 void InitialColorCalibrator::process(const std::vector<ColorClazz> &calibration_points, YUVLUT *global_lut) {
-  global_lut->lock();
-  for (int y = 0; y <= 255; y += (0x1u << global_lut->X_SHIFT)) {
-    for (int u = 0; u <= 255; u += (0x1u << global_lut->Y_SHIFT)) {
-      for (int v = 0; v <= 255; v += (0x1u << global_lut->Z_SHIFT)) {
-        yuv color = yuv(static_cast<unsigned char>(y),
-                        static_cast<unsigned char>(u),
-                        static_cast<unsigned char>(v));
-        float minScore = 1e10;
-        int clazz = 0;
-        float maxDistance = 0;
-        for (auto &colorClazz : calibration_points) {
-          float score = ratedYuvColorDist(color, colorClazz);
-          if (score < minScore) {
-            minScore = score;
-            clazz = colorClazz.clazz;
-            maxDistance = colorClazz.maxDistance;
+  // the bit depths of a LUT never change, so they can be read without the lock
+  const int yn = global_lut->getSizeX();
+  const int un = global_lut->getSizeY();
+  const int vn = global_lut->getSizeZ();
+  const int n = (int) calibration_points.size();
+
+  // everything that does not depend on the full (y,u,v) cell is computed once up front:
+  // the squared y distance of every y cell and the chroma direction of every class
+  std::vector<int> dy2((size_t) n * yn);
+  std::vector<float> clazz_dir_u(n);
+  std::vector<float> clazz_dir_v(n);
+  for (int k = 0; k < n; k++) {
+    const ColorClazz &colorClazz = calibration_points[k];
+    for (int y = 0; y < yn; y++) {
+      int d = global_lut->lut2normX((unsigned char) y) - colorClazz.color_yuv.y;
+      dy2[(size_t) k * yn + y] = d * d;
+    }
+    chromaDirection(colorClazz.color_yuv, clazz_dir_u[k], clazz_dir_v[k]);
+  }
+
+  // the labels are computed into a scratch table without holding the LUT lock, -1 keeps a cell.
+  // Every task takes one u slice, so the tasks write disjoint cells.
+  scratch.assign((size_t) yn * un * vn, -1);
+  auto computeSlice = [&](int u) {
+    std::vector<float> minScore(yn);
+    std::vector<int> best(yn);
+    for (int v = 0; v < vn; v++) {
+      yuv color(0, global_lut->lut2normY((unsigned char) u), global_lut->lut2normZ((unsigned char) v));
+      float dir_u, dir_v;
+      chromaDirection(color, dir_u, dir_v);
+      std::fill(minScore.begin(), minScore.end(), 1e10f);
+      std::fill(best.begin(), best.end(), -1);
+      for (int k = 0; k < n; k++) {
+        const ColorClazz &colorClazz = calibration_points[k];
+        // the angle only depends on the chroma, so sqrt and acos are done once per (u,v) cell
+        float bonus = angleBonus(dir_u, dir_v, colorClazz, clazz_dir_u[k], clazz_dir_v[k]);
+        int du = color.u - colorClazz.color_yuv.u;
+        int dv = color.v - colorClazz.color_yuv.v;
+        int duv2 = du * du + dv * dv;
+        float weight = colorClazz.weight;
+        const int *class_dy2 = &dy2[(size_t) k * yn];
+        for (int y = 0; y < yn; y++) {
+          float score = ((float) (class_dy2[y] + duv2) - bonus) * weight;
+          if (score < minScore[y]) {
+            minScore[y] = score;
+            best[y] = k;
           }
         }
+      }
+      for (int y = 0; y < yn; y++) {
+        if (best[y] >= 0 && minScore[y] < calibration_points[best[y]].maxDistance) {
+          scratch[((size_t) y * un + u) * vn + v] = (int16_t) calibration_points[best[y]].clazz;
+        }
+      }
+    }
+  };
+  int workers = (int) std::thread::hardware_concurrency() - 1;
+  if (workers > 0) {
+    WorkerPool pool(workers);
+    pool.run(un, computeSlice);
+  } else {
+    for (int u = 0; u < un; u++) computeSlice(u);
+  }
 
-        if (minScore < maxDistance) {
-          global_lut->set(color.y, color.u, color.v, static_cast<lut_mask_t>(clazz));
+  // the lock is only held to copy the result, the segmentation sees it at once
+  bool bitwise = global_lut->getChannelMode() == LUTChannelMode_Bitwise;
+  global_lut->lock();
+  for (int y = 0; y < yn; y++) {
+    for (int u = 0; u < un; u++) {
+      const int16_t *labels = &scratch[((size_t) y * un + u) * vn];
+      for (int v = 0; v < vn; v++) {
+        if (labels[v] >= 0) {
+          lut_mask_t mask = bitwise ? (lut_mask_t) (1 << labels[v]) : (lut_mask_t) labels[v];
+          global_lut->set_preshrunk((unsigned char) y, (unsigned char) u, (unsigned char) v, mask);
         }
       }
     }
   }
+  global_lut->publish();
   global_lut->unlock();
-  global_lut->updateDerivedLUTs();
+  global_lut->requestDerivedLUTUpdate();
 }
@@ -22,6 +22,7 @@
 #define INITIAL_COLOR_CALIBRATOR_H
 
 #include "colors.h"
+#include <vector>
 
 class ColorClazz {
 public:
@@ -46,10 +47,16 @@ public:
 
     ~InitialColorCalibrator() = default;
 
+    /// labels every cell of \p global_lut whose best rated class is close enough. The cells are
+    /// rated in parallel without holding the LUT lock, which is only taken to apply the result.
     void process(const std::vector<ColorClazz> &calibration_points, YUVLUT *global_lut);
 
 private:
-    float ratedYuvColorDist(const yuv &c1, const ColorClazz &colorClazz);
+    static float angleBonus(float dir_u, float dir_v, const ColorClazz &colorClazz,
+                            float clazz_dir_u, float clazz_dir_v);
+
+    // label of every cell computed by process(), -1 for cells that keep their label
+    std::vector<int16_t> scratch;
 };
 
 
@@ -19,7 +19,164 @@
 */
 //========================================================================
 #include "lut3d.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+static const char LUT_FILE_MAGIC[8] = {'S','S','L','L','U','T','3','D'};
+static const uint64_t LUT_FILE_ALIGNMENT = 4096;
 
+// converts the fields of a header between the byte order of the host and the
+// little endian one of the file. Does nothing on little endian hosts.
+static void swapHeaderByteOrder(LUTFileHeader & header) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  uint32_t * fields32[] = {&header.version, &header.header_size, &header.x_bits, &header.y_bits, &header.z_bits,
+                           &header.color_space, &header.channel_count, &header.channels_size, &header.checksum,
+                           &header.reserved};
+  for (uint32_t * field : fields32) *field = __builtin_bswap32(*field);
+  header.table_offset = __builtin_bswap64(header.table_offset);
+  header.table_size = __builtin_bswap64(header.table_size);
+#else
+  (void)header;
+#endif
+}
 
+// CRC-32 (IEEE 802.3), continuing from \p crc
+static uint32_t crc32Update(uint32_t crc, const uint8_t * data, size_t size) {
+  static const struct CRCTable {
+    uint32_t entry[256];
+    CRCTable() {
+      for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+        entry[i] = c;
+      }
+    }
+  } table;
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++) {
+    crc = table.entry[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
 
+// serializes the channels as written after the header
+static string channelRecords(const vector<LUTChannel> & channels) {
+  string records;
+  for (const LUTChannel & c : channels) {
+    string label = c.label.substr(0, 255);
+    records += (char)c.draw_color.r;
+    records += (char)c.draw_color.g;
+    records += (char)c.draw_color.b;
+    records += (char)label.size();
+    records += label;
+  }
+  return records;
+}
+
+bool LUT3D::saveBinary(const string & filename) {
+  lock();
+  string records = channelRecords(channels);
+  LUTFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, LUT_FILE_MAGIC, sizeof(header.magic));
+  header.version = LUT_FILE_VERSION;
+  header.header_size = sizeof(LUTFileHeader);
+  header.x_bits = X_BITS;
+  header.y_bits = Y_BITS;
+  header.z_bits = Z_BITS;
+  header.color_space = getColorSpace();
+  header.channel_count = channels.size();
+  header.channels_size = records.size();
+  uint64_t data_end = sizeof(LUTFileHeader) + records.size();
+  header.table_offset = (data_end + LUT_FILE_ALIGNMENT - 1) / LUT_FILE_ALIGNMENT * LUT_FILE_ALIGNMENT;
+  header.table_size = LUT_SIZE * sizeof(lut_mask_t);
+  header.checksum = crc32Update(crc32Update(0, (const uint8_t *)records.data(), records.size()), LUT, header.table_size);
+
+  // written next to the target and renamed, which replaces the file atomically
+  string tmp_filename = filename + ".tmp";
+  FILE * f = fopen(tmp_filename.c_str(), "wb");
+  bool ok = (f != nullptr);
+  if (ok) {
+    vector<char> padding(header.table_offset - data_end, 0);
+    LUTFileHeader file_header = header;
+    swapHeaderByteOrder(file_header);
+    ok = fwrite(&file_header, sizeof(file_header), 1, f) == 1 &&
+         fwrite(records.data(), 1, records.size(), f) == records.size() &&
+         fwrite(padding.data(), 1, padding.size(), f) == padding.size() &&
+         fwrite(LUT, 1, header.table_size, f) == header.table_size;
+    ok = (fclose(f) == 0) && ok;
+  }
+  unlock();
+  if (ok && rename(tmp_filename.c_str(), filename.c_str()) != 0) ok = false;
+  if (!ok) {
+    fprintf(stderr, "LUT3D: Unable to write binary LUT file %s: %s\n", filename.c_str(), strerror(errno));
+    remove(tmp_filename.c_str());
+  }
+  return ok;
+}
+
+bool LUT3D::loadBinary(const string & filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "LUT3D: Unable to open binary LUT file %s: %s\n", filename.c_str(), strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(LUTFileHeader)) {
+    fprintf(stderr, "LUT3D: %s is not a binary LUT file\n", filename.c_str());
+    close(fd);
+    return false;
+  }
+  uint64_t file_size = st.st_size;
+  void * map = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "LUT3D: Unable to map binary LUT file %s: %s\n", filename.c_str(), strerror(errno));
+    return false;
+  }
+  const uint8_t * data = (const uint8_t *)map;
+  LUTFileHeader header;
+  memcpy(&header, data, sizeof(header));
+  swapHeaderByteOrder(header);
+
+  const char * error = nullptr;
+  if (memcmp(header.magic, LUT_FILE_MAGIC, sizeof(header.magic)) != 0 || header.header_size < sizeof(LUTFileHeader)) {
+    error = "not a binary LUT file";
+  } else if (header.version != LUT_FILE_VERSION) {
+    error = "unsupported file version";
+  } else if (header.x_bits != X_BITS || header.y_bits != Y_BITS || header.z_bits != Z_BITS ||
+             header.color_space != (uint32_t)getColorSpace() || header.table_size != LUT_SIZE * sizeof(lut_mask_t)) {
+    error = "the file was written for a LUT of a different size or color space";
+  } else if ((uint64_t)header.header_size + header.channels_size > header.table_offset ||
+             header.table_offset > file_size || header.table_size > file_size - header.table_offset) {
+    error = "the file is truncated";
+  } else if (crc32Update(crc32Update(0, data + header.header_size, header.channels_size), data + header.table_offset,
+                   header.table_size) != header.checksum) {
+    error = "checksum mismatch";
+  }
+
+  if (error == nullptr) {
+    lock();
+    string records((const char *)data + header.header_size, header.channels_size);
+    if (header.channel_count != channels.size() || records != channelRecords(channels)) {
+      error = "the channels of the file differ from the ones of this LUT";
+    } else {
+      memcpy(LUT, data + header.table_offset, header.table_size);
+      markAllDirty();
+    }
+    unlock();
+  }
+  munmap(map, file_size);
+
+  if (error != nullptr) {
+    fprintf(stderr, "LUT3D: Unable to load binary LUT file %s: %s\n", filename.c_str(), error);
+    return false;
+  }
+  updateDerivedLUTs();
+  return true;
+}
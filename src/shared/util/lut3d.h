@@ -24,6 +24,8 @@
 #include "colors.h"
 #include "conversions.h"
 #include <assert.h>
+#include <atomic>
+#include <thread>
 #include <vector>
 #include <string>
 #include <qmutex.h>
@@ -36,8 +38,9 @@
     { --sp; XL = sp->xl; XR = sp->xr; Y = sp->y+(DY = sp->dy); }
 
 
-/// We allow 32 distinct channels (bitwise)
+/// In bitwise mode every bit is a channel, so a LUT holds up to 8 channels
 typedef uint8_t lut_mask_t;
+#define LUT_MAX_BITWISE_CHANNELS (8*sizeof(lut_mask_t))
 
 using namespace std;
 using namespace VarTypes;
@@ -47,8 +50,41 @@ enum LUTChannelMode {
   LUTChannelMode_Bitwise  //each YUV color is mapped to a bitmask, each bit represents a channel
 };
 
+/// memory layout of the table the segmentation reads, see LUT3D::setLayout()
+enum LUTLayout {
+  LUTLayout_Flat,    //x-major: index = (x,y,z). The table is always edited and stored this way
+  LUTLayout_UVMajor  //x innermost: index = (y,z,x). In a YUV LUT all Y cells of one U/V value share a cache line
+};
+
 struct LINESEGMENT { int xl, xr, y, dy; } ;
 
+/*!
+  \struct LUTFileHeader
+  \brief  Header of a binary LUT file, see LUT3D::saveBinary()
+
+  The header is followed by one record per channel (r, g, b, label length,
+  label) and, at table_offset, by the table in flat layout. The table
+  starts on a page boundary, so that it can be mapped on its own. All
+  fields are little endian.
+*/
+struct LUTFileHeader {
+  char magic[8];          //"SSLLUT3D"
+  uint32_t version;       //LUT_FILE_VERSION
+  uint32_t header_size;   //sizeof(LUTFileHeader)
+  uint32_t x_bits;
+  uint32_t y_bits;
+  uint32_t z_bits;
+  uint32_t color_space;
+  uint32_t channel_count;
+  uint32_t channels_size; //bytes of all channel records
+  uint64_t table_offset;
+  uint64_t table_size;
+  uint32_t checksum;      //CRC-32 of the channel records followed by the table
+  uint32_t reserved;
+};
+
+#define LUT_FILE_VERSION 1
+
 /*!
   \class LUTChannel
   \brief  A text and color-label for a channel used in the LUT3D class
@@ -94,14 +130,37 @@ class LUT3D : public QObject {
     unsigned int TOTAL_BITS; //total number of index bits
     unsigned int LUT_SIZE; //total size of LUT in bytes
 
+    //the tables are allocated this many bytes larger than LUT_SIZE, so that vector gathers,
+    //which load 32 bits per entry, may read past the last entry
+    static const unsigned int LUT_PADDING = 64;
+
     lut_mask_t * LUT;
+    //read-only copies of LUT for the segmentation, see publish():
+    lut_mask_t * published[2];
+    LUTLayout published_layout[2];
+    std::atomic<LUTLayout> layout;
+    std::atomic<int> published_idx;
+    mutable std::atomic<int> published_readers[2];
     VarBlob * v_blob;
     VarList * v_settings;
+    string binary_filename;
     vector<LUTChannel> channels;
+    LUTChannelMode channel_mode;
     vector<LUT3D *> derived_LUTs;
     QMutex mutex;
+    //range of x-slices (preshrunk) that changed since the derived LUTs were last updated:
+    int dirty_x_min;
+    int dirty_x_max;
+    std::atomic<bool> derive_requested;
   protected slots:
     void slotVBlobChange() {
+      lock();
+      markAllDirty();
+      unlock();
+      updateDerivedLUTs();
+    }
+    void slotDeriveRequested() {
+      derive_requested=false;
       updateDerivedLUTs();
     }
   public:
@@ -122,10 +181,27 @@ class LUT3D : public QObject {
 
       Z_AND_Y_BITS = Y_BITS+Z_BITS; // bits for each field
       TOTAL_BITS = X_BITS + Y_BITS + Z_BITS; // bits for each field
-      //LUT_SIZE = (0x1 << (TOTAL_BITS+1)) - 0x01;
-      LUT_SIZE = (0x01 << (TOTAL_BITS+1));// + 1;
+      LUT_SIZE = (0x01 << TOTAL_BITS);
       channels.resize(sizeof(lut_mask_t));
-      LUT=new lut_mask_t[LUT_SIZE];
+      channel_mode=LUTChannelMode_Numeric;
+      LUT=new lut_mask_t[LUT_SIZE+LUT_PADDING]();
+      published[0]=new lut_mask_t[LUT_SIZE+LUT_PADDING]();
+      published[1]=new lut_mask_t[LUT_SIZE+LUT_PADDING]();
+      published_layout[0]=LUTLayout_Flat;
+      published_layout[1]=LUTLayout_Flat;
+      layout=LUTLayout_Flat;
+      published_idx=0;
+      published_readers[0]=0;
+      published_readers[1]=0;
+      derive_requested=false;
+      clearDirty();
+
+      //binary LUT files (see saveBinary()) are kept next to the XML file by default
+      binary_filename=filename;
+      if (binary_filename.size() > 4 && binary_filename.compare(binary_filename.size()-4,4,".xml")==0) {
+        binary_filename.resize(binary_filename.size()-4);
+      }
+      if (binary_filename!="") binary_filename+=".lut";
 
       if (filename=="") {
         v_settings=0;
@@ -139,6 +215,21 @@ class LUT3D : public QObject {
       reset();
     };
 
+    /// Writes the table and its channels as a binary LUT file. It loads much faster than the
+    /// base64 blob of the XML settings, which stay the place the LUT is stored in. The file is
+    /// replaced atomically, so a process loading it never sees a partial one.
+    bool saveBinary(const string & filename);
+
+    /// Replaces the table with the one of a binary LUT file written by saveBinary() for a LUT with
+    /// the same bit depths and channels, and publishes it. The file is mapped and fully validated
+    /// (header, sizes, channels, checksum) before the table is touched. Returns false on errors.
+    bool loadBinary(const string & filename);
+
+    /// the default file name for saveBinary() and loadBinary(), empty if the LUT is not stored
+    string getBinaryFilename() const {
+      return binary_filename;
+    }
+
     bool copyLUT(lut_mask_t *pDataLUT, int size_copy, int color_index=-1) {   //memory copy of other camera LUT
         int size_allocated = LUT ? sizeof(lut_mask_t)*LUT_SIZE : 0;
         if (size_copy!=size_allocated) {
@@ -147,6 +238,7 @@ class LUT3D : public QObject {
             return false;
         }
         lock();                             //step 1: copy LUT from blob
+        markAllDirty();
         if(color_index == -1) {
             memcpy(LUT, pDataLUT, sizeof(lut_mask_t)*LUT_SIZE);
         } else {
@@ -206,6 +298,8 @@ class LUT3D : public QObject {
       lock();
       if (lut!=0) {
         derived_LUTs.push_back(lut);
+        //the new LUT has to be derived completely:
+        markAllDirty();
       }
       unlock();
     }
@@ -224,16 +318,130 @@ class LUT3D : public QObject {
       return result;
     }
 
+    /// re-derives all derived LUTs from the x-slices of this LUT that changed since the last update
+    /// and publishes all of them
     void updateDerivedLUTs() {
       lock();
       int n = derived_LUTs.size();
       for (int i = 0; i < n; i ++) {
         derived_LUTs[i]->copyChannels(*this);
-        derived_LUTs[i]->deriveFromLUT(this);
+        if (dirty_x_min <= dirty_x_max) {
+          derived_LUTs[i]->deriveFromLUTSlices(this, dirty_x_min, dirty_x_max);
+          derived_LUTs[i]->publish();
+        }
       }
+      if (dirty_x_min <= dirty_x_max) publish();
+      clearDirty();
       unlock(); 
     }
 
+    /// Makes the current table visible to the segmentation, which reads it through a LUTReadGuard
+    /// without taking the lock. The table is copied into the published buffer that is not in use,
+    /// rearranged to the selected layout; readers still holding it from two publishes ago are
+    /// waited for. Call with the lock held once an edit is complete.
+    void publish() {
+      int next = 1 - published_idx.load();
+      while (published_readers[next].load() != 0) {
+        std::this_thread::yield();
+      }
+      LUTLayout l=layout.load();
+      if (l==LUTLayout_Flat) {
+        memcpy(published[next],LUT,LUT_SIZE*sizeof(lut_mask_t));
+      } else {
+        unsigned int x_pos,y_pos,z_pos;
+        getIndexPositions(l,x_pos,y_pos,z_pos);
+        lut_mask_t * target=published[next];
+        const lut_mask_t * source=LUT;
+        int xn=getSizeX();
+        int yn=getSizeY();
+        int zn=getSizeZ();
+        for (int x=0;x!=xn;x++) {
+          for (int y=0;y!=yn;y++) {
+            unsigned int xy=(x << x_pos) | (y << y_pos);
+            for (int z=0;z!=zn;z++) {
+              target[xy | (z << z_pos)]=*source++;
+            }
+          }
+        }
+      }
+      published_layout[next]=l;
+      published_idx.store(next);
+    }
+
+    /// bit offsets of the x, y and z cell index within a table index of layout \p l
+    void getIndexPositions(LUTLayout l, unsigned int & x_pos, unsigned int & y_pos, unsigned int & z_pos) const {
+      if (l==LUTLayout_UVMajor) {
+        x_pos=0;
+        z_pos=X_BITS;
+        y_pos=X_BITS+Z_BITS;
+      } else {
+        x_pos=Z_AND_Y_BITS;
+        y_pos=Z_BITS;
+        z_pos=0;
+      }
+    }
+
+    LUTLayout getLayout() const {
+      return layout.load();
+    }
+
+    /// selects the layout of the published table and republishes it if it changed
+    void setLayout(LUTLayout l) {
+      lock();
+      if (layout.load()!=l) {
+        layout=l;
+        publish();
+      }
+      unlock();
+    }
+
+    /// returns the published table and keeps it from being overwritten until releasePublished(idx)
+    const lut_mask_t * acquirePublished(int & idx) const {
+      while (true) {
+        idx = published_idx.load();
+        published_readers[idx]++;
+        //the buffer may have been swapped out (and be rewritten) in between
+        if (published_idx.load() == idx) return published[idx];
+        published_readers[idx]--;
+      }
+    }
+
+    void releasePublished(int idx) const {
+      published_readers[idx]--;
+    }
+
+    /// Schedules updateDerivedLUTs() on the thread this LUT lives in (the main thread), so that
+    /// e.g. capture threads do not have to wait for it. Requests are merged until the update runs.
+    void requestDerivedLUTUpdate() {
+      if (!derive_requested.exchange(true)) {
+        QMetaObject::invokeMethod(this, "slotDeriveRequested", Qt::QueuedConnection);
+      }
+    }
+
+    /// marks the x-slices [x_min,x_max] (preshrunk) as changed. set() and set_preshrunk() do this
+    /// on their own, code that writes to the table directly has to call it (or markAllDirty()).
+    inline void markDirty(int x_min, int x_max) {
+      if (x_min < dirty_x_min) dirty_x_min=x_min;
+      if (x_max > dirty_x_max) dirty_x_max=x_max;
+    }
+
+    void markAllDirty() {
+      markDirty(0,getMaxX());
+    }
+
+    void clearDirty() {
+      dirty_x_min=getSizeX();
+      dirty_x_max=-1;
+    }
+
+    /// re-derives the cells that depend on the x-slices [x_min,x_max] of \p lut. LUTs that can
+    /// not tell which cells these are derive everything.
+    virtual void deriveFromLUTSlices(LUT3D * lut, int x_min, int x_max) {
+      (void)x_min;
+      (void)x_max;
+      deriveFromLUT(lut);
+    }
+
     virtual void deriveFromLUT(LUT3D * lut) {
       for (int x=0;x<=255;x++) {
         for (int y=0;y<=255;y++) {
@@ -292,6 +500,8 @@ class LUT3D : public QObject {
       channels.clear();
       clearDerivedLUTs(true);
       delete[] LUT;
+      delete[] published[0];
+      delete[] published[1];
       if (v_blob!=0) delete v_blob;
       if (v_settings!=0) delete v_settings;
     };
@@ -303,6 +513,7 @@ class LUT3D : public QObject {
     void reset() {
       lock();
       memset(LUT,0x00,LUT_SIZE*sizeof(lut_mask_t));
+      markAllDirty();
       unlock();
     };
 
@@ -338,10 +549,12 @@ class LUT3D : public QObject {
     }
 
     inline void set(unsigned char x, unsigned char y,unsigned char z, lut_mask_t mask) {
+      markDirty(x >> X_SHIFT,x >> X_SHIFT);
       LUT[((x >> X_SHIFT) << Z_AND_Y_BITS) | ((y >> Y_SHIFT) << Z_BITS) | (z >> Z_SHIFT)]=mask;
     }
 
     inline void set_preshrunk(unsigned char x, unsigned char y,unsigned char z, lut_mask_t mask) {
+      markDirty(x,x);
       LUT[((x) << Z_AND_Y_BITS) | ((y) << Z_BITS) | (z)]=mask;
     }
 
@@ -364,9 +577,15 @@ class LUT3D : public QObject {
       for (int i=0;i<n;i++) {
         channels.push_back(other.getChannel(i));
       }
+      channel_mode=other.getChannelMode();
       unlock();
     }
 
+    /// How the entries of the table map to channels, set by the load...Channels() functions
+    LUTChannelMode getChannelMode() const {
+      return channel_mode;
+    }
+
     void loadRoboCupChannels(LUTChannelMode mode) {
       lock();
       channels.clear();
@@ -380,6 +599,9 @@ class LUT3D : public QObject {
       channels.push_back(LUTChannel("Green",RGB::Green));
       channels.push_back(LUTChannel("White",RGB::White));
       channels.push_back(LUTChannel("Black",RGB::Black));
+      //there is one bit per channel, so in bitwise mode "Black" does not fit anymore
+      if (mode==LUTChannelMode_Bitwise && channels.size() > LUT_MAX_BITWISE_CHANNELS) channels.resize(LUT_MAX_BITWISE_CHANNELS);
+      channel_mode=mode;
       unlock();
     }
 
@@ -389,6 +611,7 @@ class LUT3D : public QObject {
       if (mode==LUTChannelMode_Numeric) channels.push_back(LUTChannel("<Clear>",RGB::Black));
       channels.push_back(LUTChannel("White",RGB::White));
       channels.push_back(LUTChannel("Black",RGB::Black));
+      channel_mode=mode;
       unlock();
     }
 
@@ -494,43 +717,116 @@ class LUT3D : public QObject {
 };
 
 
+/*!
+  \class LUTReadGuard
+  \brief  Lock-free read access to the published table of a LUT3D
+
+  The table stays valid and unchanged while the guard exists. Do not lock
+  the LUT while holding a guard, as publish() waits for old readers.
+*/
+class LUTReadGuard {
+  public:
+  explicit LUTReadGuard(const LUT3D * lut) : _lut(lut) {
+    _table=_lut->acquirePublished(_idx);
+    _layout=_lut->published_layout[_idx];
+  }
+  ~LUTReadGuard() {
+    _lut->releasePublished(_idx);
+  }
+  LUTReadGuard(const LUTReadGuard &) = delete;
+  LUTReadGuard & operator=(const LUTReadGuard &) = delete;
+
+  const LUT3D * getLUT() const {
+    return _lut;
+  }
+  const lut_mask_t * getTable() const {
+    return _table;
+  }
+  /// the layout of getTable(), index it with LUT3D::getIndexPositions() of this layout
+  LUTLayout getLayout() const {
+    return _layout;
+  }
+
+  private:
+  const LUT3D * _lut;
+  const lut_mask_t * _table;
+  LUTLayout _layout;
+  int _idx;
+};
+
 /*!
   \class RGBLUT
   \brief  A 3D RGB LUT
   \author Stefan Zickler
 */
 class RGBLUT : public LUT3D {
+  protected:
+  //the cells of this LUT sorted by the x-slice of the source LUT they are derived from.
+  //cells of slice i are in [slice_start[i],slice_start[i+1])
+  vector<int> target_cells;
+  vector<int> source_cells;
+  vector<int> slice_start;
+  unsigned int source_bits[3];
+
+  void buildDerivationTable(LUT3D * lut) {
+    int n=getSizeX()*getSizeY()*getSizeZ();
+    int slices=lut->getSizeX();
+    vector<int> source(n);
+    slice_start.assign(slices+1,0);
+    int y,u,v;
+    int rn=this->getSizeX();
+    int gn=this->getSizeY();
+    int bn=this->getSizeZ();
+    for (int r=0;r!=rn;r++) {
+      for (int g=0;g!=gn;g++) {
+        for (int b=0;b!=bn;b++) {
+          int i=getPointerPreshrunk(r,g,b)-LUT;
+          Conversions::rgb2yuv((int)lut2normX((unsigned char)r),(int)lut2normY((unsigned char)g),(int)lut2normZ((unsigned char)b),y,u,v);
+          source[i]=lut->getPointer((unsigned char)y,(unsigned char)u,(unsigned char)v)-lut->getTable();
+          slice_start[(source[i] >> lut->Z_AND_Y_BITS)+1]++;
+        }
+      }
+    }
+    for (int i=0;i<slices;i++) slice_start[i+1]+=slice_start[i];
+
+    target_cells.resize(n);
+    source_cells.resize(n);
+    vector<int> next(slice_start.begin(),slice_start.end()-1);
+    for (int i=0;i<n;i++) {
+      int j=next[source[i] >> lut->Z_AND_Y_BITS]++;
+      target_cells[j]=i;
+      source_cells[j]=source[i];
+    }
+    source_bits[0]=lut->X_BITS;
+    source_bits[1]=lut->Y_BITS;
+    source_bits[2]=lut->Z_BITS;
+  }
+
   public:
-  RGBLUT(unsigned int r_bits=5, unsigned int g_bits=5, unsigned int b_bits=5, string filename="rgblut.xml") : LUT3D(r_bits, g_bits, b_bits,filename) {};
+  RGBLUT(unsigned int r_bits=5, unsigned int g_bits=5, unsigned int b_bits=5, string filename="rgblut.xml") : LUT3D(r_bits, g_bits, b_bits,filename) {
+    source_bits[0]=source_bits[1]=source_bits[2]=0;
+  };
   virtual void deriveFromLUT(LUT3D * lut) {
+    deriveFromLUTSlices(lut,0,lut->getMaxX());
+  }
+
+  /// only updates the RGB cells whose color falls into the YUV slices [x_min,x_max]
+  virtual void deriveFromLUTSlices(LUT3D * lut, int x_min, int x_max) {
     if (lut->getColorSpace()!=CSPACE_YUV) {
       fprintf(stderr,"Warning: deriveFromLUT input on RGBLUT does not seem to be in YUV color-space\n");
     } else {
-      // OLD :
-      /*int y,u,v;
-      for (int r=0;r<=255;r++) {
-        for (int g=0;g<=255;g++) {
-          for (int b=0;b<=255;b++) {
-            Conversions::rgb2yuv(r,g,b,y,u,v);
-            set((unsigned char)r,(unsigned char)g,(unsigned char)b,lut->get((unsigned char)y,(unsigned char)u,(unsigned char)v));
-          }
-        }
-      }*/
-      
-      //new, faster:
-      int y,u,v;
-      int rn=this->getSizeX();
-      int gn=this->getSizeY();
-      int bn=this->getSizeZ();
-      for (int r=0;r!=rn;r++) {
-        for (int g=0;g!=gn;g++) {
-          for (int b=0;b!=bn;b++) {
-            Conversions::rgb2yuv((int)lut2normX((unsigned char)r),(int)lut2normY((unsigned char)g),(int)lut2normZ((unsigned char)b),y,u,v);
-            set_preshrunk(r,g,b,lut->get((unsigned char)y,(unsigned char)u,(unsigned char)v));
-          }
-        }
+      //the rgb2yuv conversions only have to be done once per source LUT layout
+      if (source_bits[0]!=lut->X_BITS || source_bits[1]!=lut->Y_BITS || source_bits[2]!=lut->Z_BITS) {
+        buildDerivationTable(lut);
+      }
+      x_min=max(x_min,0);
+      x_max=min(x_max,lut->getMaxX());
+      if (x_min > x_max) return;
+      const lut_mask_t * source=lut->getTable();
+      int end=slice_start[x_max+1];
+      for (int i=slice_start[x_min];i<end;i++) {
+        LUT[target_cells[i]]=source[source_cells[i]];
       }
-      
     }
   }
 
@@ -606,6 +902,7 @@ class YUVLUT : public LUT3D {
         }
       }
     }
+    publish();
     this->unlock();
   }
   virtual ColorSpace getColorSpace() const {
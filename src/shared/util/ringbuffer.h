@@ -22,6 +22,10 @@
 #ifndef RINGBUFFER_H_
 #define RINGBUFFER_H_
 #include <qmutex.h>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
 
 /*!
   \class RingBuffer
@@ -40,56 +44,76 @@
   The ringbuffer ensures that
     1) the reader and the writer will NEVER access the same bin at the same time
     2) the reader will not leap ahead over the writer
+
+  The buffer is lock-free for one writer and one reader: the write-bin,
+  the read-bin, the most recently completed bin and its sequence number are
+  packed into a single atomic word which both sides update with
+  compare-and-swap. Every completed bin is tagged with a sequence number,
+  so a reader can tell a new frame from a repeat without taking a lock.
 */
 
 template <class ITEM>
 class RingBuffer {
   protected:
-    QMutex mutex;
     QMutex readlock;
+
+    // layout of the packed state word
+    static const int IDX_BITS=8;
+    static const uint64_t IDX_MASK=(1ULL << IDX_BITS) - 1;
+    static const int WRITE_SHIFT=0;
+    static const int READ_SHIFT=IDX_BITS;
+    static const int LATEST_SHIFT=2*IDX_BITS;
+    static const int SEQ_SHIFT=3*IDX_BITS;
+
+    static int unpackWrite(uint64_t state) { return (int)((state >> WRITE_SHIFT) & IDX_MASK); }
+    static int unpackRead(uint64_t state) { return (int)((state >> READ_SHIFT) & IDX_MASK); }
+    static int unpackLatest(uint64_t state) { return (int)((state >> LATEST_SHIFT) & IDX_MASK); }
+    static uint64_t unpackSequence(uint64_t state) { return state >> SEQ_SHIFT; }
+    static uint64_t pack(int write, int read, int latest, uint64_t seq) {
+      return ((uint64_t)write << WRITE_SHIFT) | ((uint64_t)read << READ_SHIFT) |
+             ((uint64_t)latest << LATEST_SHIFT) | (seq << SEQ_SHIFT);
+    }
   public:
     ITEM * items;
   private:
-    int current_read;
-    int current_write;
-    int previous_write;
-    int previous_read;
+    std::atomic<uint64_t> state;
+    // sequence number of the frame stored in each bin.
+    // written by the writer before publishing, read by the reader that holds the bin.
+    uint64_t * sequences;
   public:
     int size;
     /*!
       \brief Constructor of the Ringbuffer
       \param _size determines how many elements are stored in it.
 
-      Note that \p _size needs to be at least 2!
+      Note that \p _size needs to be at least 3 for the writer to keep
+      publishing frames while a reader holds a bin, and at most 255.
+      Other sizes are clamped to that range with a warning.
     */
     RingBuffer ( int _size ) {
+      assert ( _size >= 3 && (uint64_t)_size <= IDX_MASK );
+      // the assert is compiled out in release builds, where the size is clamped instead
+      if ( _size < 3 || (uint64_t)_size > IDX_MASK ) {
+        int clamped = ( _size < 3 ) ? 3 : (int)IDX_MASK;
+        printf ( "WARNING: a ring buffer of %d bins is not supported, using %d bins!\n",_size,clamped );
+        _size = clamped;
+      }
       items=new ITEM[_size];
-
-      current_read=0;
-      previous_read=-1;
-      previous_write=0;
-      current_write=1;
+      sequences=new uint64_t[_size];
+      for ( int i=0;i<_size;i++ ) sequences[i]=0;
       size=_size;
 
+      // the reader starts on bin 0, the writer on bin 1
+      state.store ( pack ( 1,0,0,0 ) );
     }
     virtual ~RingBuffer() {
       delete[] items;
+      delete[] sequences;
     }
   private:
-    int next ( int cur_idx, int not_avail, bool preventLap ) {
-      //if preventLap is true then we won't jump over
-      //not_avail.
+    int next ( int cur_idx ) const {
       int idx=cur_idx+1;
       if ( idx >= size ) idx=0;
-      if ( idx < 0 ) idx=0;
-      if ( idx == not_avail ) {
-        if ( preventLap ) {
-          idx=cur_idx;
-        } else {
-          idx++;
-        }
-      }
-      if ( idx >= size || idx==-1 ) idx=0;
       return idx;
     }
   public:
@@ -113,25 +137,44 @@ class RingBuffer {
     }
 
     /*!
-      \brief gets the index to the next write-bin
+      \brief publishes the current write-bin and gets the index to the next write-bin
+
+      The bin that was written up to now becomes the most recent frame and
+      receives the next sequence number.
 
       If \p allow_lapping is true then this function can overtake the
-      read-pointer. This means that we are overwriting old frames which
-      have not been read yet.
-      if \p allow_lapping is false then we will not overatake a read-pointer.
+      read-pointer: the bin held by the reader is jumped over, so that
+      a slow reader never stalls the writer.
+      If \p allow_lapping is false then we will not overtake a read-pointer.
       Instead, we will stay at our current location and thus return the same
       index as on the previous call. this means that our caller can overwrite
       the most recently written frame with the actually most recent frame.
+      A bin that is going to be overwritten is not published.
+
+      Either way, the writer never enters the bin held by the reader.
 
-      nextWrite is thread-safe and atomic.
+      nextWrite is thread-safe and lock-free.
     */
     int nextWrite ( bool allow_lapping ) {
-      mutex.lock();
-      previous_write=current_write;
-      current_write=next ( current_write,current_read, allow_lapping );
-      int res=current_write;
-      mutex.unlock();
-      return res;
+      uint64_t cur=state.load ( std::memory_order_relaxed );
+      while ( true ) {
+        int write=unpackWrite ( cur );
+        int read=unpackRead ( cur );
+        int idx=next ( write );
+        if ( idx == read ) {
+          idx = allow_lapping ? next ( idx ) : write;
+          if ( idx == write ) {
+            // nowhere to go: keep overwriting the current bin
+            return write;
+          }
+        }
+        uint64_t seq=unpackSequence ( cur ) + 1;
+        sequences[write]=seq;
+        uint64_t desired=pack ( idx,read,write,seq );
+        if ( state.compare_exchange_weak ( cur,desired,std::memory_order_acq_rel,std::memory_order_relaxed ) ) {
+          return idx;
+        }
+      }
     }
 
     /*!
@@ -148,48 +191,57 @@ class RingBuffer {
       Thus, it is possible that nextRead will return the same index as on the previous call
       if we are unable to move on because the write-pointer is in front of us.
 
-      nextRead is thread-safe and atomic.
+      nextRead is thread-safe and lock-free.
     */
     int nextRead ( bool skip_frames ) {
-      mutex.lock();
-      previous_read=current_read;
-      if ( skip_frames ) {
-        int prev_frame;
-        if ( previous_write==0 ) {
-          prev_frame=size-1;
+      uint64_t cur=state.load ( std::memory_order_acquire );
+      while ( true ) {
+        int write=unpackWrite ( cur );
+        int read=unpackRead ( cur );
+        int idx;
+        if ( skip_frames ) {
+          idx=unpackLatest ( cur );
         } else {
-          prev_frame=previous_write-1;
-          if ( prev_frame < 0 ) prev_frame=0;
+          idx=next ( read );
+          if ( idx == write ) idx=read;
+        }
+        if ( idx == read ) return read;
+        uint64_t desired=pack ( write,idx,unpackLatest ( cur ),unpackSequence ( cur ) );
+        if ( state.compare_exchange_weak ( cur,desired,std::memory_order_acq_rel,std::memory_order_acquire ) ) {
+          return idx;
         }
-        current_read=next ( prev_frame,current_write,true );
-      } else {
-        current_read=next ( current_read,current_write,true );
       }
-      int res=current_read;
-      mutex.unlock();
-      return res;
     }
 
     /*!
       \brief returns the index of the current write-bin
     */
-    int curWrite() {
-      int res;
-      mutex.lock();
-      res=current_write;
-      mutex.unlock();
-      return res;
+    int curWrite() const {
+      return unpackWrite ( state.load ( std::memory_order_acquire ) );
     }
 
     /*!
       \brief returns the index of the current read-bin
     */
-    int curRead() {
-      int res;
-      mutex.lock();
-      res=current_read;
-      mutex.unlock();
-      return res;
+    int curRead() const {
+      return unpackRead ( state.load ( std::memory_order_acquire ) );
+    }
+
+    /*!
+      \brief returns the sequence number of the frame in the current read-bin
+
+      Sequence numbers start at 1 for the first published frame, 0 means that
+      the bin has never been written.
+    */
+    uint64_t curReadSequence() const {
+      return sequences[curRead()];
+    }
+
+    /*!
+      \brief returns the sequence number of the most recently published frame
+    */
+    uint64_t latestSequence() const {
+      return unpackSequence ( state.load ( std::memory_order_acquire ) );
     }
 
     /*!
@@ -0,0 +1,144 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    worker_pool.cpp
+  \brief   C++ Implementation: WorkerPool
+*/
+//========================================================================
+#include "worker_pool.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+WorkerPool::WorkerPool(int num_workers, const std::vector<int> & cpus) {
+  job_task = nullptr;
+  job_num_tasks = 0;
+  next_task = 0;
+  pending_workers = 0;
+  generation = 0;
+  stop = false;
+  spin_limit = ((int)std::thread::hardware_concurrency() > num_workers) ? SPIN_ITERATIONS : 0;
+
+  for (int i = 0; i < num_workers; i++) {
+    threads.emplace_back(&WorkerPool::workerLoop, this, i);
+    if (!cpus.empty()) {
+      cpu_set_t cpu_set;
+      CPU_ZERO(&cpu_set);
+      CPU_SET(cpus[i % cpus.size()], &cpu_set);
+      if (pthread_setaffinity_np(threads.back().native_handle(), sizeof(cpu_set), &cpu_set) != 0) {
+        fprintf(stderr, "WorkerPool: unable to pin worker %d to cpu %d\n", i, cpus[i % cpus.size()]);
+      }
+    }
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(park_mutex);
+    stop = true;
+  }
+  park_cond.notify_all();
+  for (auto & thread : threads) {
+    thread.join();
+  }
+}
+
+void WorkerPool::cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  _mm_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+void WorkerPool::processTasks() {
+  int task;
+  while ((task = next_task.fetch_add(1, std::memory_order_relaxed)) < job_num_tasks) {
+    (*job_task)(task);
+  }
+}
+
+void WorkerPool::workerLoop(int id) {
+  (void)id;
+  uint64_t seen = 0;
+  while (true) {
+    // spin for a while, then park until a new job arrives
+    int spins = 0;
+    while (generation.load(std::memory_order_acquire) == seen && !stop.load(std::memory_order_relaxed)) {
+      spins++;
+      if (spins < spin_limit) {
+        cpuRelax();
+      } else if (spins < spin_limit + YIELD_ITERATIONS) {
+        std::this_thread::yield();
+      } else {
+        std::unique_lock<std::mutex> lock(park_mutex);
+        park_cond.wait(lock, [this, seen]() {
+          return generation.load(std::memory_order_acquire) != seen || stop.load(std::memory_order_relaxed);
+        });
+      }
+    }
+    if (stop.load(std::memory_order_relaxed)) return;
+    seen = generation.load(std::memory_order_acquire);
+
+    processTasks();
+    pending_workers.fetch_sub(1, std::memory_order_acq_rel);
+  }
+}
+
+void WorkerPool::run(int num_tasks, const std::function<void(int)> & task) {
+  if (num_tasks <= 0) return;
+  if (threads.empty() || num_tasks == 1) {
+    for (int i = 0; i < num_tasks; i++) task(i);
+    return;
+  }
+
+  job_task = &task;
+  job_num_tasks = num_tasks;
+  next_task.store(0, std::memory_order_relaxed);
+  pending_workers.store((int)threads.size(), std::memory_order_relaxed);
+  {
+    // the lock orders the publication against workers about to park
+    std::lock_guard<std::mutex> lock(park_mutex);
+    generation.fetch_add(1, std::memory_order_release);
+  }
+  park_cond.notify_all();
+
+  processTasks();
+
+  // every worker has to check in before the job can be reused
+  int spins = 0;
+  while (pending_workers.load(std::memory_order_acquire) != 0) {
+    if (++spins < spin_limit) {
+      cpuRelax();
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void WorkerPool::runTiles(int total, int tile_rows, const std::function<void(int, int)> & task) {
+  if (total <= 0) return;
+  if (tile_rows <= 0) tile_rows = total;
+  int num_tiles = (total + tile_rows - 1) / tile_rows;
+  run(num_tiles, [&](int tile) {
+    int first = tile * tile_rows;
+    int end = first + tile_rows;
+    if (end > total) end = total;
+    task(first, end);
+  });
+}
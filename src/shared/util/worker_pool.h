@@ -0,0 +1,96 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    worker_pool.h
+  \brief   C++ Interface: WorkerPool
+*/
+//========================================================================
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*!
+  \class   WorkerPool
+  \brief   A persistent pool of worker threads for fork-join style data parallelism
+
+  The pool keeps its threads alive between jobs. After finishing a job a
+  worker busy-waits for a short while, so that jobs submitted at a high
+  rate are picked up within microseconds, and then parks on a condition
+  variable so that an idle pool does not burn any CPU. Busy-waiting is
+  skipped if there are not more cpus than workers.
+
+  A job is a number of independent tasks. Tasks are handed out dynamically
+  to the workers *and* to the calling thread, so uneven tasks balance out.
+  run() returns when all tasks are done.
+
+  Only one job can run at a time; run() is meant to be called from a single
+  thread, e.g. the capture thread owning the plugin.
+*/
+class WorkerPool {
+public:
+  /// creates \p num_workers additional threads. If \p cpus is not empty,
+  /// worker i is pinned to cpu cpus[i % cpus.size()].
+  explicit WorkerPool(int num_workers, const std::vector<int> & cpus = std::vector<int>());
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool & operator=(const WorkerPool &) = delete;
+
+  /// number of additional worker threads
+  int getNumWorkers() const {
+    return (int)threads.size();
+  }
+
+  /// runs task(0) .. task(num_tasks-1) in parallel and returns when all of them are done
+  void run(int num_tasks, const std::function<void(int)> & task);
+
+  /// splits \p total rows into tiles of \p tile_rows rows (the last tile takes the remainder)
+  /// and runs task(first_row, end_row) for every tile
+  void runTiles(int total, int tile_rows, const std::function<void(int, int)> & task);
+
+private:
+  void workerLoop(int id);
+  void processTasks();
+  static void cpuRelax();
+
+  std::vector<std::thread> threads;
+
+  // the current job
+  const std::function<void(int)> * job_task;
+  int job_num_tasks;
+  std::atomic<int> next_task;
+  std::atomic<int> pending_workers;
+  std::atomic<uint64_t> generation;
+  std::atomic<bool> stop;
+
+  // busy-wait iterations before yielding/parking, 0 if the machine is oversubscribed
+  int spin_limit;
+
+  // parking of idle workers
+  std::mutex park_mutex;
+  std::condition_variable park_cond;
+
+  static const int SPIN_ITERATIONS = 20000;
+  static const int YIELD_ITERATIONS = 100;
+};
+
+#endif
@@ -0,0 +1,132 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    test_camera_calibration.cpp
+  \brief   Runs a four point calibration after a full one
+
+  A full estimation leaves the alphas of all detected line points in
+  CameraParameters::p_alpha. The four point calibration that follows
+  estimates no alphas and has to ignore them: it must end at exactly the
+  parameters of a four point calibration of a fresh camera from the same
+  start. The image points are projections of a known camera, so both
+  also have to fit the control points. Returns 0 if they do.
+*/
+//========================================================================
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+#include "camera_calibration.h"
+#include "field.h"
+
+typedef GVector::vector2d<double> vec2;
+typedef GVector::vector3d<double> vec3;
+
+static int failures = 0;
+
+static void check(bool ok, const char * what) {
+  if (ok) return;
+  failures++;
+  printf("FAILED: %s\n", what);
+}
+
+static void getParameters(const CameraParameters & camera, double values[10]) {
+  VarDouble * vars[10] = {camera.focal_length, camera.principal_point_x, camera.principal_point_y,
+                          camera.distortion, camera.q0, camera.q1, camera.q2, camera.q3,
+                          camera.tx, camera.ty};
+  for (int i = 0; i < 10; i++) values[i] = vars[i]->getDouble();
+}
+
+// the start of every calibration: the default parameters, which reset() does not restore for the height
+static void startCalibration(CameraParameters & camera) {
+  camera.reset();
+  camera.tz->resetToDefault();
+  camera.additional_calibration_information->convergence_timeout->setDouble(1000.0);
+}
+
+int main() {
+  RoboCupField field;
+
+  // the camera that takes the image points: a bit off the default parameters
+  CameraParameters truth(0, &field);
+  truth.focal_length->setDouble(520.0);
+  truth.tx->setDouble(150.0);
+  truth.ty->setDouble(1100.0);
+  double q[4] = {0.72, -0.68, 0.03, 0.02};
+  double q_norm = sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+  truth.q0->setDouble(q[0] / q_norm);
+  truth.q1->setDouble(q[1] / q_norm);
+  truth.q2->setDouble(q[2] / q_norm);
+  truth.q3->setDouble(q[3] / q_norm);
+
+  // control points and straight lines on the field, both seen by that camera
+  std::vector<vec3> p_f;
+  std::vector<vec2> p_i;
+  const vec2 corners[4] = {vec2(150, 120), vec2(630, 120), vec2(150, 460), vec2(630, 460)};
+  for (const vec2 & corner : corners) {
+    vec3 point;
+    truth.image2field(point, corner, 0.0);
+    p_f.push_back(point);
+    p_i.push_back(corner);
+  }
+
+  std::vector<CameraParameters::CalibrationData> segments;
+  for (int k = 0; k < 4; k++) {
+    CameraParameters::CalibrationData segment;
+    truth.image2field(segment.p1, vec2(100 + 150 * k, 60), 0.0);
+    truth.image2field(segment.p2, vec2(140 + 150 * k, 520), 0.0);
+    for (int i = 1; i < 20; i++) {
+      double alpha = i / 20.0;
+      vec2 image_point;
+      truth.field2image(alpha * segment.p1 + (1.0 - alpha) * segment.p2, image_point);
+      segment.points.emplace_back(image_point, true);
+      // the position along the line is only roughly known
+      segment.alphas.push_back(alpha + ((i % 3) - 1) * 0.01);
+    }
+    segments.push_back(segment);
+  }
+
+  // a full estimation first, then a four point calibration from the start parameters
+  CameraParameters camera(0, &field);
+  camera.calibrationSegments = segments;
+  startCalibration(camera);
+  camera.calibrate(p_f, p_i, CameraParameters::FULL_ESTIMATION);
+  check(camera.p_alpha.size() == 4 * 19, "the full estimation did not estimate the alphas of all points");
+  startCalibration(camera);
+  camera.calibrate(p_f, p_i, CameraParameters::FOUR_POINT_INITIAL);
+
+  // the four point calibration alone
+  CameraParameters fresh(0, &field);
+  startCalibration(fresh);
+  fresh.calibrate(p_f, p_i, CameraParameters::FOUR_POINT_INITIAL);
+
+  double values[10], fresh_values[10];
+  getParameters(camera, values);
+  getParameters(fresh, fresh_values);
+  for (int i = 0; i < 10; i++) {
+    if (fabs(values[i] - fresh_values[i]) > 1e-9 * (1.0 + fabs(fresh_values[i]))) {
+      printf("parameter %d: %f after a full estimation, %f without\n", i, values[i], fresh_values[i]);
+      check(false, "the four point calibration depends on the alphas of the full estimation before");
+      break;
+    }
+  }
+  check(camera.calculateFourPointRmse(p_f, p_i) < 1.0, "the four point calibration does not fit the control points");
+
+  if (failures > 0) {
+    printf("%d checks failed\n", failures);
+    return 1;
+  }
+  printf("four point calibration is independent of the full estimation before\n");
+  return 0;
+}
@@ -0,0 +1,149 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    test_connect_components.cpp
+  \brief   Compares the labeling in bands of rows with the serial one
+
+  The same run list is labeled by the serial connectComponents() and by
+  the parallel one, which splits it into bands of rows and joins the
+  labels along the seams between them. A pool of one worker cuts an
+  image of up to 8 rows into one band per row, so images of 2 to 8 rows
+  hit every band count up to 8, larger images and pools more of them.
+  Regions that only connect across a seam are drawn on purpose: columns
+  through all rows, and combs whose teeth only meet in the last row.
+  The parents and the extracted regions have to be the same. Returns 0
+  if they are.
+*/
+//========================================================================
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "cmvision_region.h"
+#include "convex_hull_image_mask.h"
+#include "worker_pool.h"
+
+using namespace CMVision;
+
+static int failures = 0;
+
+static void check(bool ok, const char * what, int workers, int width, int height) {
+  if (ok) return;
+  failures++;
+  if (failures <= 20) printf("FAILED: %s differs with %d workers (%dx%d)\n", what, workers, width, height);
+}
+
+// fills a row with runs, mostly short ones or mostly long ones, of a few labels including clear
+static void fillRow(raw8 * row, int width, int num_labels) {
+  bool short_runs = rand() % 2;
+  for (int x = 0; x < width;) {
+    int length = short_runs ? 1 + rand() % 3 : 1 + rand() % 150;
+    uint8_t label = (rand() % 3 == 0) ? 0 : rand() % num_labels;
+    for (int i = 0; i < length && x < width; i++, x++) row[x] = raw8(label);
+  }
+}
+
+// draws a column through all rows and a comb, whose teeth are only connected by the last row
+static void drawSeamShapes(Image<raw8> & image) {
+  int width = image.getWidth();
+  int height = image.getHeight();
+  raw8 * pixels = image.getPixelData();
+  int column = rand() % width;
+  for (int y = 0; y < height; y++) pixels[y * width + column] = raw8(1);
+  if (width < 8) return;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      if (x == column) continue;
+      bool tooth = (x % 4) == 1;
+      pixels[y * width + x] = raw8((tooth || y == height - 1) ? 2 : 0);
+    }
+  }
+}
+
+static void copyRuns(const RunList & source, RunList & target) {
+  for (int i = 0; i < source.getUsedRuns(); i++) target.setRun(i, source.getRun(i));
+  target.setUsedRuns(source.getUsedRuns());
+}
+
+static bool sameParents(const RunList & a, const RunList & b) {
+  if (a.getUsedRuns() != b.getUsedRuns()) return false;
+  return memcmp(a.getParentArray(), b.getParentArray(), a.getUsedRuns() * sizeof(int)) == 0;
+}
+
+static bool sameRegions(const RegionList & a, const RunList & a_runs, const RegionList & b, const RunList & b_runs) {
+  if (a.getUsedRegions() != b.getUsedRegions()) return false;
+  for (int i = 0; i < a.getUsedRegions(); i++) {
+    const Region & r = a.getRegionArrayPointer()[i];
+    const Region & s = b.getRegionArrayPointer()[i];
+    if (r.color != s.color || r.x1 != s.x1 || r.y1 != s.y1 || r.x2 != s.x2 || r.y2 != s.y2 ||
+        r.cen_x != s.cen_x || r.cen_y != s.cen_y || r.area != s.area || r.run_start != s.run_start) return false;
+  }
+  // the runs of each region are chained through next
+  return sameParents(a_runs, b_runs) &&
+         memcmp(a_runs.getNextArray(), b_runs.getNextArray(), a_runs.getUsedRuns() * sizeof(int)) == 0;
+}
+
+// labels an image serially and on the pool, in full rows and within random spans
+static void testImage(WorkerPool & pool, int width, int height, bool seam_shapes) {
+  Image<raw8> image;
+  image.allocate(width, height);
+  for (int y = 0; y < height; y++) fillRow(image.getPixelData() + y * width, width, 4);
+  if (seam_shapes) drawSeamShapes(image);
+
+  // rows without any pixel in the mask have no runs, so bands may start and end at gaps
+  std::vector<MaskSpan> spans(height);
+  for (int y = 0; y < height; y++) {
+    spans[y].begin = rand() % (width + 1);
+    spans[y].end = (rand() % 4 == 0) ? spans[y].begin : spans[y].begin + rand() % (width - spans[y].begin + 1);
+  }
+  const MaskSpan * image_spans[] = {nullptr, spans.data()};
+
+  int max_runs = width * height + height;
+  RunList serial(max_runs), banded(max_runs);
+  RegionList serial_regions(max_runs), banded_regions(max_runs);
+  for (int i = 0; i < 2; i++) {
+    RegionProcessing::encodeRuns(&image, &serial, image_spans[i]);
+    if (serial.getUsedRuns() == 0) continue;
+    copyRuns(serial, banded);
+    RegionProcessing::connectComponents(&serial);
+    RegionProcessing::connectComponents(&banded, &pool);
+    check(sameParents(serial, banded), "parent", pool.getNumWorkers(), width, height);
+    RegionProcessing::extractRegions(&serial_regions, &serial);
+    RegionProcessing::extractRegions(&banded_regions, &banded);
+    check(sameRegions(serial_regions, serial, banded_regions, banded), "region list", pool.getNumWorkers(), width, height);
+  }
+}
+
+int main() {
+  srand(1);
+  for (int workers = 1; workers <= 3; workers++) {
+    WorkerPool pool(workers);
+    printf("testing %d workers\n", workers);
+    // one band per row up to the maximum number of bands, then larger images
+    for (int height = 2; height <= 4 * (workers + 1); height++) {
+      for (int k = 0; k < 50; k++) {
+        testImage(pool, 1 + rand() % 200, height, k % 2 == 0);
+      }
+    }
+    for (int k = 0; k < 50; k++) testImage(pool, 1 + rand() % 1000, 1 + rand() % 200, k % 2 == 0);
+  }
+
+  if (failures > 0) {
+    printf("%d comparisons failed\n", failures);
+    return 1;
+  }
+  printf("all labels match\n");
+  return 0;
+}
@@ -0,0 +1,178 @@
+//========================================================================
+//  This software is free: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License Version 3,
+//  as published by the Free Software Foundation.
+//
+//  This software is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  Version 3 in the file COPYING that came with this distribution.
+//  If not, see <http://www.gnu.org/licenses/>.
+//========================================================================
+/*!
+  \file    test_runlength_encode.cpp
+  \brief   Compares the vector run-length encoders with the scalar one
+
+  Every instruction set the cpu supports is selected in turn with
+  CMVisionThreshold::setInstructionSet() and has to produce exactly the
+  runs of the scalar encoder: for random rows with short and long runs,
+  all widths up to a few vector lengths (so that every length of the row
+  tail is hit), within the spans of a mask, truncated at the maximum
+  number of runs, and for rows that end right before an unmapped page,
+  which the masked loads must not touch. Returns 0 if all runs match.
+*/
+//========================================================================
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+#include "cmvision_region.h"
+#include "cmvision_threshold.h"
+#include "convex_hull_image_mask.h"
+
+using namespace CMVision;
+
+static int failures = 0;
+
+static void check(bool ok, const char * isa, const char * what, int width, int height) {
+  if (ok) return;
+  failures++;
+  if (failures <= 20) printf("FAILED: %s differs from scalar for %s (%dx%d)\n", isa, what, width, height);
+}
+
+// fills a row with runs, mostly short ones or mostly long ones, of a few labels including clear
+static void fillRow(raw8 * row, int width, int num_labels) {
+  bool short_runs = rand() % 2;
+  for (int x = 0; x < width;) {
+    int length = short_runs ? 1 + rand() % 3 : 1 + rand() % 150;
+    uint8_t label = (rand() % 3 == 0) ? 0 : rand() % num_labels;
+    for (int i = 0; i < length && x < width; i++, x++) row[x] = raw8(label);
+  }
+}
+
+static bool sameRuns(const RunList & a, const RunList & b) {
+  if (a.getUsedRuns() != b.getUsedRuns()) return false;
+  for (int i = 0; i < a.getUsedRuns(); i++) {
+    Run r = a.getRun(i);
+    Run s = b.getRun(i);
+    if (r.x != s.x || r.y != s.y || r.width != s.width || r.color != s.color ||
+        r.parent != s.parent || r.next != s.next) return false;
+  }
+  return true;
+}
+
+static bool sameRuns(const std::vector<Run> & a, int a_used, const std::vector<Run> & b, int b_used) {
+  if (a_used != b_used) return false;
+  for (int i = 0; i < a_used; i++) {
+    if (a[i].x != b[i].x || a[i].y != b[i].y || a[i].width != b[i].width || a[i].color != b[i].color ||
+        a[i].parent != b[i].parent || a[i].next != b[i].next) return false;
+  }
+  return true;
+}
+
+// encodes an image with the selected and with the scalar encoder, in full,
+// within random spans, truncated and as bitplanes
+static void testImage(CMVisionThreshold::InstructionSet isa, int width, int height) {
+  const char * name = CMVisionThreshold::getInstructionSetName(isa);
+  Image<raw8> image;
+  image.allocate(width, height);
+  for (int y = 0; y < height; y++) fillRow(image.getPixelData() + y * width, width, 8);
+
+  std::vector<MaskSpan> spans(height);
+  Image<raw8> masked;
+  masked.allocate(width, height);
+  for (int y = 0; y < height; y++) {
+    spans[y].begin = rand() % (width + 1);
+    spans[y].end = spans[y].begin + rand() % (width - spans[y].begin + 1);
+    const raw8 * source = image.getPixelData() + y * width;
+    raw8 * row = masked.getPixelData() + y * width;
+    for (int x = 0; x < width; x++) {
+      row[x] = (x < spans[y].begin || x >= spans[y].end) ? raw8(0) : source[x];
+    }
+  }
+
+  int full_runs = width * height + height;
+  int truncated_runs = 1 + rand() % (width * height / 2 + 1);
+  RunList expected(full_runs), runs(full_runs);
+  RunList expected_truncated(truncated_runs), runs_truncated(truncated_runs);
+  RunList expected_planes(8 * full_runs), runs_planes(8 * full_runs);
+  Image<raw8> * images[] = {&image, &masked};
+  const MaskSpan * image_spans[] = {nullptr, spans.data()};
+  const char * names[] = {"full rows", "rows within spans"};
+
+  for (int i = 0; i < 2; i++) {
+    CMVisionThreshold::setInstructionSet(CMVisionThreshold::ISA_SCALAR);
+    RegionProcessing::encodeRuns(images[i], &expected, image_spans[i]);
+    RegionProcessing::encodeRuns(images[i], &expected_truncated, image_spans[i]);
+    RegionProcessing::encodeBitplanes(images[i], &expected_planes, 8, image_spans[i]);
+    CMVisionThreshold::setInstructionSet(isa);
+    RegionProcessing::encodeRuns(images[i], &runs, image_spans[i]);
+    RegionProcessing::encodeRuns(images[i], &runs_truncated, image_spans[i]);
+    RegionProcessing::encodeBitplanes(images[i], &runs_planes, 8, image_spans[i]);
+    check(sameRuns(expected, runs), name, names[i], width, height);
+    check(sameRuns(expected_truncated, runs_truncated), name, "a truncated run list", width, height);
+    check(sameRuns(expected_planes, runs_planes), name, "bitplanes", width, height);
+  }
+
+  // single rows into an array of Run, cut off at every possible maximum
+  std::vector<Run> expected_row(width + 1), row_runs(width + 1);
+  const raw8 * row = masked.getPixelData();
+  for (int max_runs = 1; max_runs <= width + 1; max_runs++) {
+    CMVisionThreshold::setInstructionSet(CMVisionThreshold::ISA_SCALAR);
+    int n = RegionProcessing::encodeRow(row, width, spans[0].begin, spans[0].end, 0, expected_row.data(), 0, max_runs);
+    CMVisionThreshold::setInstructionSet(isa);
+    int m = RegionProcessing::encodeRow(row, width, spans[0].begin, spans[0].end, 0, row_runs.data(), 0, max_runs);
+    check(sameRuns(expected_row, n, row_runs, m), name, "a row cut off at max_runs", width, 1);
+  }
+}
+
+// encodes rows that end at the last byte before a page that must not be read
+static void testRowsAtPageEnd(CMVisionThreshold::InstructionSet isa, int max_width) {
+  const char * name = CMVisionThreshold::getInstructionSetName(isa);
+  long page = sysconf(_SC_PAGESIZE);
+  long size = ((max_width + page - 1) / page) * page;
+  uint8_t * memory = (uint8_t *)mmap(nullptr, size + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    printf("FAILED: unable to map the guard page\n");
+    failures++;
+    return;
+  }
+  mprotect(memory + size, page, PROT_NONE);
+  std::vector<Run> expected(max_width + 1), runs(max_width + 1);
+  for (int width = 1; width <= max_width; width++) {
+    raw8 * row = (raw8 *)(memory + size - width);
+    fillRow(row, width, 8);
+    CMVisionThreshold::setInstructionSet(CMVisionThreshold::ISA_SCALAR);
+    int n = RegionProcessing::encodeRow(row, width, 0, expected.data(), 0, width + 1);
+    CMVisionThreshold::setInstructionSet(isa);
+    int m = RegionProcessing::encodeRow(row, width, 0, runs.data(), 0, width + 1);
+    check(sameRuns(expected, n, runs, m), name, "a row at the end of a page", width, 1);
+  }
+  munmap(memory, size + page);
+}
+
+int main() {
+  srand(1);
+  CMVisionThreshold::InstructionSet best = CMVisionThreshold::getInstructionSet();
+  for (int i = CMVisionThreshold::ISA_SSE41; i <= best; i++) {
+    CMVisionThreshold::InstructionSet isa = (CMVisionThreshold::InstructionSet)i;
+    printf("testing %s\n", CMVisionThreshold::getInstructionSetName(isa));
+    // every row width up to three 64 byte vectors, then a few larger images
+    for (int width = 1; width <= 3 * 64 + 1; width++) testImage(isa, width, 1 + rand() % 8);
+    for (int k = 0; k < 20; k++) testImage(isa, 1 + rand() % 1000, 1 + rand() % 50);
+    testRowsAtPageEnd(isa, 3 * 64 + 1);
+  }
+  if (best == CMVisionThreshold::ISA_SCALAR) printf("the cpu has no vector encoder, nothing to compare\n");
+  CMVisionThreshold::setInstructionSet(best);
+
+  if (failures > 0) {
+    printf("%d comparisons failed\n", failures);
+    return 1;
+  }
+  printf("all runs match\n");
+  return 0;
+}